@@ -0,0 +1,339 @@
+#include "archive.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <ios>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+[[noreturn]] static void invalid_archive() {
+    throw std::ios::failure("Not a huf archive!");
+}
+
+static void write_integer(std::vector<Archive::character_type>& output,
+                          std::uint64_t value, std::size_t size) {
+    for (std::size_t byte = 0; byte < size; byte++) {
+        output.push_back(
+            static_cast<Archive::character_type>(value >> (8 * byte)));
+    }
+}
+
+static std::uint64_t read_integer(
+    std::basic_istream<Archive::character_type>& input, std::size_t size) {
+    std::array<Archive::character_type, 8> bytes;
+    if (!input.read(bytes.data(), size)) {
+        ::invalid_archive();
+    }
+    std::uint64_t value = 0;
+    for (std::size_t byte = size; byte-- > 0;) {
+        value = value << 8 | static_cast<std::uint8_t>(bytes[byte]);
+    }
+    return value;
+}
+
+namespace {
+constexpr std::size_t footer_size = 8 + 8 + Archive::directory_magic.size();
+// Longer names are taken for a corrupt directory
+constexpr std::size_t max_name_size = 1 << 16;
+// Bytes copied or read at a time
+constexpr std::size_t chunk_size = 1 << 16;
+
+// Holds a member's container until its turn to be written: in memory up to
+// `spill_size` bytes, then in a temporary file
+class Spill : public std::basic_streambuf<Archive::character_type> {
+   public:
+    Spill() = default;
+    Spill(const Spill&) = delete;
+    Spill& operator=(const Spill&) = delete;
+    ~Spill() override {
+        if (file != nullptr) {
+            std::fclose(file);
+        }
+    }
+
+    std::uint64_t size() const { return spilled + bytes.size(); }
+
+    // Writes everything held to `output`
+    void copy_to(std::basic_ostream<Archive::character_type>& output) {
+        if (file != nullptr) {
+            std::vector<Archive::character_type> chunk(chunk_size);
+            std::rewind(file);
+            for (auto left = spilled; left > 0;) {
+                const auto count = std::min<std::uint64_t>(left, chunk.size());
+                if (std::fread(chunk.data(), 1, count, file) != count) {
+                    throw std::ios::failure("Cannot read a spilled member");
+                }
+                output.write(chunk.data(), count);
+                left -= count;
+            }
+        }
+        output.write(bytes.data(), bytes.size());
+    }
+
+   protected:
+    std::streamsize xsputn(const Archive::character_type* data,
+                           std::streamsize count) override {
+        if (file == nullptr && bytes.size() + count > Archive::spill_size) {
+            file = std::tmpfile();
+            if (file == nullptr) {
+                throw std::ios::failure("Cannot spill a member");
+            }
+            write(bytes.data(), bytes.size());
+            bytes = {};
+        }
+        if (file != nullptr) {
+            write(data, count);
+        } else {
+            bytes.insert(bytes.end(), data, data + count);
+        }
+        return count;
+    }
+
+    int_type overflow(int_type letter) override {
+        if (!traits_type::eq_int_type(letter, traits_type::eof())) {
+            const auto byte = traits_type::to_char_type(letter);
+            xsputn(&byte, 1);
+        }
+        return traits_type::not_eof(letter);
+    }
+
+   private:
+    void write(const Archive::character_type* data, std::size_t count) {
+        if (std::fwrite(data, 1, count, file) != count) {
+            throw std::ios::failure("Cannot spill a member");
+        }
+        spilled += count;
+    }
+
+   private:
+    std::vector<Archive::character_type> bytes;
+    std::FILE* file = nullptr;
+    std::uint64_t spilled = 0;
+};
+}  // namespace
+
+Container::Stats Archive::create(const std::vector<std::string>& files,
+                                 std::basic_ostream<character_type>& output,
+                                 const Container::Options& options) {
+    Container::Stats stats;
+    output.write(magic.data(), magic.size());
+    stats.output_size = magic.size();
+
+    // Members keep the threads busy on their own; only a few large ones
+    // leave threads over for their blocks
+    auto member_options = options;
+    member_options.threads = std::max<std::size_t>(
+        options.threads / std::max<std::size_t>(files.size(), 1), 1);
+    struct Compressed {
+        std::unique_ptr<Spill> bytes;
+        Container::Stats stats;
+    };
+    Directory directory;
+    Parallel::StealingPool pool(options.threads);
+    Parallel::InOrder<Compressed, Parallel::StealingPool> writer(
+        pool, [&](Compressed compressed) {
+            directory.push_back(Member{files[directory.size()],
+                                       stats.output_size,
+                                       compressed.bytes->size(),
+                                       compressed.stats.input_size});
+            compressed.bytes->copy_to(output);
+            stats += compressed.stats;
+        });
+    for (const auto& file : files) {
+        writer.submit([&file, &member_options]() -> Compressed {
+            std::basic_ifstream<character_type> input(file, std::ios::binary);
+            if (!input) {
+                throw std::ios::failure("No such file to archive: " + file);
+            }
+            Compressed compressed{std::make_unique<Spill>(), {}};
+            std::basic_ostream<character_type> member(compressed.bytes.get());
+            member.exceptions(std::ios::badbit);
+            compressed.stats =
+                Container::compress(input, member, member_options);
+            return compressed;
+        });
+    }
+    writer.finish();
+
+    std::vector<character_type> end;
+    for (const auto& member : directory) {
+        ::write_integer(end, member.name.size(), 4);
+        end.insert(end.end(), member.name.begin(), member.name.end());
+        ::write_integer(end, member.offset, 8);
+        ::write_integer(end, member.compressed_size, 8);
+        ::write_integer(end, member.size, 8);
+    }
+    ::write_integer(end, directory.size(), 8);
+    ::write_integer(end, stats.output_size, 8);
+    end.insert(end.end(), directory_magic.begin(), directory_magic.end());
+    output.write(end.data(), end.size());
+    stats.output_size += end.size();
+    return stats;
+}
+
+bool Archive::is_archive(std::basic_istream<character_type>& input) {
+    std::array<character_type, magic.size()> signature;
+    const bool archive =
+        input.read(signature.data(), signature.size()) && signature == magic;
+    input.clear();
+    input.seekg(0);
+    return archive;
+}
+
+Archive::Directory Archive::read_directory(
+    std::basic_istream<character_type>& input) {
+    if (!is_archive(input)) {
+        ::invalid_archive();
+    }
+    input.seekg(0, std::ios::end);
+    const std::uint64_t size = input.tellg();
+    if (size < magic.size() + footer_size) {
+        ::invalid_archive();
+    }
+    input.seekg(size - footer_size);
+    const auto count = ::read_integer(input, 8);
+    const auto offset = ::read_integer(input, 8);
+    std::array<character_type, directory_magic.size()> signature;
+    if (!input.read(signature.data(), signature.size()) ||
+        signature != directory_magic || offset < magic.size() ||
+        offset > size - footer_size) {
+        ::invalid_archive();
+    }
+    input.seekg(offset);
+    Directory directory;
+    std::uint64_t next = magic.size();
+    for (std::uint64_t i = 0; i < count; i++) {
+        Member member;
+        const auto name_size = ::read_integer(input, 4);
+        if (name_size > max_name_size) {
+            ::invalid_archive();
+        }
+        member.name.resize(name_size);
+        if (!input.read(member.name.data(), member.name.size())) {
+            ::invalid_archive();
+        }
+        member.offset = ::read_integer(input, 8);
+        member.compressed_size = ::read_integer(input, 8);
+        member.size = ::read_integer(input, 8);
+        // Members follow each other up to the directory
+        if (member.offset != next ||
+            member.compressed_size > offset - member.offset) {
+            ::invalid_archive();
+        }
+        next = member.offset + member.compressed_size;
+        directory.push_back(std::move(member));
+    }
+    if (next != offset ||
+        input.tellg() != static_cast<std::streamoff>(size - footer_size)) {
+        ::invalid_archive();
+    }
+    return directory;
+}
+
+const Archive::Member& Archive::find_member(const Directory& directory,
+                                            const std::string& name) {
+    const auto member =
+        std::find_if(directory.begin(), directory.end(),
+                     [&name](const Member& member) {
+                         return member.name == name;
+                     });
+    if (member == directory.end()) {
+        throw std::ios::failure("No such member in the archive: " + name);
+    }
+    return *member;
+}
+
+// Reads the bytes of a member from the archive's own buffer a chunk at a
+// time, positions counting from the start of the member
+class Archive::MemberBuffer : public std::basic_streambuf<character_type> {
+   public:
+    MemberBuffer(std::basic_streambuf<character_type>* archive,
+                 const Member& member)
+        : archive(archive),
+          offset(member.offset),
+          size(member.compressed_size),
+          chunk(chunk_size) {}
+
+   protected:
+    int_type underflow() override {
+        if (gptr() == egptr()) {
+            const auto count = read_at(end, chunk.data(), chunk.size());
+            setg(chunk.data(), chunk.data(), chunk.data() + count);
+            end += count;
+        }
+        return gptr() == egptr() ? traits_type::eof()
+                                 : traits_type::to_int_type(*gptr());
+    }
+
+    // Large reads skip the chunk
+    std::streamsize xsgetn(character_type* data,
+                           std::streamsize count) override {
+        const auto buffered =
+            std::min<std::streamsize>(count, egptr() - gptr());
+        std::copy_n(gptr(), buffered, data);
+        gbump(static_cast<int>(buffered));
+        if (buffered == count) {
+            return count;
+        }
+        const auto read = read_at(end, data + buffered, count - buffered);
+        end += read;
+        setg(chunk.data(), chunk.data(), chunk.data());
+        return buffered + read;
+    }
+
+    pos_type seekoff(off_type off, std::ios::seekdir dir,
+                     std::ios::openmode which) override {
+        const auto position = static_cast<off_type>(end - (egptr() - gptr()));
+        return seekpos(dir == std::ios::beg   ? off
+                       : dir == std::ios::cur ? position + off
+                                              : static_cast<off_type>(size) +
+                                                    off,
+                       which);
+    }
+
+    pos_type seekpos(pos_type position, std::ios::openmode) override {
+        if (position < 0 || static_cast<std::uint64_t>(position) > size) {
+            return pos_type(off_type(-1));
+        }
+        end = position;
+        setg(chunk.data(), chunk.data(), chunk.data());
+        return position;
+    }
+
+   private:
+    // Reads up to `count` bytes at `position` of the member
+    std::size_t read_at(std::uint64_t position, character_type* data,
+                        std::size_t count) {
+        count = std::min<std::uint64_t>(count, size - position);
+        if (count == 0) {
+            return 0;
+        }
+        const auto target = static_cast<off_type>(offset + position);
+        const auto wanted = static_cast<std::streamsize>(count);
+        if (archive->pubseekpos(target, std::ios::in) != pos_type(target) ||
+            archive->sgetn(data, wanted) != wanted) {
+            ::invalid_archive();
+        }
+        return count;
+    }
+
+   private:
+    std::basic_streambuf<character_type>* archive;
+    std::uint64_t offset;
+    std::uint64_t size;
+    std::vector<character_type> chunk;
+    // Position in the member of the end of the chunk
+    std::uint64_t end = 0;
+};
+
+Archive::MemberInput::MemberInput(std::basic_istream<character_type>& archive,
+                                  const Member& member)
+    : std::basic_istream<character_type>(nullptr),
+      buffer(std::make_unique<MemberBuffer>(archive.rdbuf(), member)) {
+    rdbuf(buffer.get());
+    exceptions(std::ios::badbit);
+}
+
+Archive::MemberInput::~MemberInput() = default;
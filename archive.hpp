@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "container.hpp"
+
+// An archive holds files compressed independently of each other, so any
+// one of them can be read without going through the rest:
+//
+//   magic      "HUFA"
+//   members    a container each, one after the other
+//   directory  per member: u32 name size, name, u64 offset of its
+//              container, u64 container size, u64 uncompressed size
+//   footer     u64 member count, u64 directory offset, `directory_magic`
+//
+// Integers are little-endian.
+namespace Archive {
+
+using character_type = Container::character_type;
+
+constexpr std::array<character_type, 4> magic = {'H', 'U', 'F', 'A'};
+constexpr std::array<character_type, 4> directory_magic = {'H', 'U', 'F',
+                                                           'C'};
+
+struct Member {
+    std::string name;
+    // Offset of the member's container from the start of the archive
+    std::uint64_t offset;
+    std::uint64_t compressed_size;
+    std::uint64_t size;
+};
+
+using Directory = std::vector<Member>;
+
+constexpr std::size_t spill_size = 1 << 20;
+
+// Compresses every file of `files`, which name their members, into its own
+// container. Members are coded concurrently on `options.threads` threads;
+// the output does not depend on their number. Containers waiting for their
+// turn to be written spill to temporary files past `spill_size` bytes.
+Container::Stats create(const std::vector<std::string>& files,
+                        std::basic_ostream<character_type>& output,
+                        const Container::Options& options);
+
+// Whether a seekable input starts like an archive; rewinds it either way
+bool is_archive(std::basic_istream<character_type>& input);
+
+Directory read_directory(std::basic_istream<character_type>& input);
+
+// Throws if the archive has no member of that name
+const Member& find_member(const Directory& directory,
+                          const std::string& name);
+
+class MemberBuffer;
+
+// The member's container as a seekable stream of its own, read from the
+// archive as it goes without touching the other members. The archive's
+// stream must outlive it and is left where the reads leave it.
+class MemberInput : public std::basic_istream<character_type> {
+   public:
+    MemberInput(std::basic_istream<character_type>& archive,
+                const Member& member);
+    ~MemberInput();
+
+   private:
+    std::unique_ptr<MemberBuffer> buffer;
+};
+}  // namespace Archive
@@ -0,0 +1,659 @@
+#include "async_file.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <deque>
+#include <exception>
+#include <ios>
+#include <optional>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "thread_pool.hpp"
+
+namespace {
+using Chunk = std::vector<AsyncFile::character_type>;
+// Bytes each io_uring write submits at most, 0 for the whole chunk
+std::atomic<std::size_t> ring_write_limit = 0;
+}  // namespace
+
+[[noreturn]] static void io_error(const char* what) {
+    throw std::ios::failure(what,
+                            std::error_code(errno, std::generic_category()));
+}
+
+// Reads what is available, up to `size` bytes; 0 at the end of the file
+static std::size_t read_some(int file, AsyncFile::character_type* data,
+                             std::size_t size) {
+    while (true) {
+        const auto read = ::read(file, data, size);
+        if (read >= 0) {
+            return read;
+        }
+        if (errno != EINTR) {
+            ::io_error("Cannot read");
+        }
+    }
+}
+
+static void write_all(int file, const AsyncFile::character_type* data,
+                      std::size_t size) {
+    while (size > 0) {
+        const auto written = ::write(file, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ::io_error("Cannot write");
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+static bool is_regular(int file) {
+    struct stat status;
+    return ::fstat(file, &status) == 0 && S_ISREG(status.st_mode);
+}
+
+#ifdef HAVE_IO_URING
+namespace {
+// Bare io_uring submission and completion rings, driven by a single thread
+class Ring {
+   public:
+    struct Completion {
+        std::uint64_t tag;
+        std::int32_t result;
+    };
+
+    explicit Ring(unsigned entries) {
+        io_uring_params params{};
+        file = static_cast<int>(
+            ::syscall(SYS_io_uring_setup, entries, &params));
+        if (file < 0) {
+            return;
+        }
+        // Older kernels map the rings apart and lack plain reads and writes
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+            !(params.features & IORING_FEAT_RW_CUR_POS)) {
+            ::close(file);
+            file = -1;
+            return;
+        }
+        rings_size = std::max<std::size_t>(
+            params.sq_off.array + params.sq_entries * sizeof(unsigned),
+            params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        rings = ::mmap(nullptr, rings_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, file, IORING_OFF_SQ_RING);
+        sqes = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, file, IORING_OFF_SQES);
+        if (rings == MAP_FAILED || sqes == MAP_FAILED) {
+            release();
+            return;
+        }
+        auto* base = static_cast<char*>(rings);
+        sq_tail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+    }
+
+    ~Ring() { release(); }
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    explicit operator bool() const { return file >= 0; }
+
+    // Queues a read or write of `size` bytes at `offset` and submits it
+    void submit(std::uint8_t opcode, int target, void* data, unsigned size,
+                std::uint64_t offset, std::uint64_t tag) {
+        const auto tail = *sq_tail;
+        const auto index = tail & sq_mask;
+        auto& sqe = static_cast<io_uring_sqe*>(sqes)[index];
+        sqe = io_uring_sqe{};
+        sqe.opcode = opcode;
+        sqe.fd = target;
+        sqe.addr = reinterpret_cast<std::uint64_t>(data);
+        sqe.len = size;
+        sqe.off = offset;
+        sqe.user_data = tag;
+        sq_array[index] = index;
+        std::atomic_ref(*sq_tail).store(tail + 1, std::memory_order_release);
+        enter(1, 0, 0);
+    }
+
+    // Waits for the next completion
+    Completion wait() {
+        while (true) {
+            const auto head = *cq_head;
+            if (head != std::atomic_ref(*cq_tail).load(
+                            std::memory_order_acquire)) {
+                const auto& cqe = cqes[head & cq_mask];
+                const Completion completion{cqe.user_data, cqe.res};
+                std::atomic_ref(*cq_head).store(head + 1,
+                                                std::memory_order_release);
+                return completion;
+            }
+            enter(0, 1, IORING_ENTER_GETEVENTS);
+        }
+    }
+
+   private:
+    void enter(unsigned submit, unsigned complete, unsigned flags) {
+        while (::syscall(SYS_io_uring_enter, file, submit, complete, flags,
+                         nullptr, 0) < 0) {
+            if (errno != EINTR) {
+                ::io_error("Cannot submit I/O");
+            }
+        }
+    }
+
+    void release() {
+        if (rings != nullptr && rings != MAP_FAILED) {
+            ::munmap(rings, rings_size);
+        }
+        if (sqes != nullptr && sqes != MAP_FAILED) {
+            ::munmap(sqes, sqes_size);
+        }
+        rings = sqes = nullptr;
+        if (file >= 0) {
+            ::close(file);
+            file = -1;
+        }
+    }
+
+   private:
+    int file = -1;
+    void* rings = nullptr;
+    std::size_t rings_size = 0;
+    void* sqes = nullptr;
+    std::size_t sqes_size = 0;
+    unsigned* sq_tail = nullptr;
+    unsigned sq_mask = 0;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+};
+
+// A chunk the kernel reads into or writes from, tagged with its position
+// in the queue
+struct Flight {
+    Chunk chunk;
+    std::uint64_t offset;
+    std::optional<std::int32_t> result;
+};
+}  // namespace
+
+// Waits for the completions of every flight, queued from `first_tag` on
+static void land(Ring& ring, std::deque<Flight>& flights,
+                 std::uint64_t first_tag) {
+    for (auto& flight : flights) {
+        while (!flight.result) {
+            const auto completion = ring.wait();
+            flights[completion.tag - first_tag].result = completion.result;
+        }
+    }
+}
+
+// Positioned I/O for what io_uring left undone
+static void finish_read(int file, Flight& flight, std::size_t& size) {
+    while (size < flight.chunk.size()) {
+        const auto read =
+            ::pread(file, flight.chunk.data() + size,
+                    flight.chunk.size() - size, flight.offset + size);
+        if (read == 0) {
+            return;
+        }
+        if (read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ::io_error("Cannot read");
+        }
+        size += read;
+    }
+}
+
+static void finish_write(int file, const Flight& flight, std::size_t written) {
+    while (written < flight.chunk.size()) {
+        const auto write =
+            ::pwrite(file, flight.chunk.data() + written,
+                     flight.chunk.size() - written, flight.offset + written);
+        if (write < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ::io_error("Cannot write");
+        }
+        written += write;
+    }
+}
+#else
+namespace {
+// Stands in for io_uring where the build has none
+class Ring {
+   public:
+    explicit Ring(unsigned) {}
+    explicit operator bool() const { return false; }
+};
+}  // namespace
+#endif
+
+// Picks io_uring for regular files when preferred and available
+static std::unique_ptr<Ring> open_ring(int file,
+                                       AsyncFile::Backend preferred) {
+    if (preferred != AsyncFile::Backend::io_uring || !::is_regular(file)) {
+        return nullptr;
+    }
+    auto ring = std::make_unique<Ring>(AsyncFile::queued_chunks);
+    return *ring ? std::move(ring) : nullptr;
+}
+
+class AsyncFile::ReadBuffer : public std::basic_streambuf<character_type> {
+   public:
+    ReadBuffer(int file, bool owned, Backend preferred)
+        : file(file),
+          owned(owned),
+          ring(file >= 0 ? ::open_ring(file, preferred) : nullptr) {
+        if (file < 0) {
+            filled.close();
+            return;
+        }
+        for (std::size_t i = 0; i < queued_chunks; i++) {
+            free.push(Chunk(chunk_size));
+        }
+        thread = std::thread(&ReadBuffer::run, this);
+    }
+
+    ~ReadBuffer() override {
+        free.close();
+        filled.close();
+        if (thread.joinable()) {
+            thread.join();
+        }
+        if (owned && file >= 0) {
+            ::close(file);
+        }
+    }
+
+    bool is_open() const { return file >= 0; }
+    Backend backend() const {
+        return ring ? Backend::io_uring : Backend::blocking;
+    }
+
+   protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        if (!current.empty()) {
+            free.push(std::exchange(current, Chunk()));
+        }
+        auto chunk = filled.pop();
+        if (!chunk) {
+            setg(nullptr, nullptr, nullptr);
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            return traits_type::eof();
+        }
+        current = std::move(*chunk);
+        setg(current.data(), current.data(), current.data() + current.size());
+        return traits_type::to_int_type(*gptr());
+    }
+
+   private:
+    void run() {
+        try {
+            if (ring) {
+                read_ring();
+            } else {
+                read_blocking();
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+        filled.close();
+    }
+
+    void read_blocking() {
+        while (auto chunk = free.pop()) {
+            chunk->resize(chunk_size);
+            const auto size = ::read_some(file, chunk->data(), chunk->size());
+            if (size == 0) {
+                return;
+            }
+            chunk->resize(size);
+            if (!filled.push(std::move(*chunk))) {
+                return;
+            }
+        }
+    }
+
+    // Keeps up to `queued_chunks` reads of consecutive chunks in flight and
+    // hands them over in order
+    void read_ring() {
+#ifdef HAVE_IO_URING
+        std::deque<Flight> flights;
+        std::uint64_t first_tag = 0;
+        auto offset = static_cast<std::uint64_t>(
+            std::max<off_t>(::lseek(file, 0, SEEK_CUR), 0));
+        bool end = false;
+        try {
+            while (true) {
+                while (!end && flights.size() < queued_chunks) {
+                    auto chunk = flights.empty() ? free.pop() : free.try_pop();
+                    if (!chunk) {
+                        break;
+                    }
+                    chunk->resize(chunk_size);
+                    ring->submit(IORING_OP_READ, file, chunk->data(),
+                                 chunk_size, offset,
+                                 first_tag + flights.size());
+                    flights.push_back(
+                        Flight{std::move(*chunk), offset, std::nullopt});
+                    offset += chunk_size;
+                }
+                if (flights.empty()) {
+                    return;
+                }
+                auto& front = flights.front();
+                while (!front.result) {
+                    const auto completion = ring->wait();
+                    flights[completion.tag - first_tag].result =
+                        completion.result;
+                }
+                auto flight = std::move(front);
+                flights.pop_front();
+                ++first_tag;
+                if (*flight.result < 0) {
+                    errno = -*flight.result;
+                    ::io_error("Cannot read");
+                }
+                std::size_t size = *flight.result;
+                // Reads only come up short at the end of the file
+                if (size > 0) {
+                    ::finish_read(file, flight, size);
+                }
+                if (size < chunk_size) {
+                    end = true;
+                }
+                if (size == 0) {
+                    continue;
+                }
+                flight.chunk.resize(size);
+                if (!filled.push(std::move(flight.chunk))) {
+                    ::land(*ring, flights, first_tag);
+                    return;
+                }
+            }
+        } catch (...) {
+            ::land(*ring, flights, first_tag);
+            throw;
+        }
+#endif
+    }
+
+   private:
+    int file;
+    bool owned;
+    std::unique_ptr<Ring> ring;
+    Parallel::Channel<Chunk> free{queued_chunks};
+    Parallel::Channel<Chunk> filled{queued_chunks};
+    // The chunk the get area points into
+    Chunk current;
+    std::exception_ptr error;
+    std::thread thread;
+};
+
+class AsyncFile::WriteBuffer : public std::basic_streambuf<character_type> {
+   public:
+    WriteBuffer(int file, bool owned, Backend preferred)
+        : file(file),
+          owned(owned),
+          ring(file >= 0 ? ::open_ring(file, preferred) : nullptr) {
+        if (file < 0) {
+            filled.close();
+            return;
+        }
+        current.resize(chunk_size);
+        setp(current.data(), current.data() + current.size());
+        for (std::size_t i = 1; i < queued_chunks; i++) {
+            free.push(Chunk(chunk_size));
+        }
+        thread = std::thread(&WriteBuffer::run, this);
+    }
+
+    ~WriteBuffer() override {
+        try {
+            close();
+        } catch (...) {
+        }
+        if (owned && file >= 0) {
+            ::close(file);
+        }
+    }
+
+    bool is_open() const { return file >= 0; }
+    Backend backend() const {
+        return ring ? Backend::io_uring : Backend::blocking;
+    }
+
+    void close() {
+        if (!thread.joinable()) {
+            return;
+        }
+        try {
+            hand_over();
+        } catch (...) {
+            filled.close();
+            thread.join();
+            throw;
+        }
+        filled.close();
+        thread.join();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+   protected:
+    int_type overflow(int_type letter) override {
+        hand_over();
+        if (!traits_type::eq_int_type(letter, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(letter);
+            pbump(1);
+        }
+        return traits_type::not_eof(letter);
+    }
+
+    int sync() override {
+        hand_over();
+        return 0;
+    }
+
+   private:
+    // Queues the pending bytes for writing and takes a free chunk
+    void hand_over() {
+        if (pptr() == pbase()) {
+            return;
+        }
+        current.resize(pptr() - pbase());
+        setp(nullptr, nullptr);
+        auto next = filled.push(std::move(current)) ? free.pop()
+                                                    : std::nullopt;
+        if (!next) {
+            // The writer stops on errors, or once closed
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            throw std::ios::failure("Cannot write to a closed file");
+        }
+        current = std::move(*next);
+        current.resize(chunk_size);
+        setp(current.data(), current.data() + current.size());
+    }
+
+    void run() {
+        try {
+            if (ring) {
+                write_ring();
+            } else {
+                write_blocking();
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+        filled.close();
+        free.close();
+    }
+
+    void write_blocking() {
+        while (auto chunk = filled.pop()) {
+            ::write_all(file, chunk->data(), chunk->size());
+            free.push(std::move(*chunk));
+        }
+    }
+
+    // Keeps up to `queued_chunks` writes in flight, recycling each chunk
+    // once written
+    void write_ring() {
+#ifdef HAVE_IO_URING
+        std::deque<Flight> flights;
+        std::uint64_t first_tag = 0;
+        auto offset = static_cast<std::uint64_t>(
+            std::max<off_t>(::lseek(file, 0, SEEK_CUR), 0));
+        try {
+            while (true) {
+                std::optional<Chunk> chunk;
+                if (flights.empty()) {
+                    chunk = filled.pop();
+                    if (!chunk) {
+                        break;
+                    }
+                } else if (flights.size() < queued_chunks) {
+                    chunk = filled.try_pop();
+                }
+                if (chunk) {
+                    const auto size = chunk->size();
+                    const auto limit = ring_write_limit.load();
+                    ring->submit(IORING_OP_WRITE, file, chunk->data(),
+                                 limit != 0 ? std::min(size, limit) : size,
+                                 offset, first_tag + flights.size());
+                    flights.push_back(
+                        Flight{std::move(*chunk), offset, std::nullopt});
+                    offset += size;
+                    continue;
+                }
+                const auto completion = ring->wait();
+                flights[completion.tag - first_tag].result = completion.result;
+                while (!flights.empty() && flights.front().result) {
+                    auto flight = std::move(flights.front());
+                    flights.pop_front();
+                    ++first_tag;
+                    if (*flight.result < 0) {
+                        errno = -*flight.result;
+                        ::io_error("Cannot write");
+                    }
+                    ::finish_write(file, flight, *flight.result);
+                    free.push(std::move(flight.chunk));
+                }
+            }
+        } catch (...) {
+            ::land(*ring, flights, first_tag);
+            throw;
+        }
+        // Leave the file where plain writes would have
+        ::lseek(file, offset, SEEK_SET);
+#endif
+    }
+
+   private:
+    int file;
+    bool owned;
+    std::unique_ptr<Ring> ring;
+    Parallel::Channel<Chunk> free{queued_chunks};
+    Parallel::Channel<Chunk> filled{queued_chunks};
+    // The chunk the put area points into
+    Chunk current;
+    std::exception_ptr error;
+    std::thread thread;
+};
+
+AsyncFile::Input::Input(const std::string& filename, Backend preferred)
+    : std::basic_istream<character_type>(nullptr),
+      buffer(std::make_unique<ReadBuffer>(
+          ::open(filename.c_str(), O_RDONLY | O_CLOEXEC), true, preferred)) {
+    rdbuf(buffer.get());
+    exceptions(std::ios::badbit);
+    if (!buffer->is_open()) {
+        setstate(std::ios::failbit);
+    }
+}
+
+AsyncFile::Input::Input(int file, Backend preferred)
+    : std::basic_istream<character_type>(nullptr),
+      buffer(std::make_unique<ReadBuffer>(file, false, preferred)) {
+    rdbuf(buffer.get());
+    exceptions(std::ios::badbit);
+}
+
+AsyncFile::Input::~Input() = default;
+
+AsyncFile::Backend AsyncFile::Input::backend() const {
+    return buffer->backend();
+}
+
+AsyncFile::Output::Output(const std::string& filename, Backend preferred)
+    : std::basic_ostream<character_type>(nullptr),
+      buffer(std::make_unique<WriteBuffer>(
+          ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                 0666),
+          true, preferred)) {
+    rdbuf(buffer.get());
+    exceptions(std::ios::badbit);
+    if (!buffer->is_open()) {
+        setstate(std::ios::failbit);
+    }
+}
+
+AsyncFile::Output::Output(int file, Backend preferred)
+    : std::basic_ostream<character_type>(nullptr),
+      buffer(std::make_unique<WriteBuffer>(file, false, preferred)) {
+    rdbuf(buffer.get());
+    exceptions(std::ios::badbit);
+}
+
+AsyncFile::Output::~Output() = default;
+
+void AsyncFile::Output::close() {
+    flush();
+    buffer->close();
+}
+
+AsyncFile::Backend AsyncFile::Output::backend() const {
+    return buffer->backend();
+}
+
+void AsyncFile::limit_ring_writes(std::size_t bytes) {
+    ring_write_limit = bytes;
+}
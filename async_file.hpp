@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "bitstream.hpp"
+
+// Streams whose reads and writes run on a thread of their own, so that the
+// disk works while the caller codes. Chunks go back and forth between the
+// stream and its I/O thread over bounded queues and are recycled, which
+// bounds the memory and spares allocations. On regular files the I/O
+// thread keeps several chunks in flight through io_uring where the kernel
+// has it; other files, such as pipes, take plain blocking calls.
+namespace AsyncFile {
+using character_type = BitStream::character_type;
+
+constexpr std::size_t chunk_size = 1 << 20;
+// Chunks queued or in flight between a stream and its I/O thread
+constexpr std::size_t queued_chunks = 4;
+
+enum class Backend : std::uint8_t {
+    blocking = 0,
+    io_uring = 1,
+};
+
+class ReadBuffer;
+class WriteBuffer;
+
+// Reads ahead of the caller. I/O errors are thrown from the read that
+// meets them
+class Input : public std::basic_istream<character_type> {
+   public:
+    // Fails the stream if the file cannot be opened
+    explicit Input(const std::string& filename,
+                   Backend preferred = Backend::io_uring);
+    // Reads `file`, such as the standard input, without closing it
+    explicit Input(int file, Backend preferred = Backend::io_uring);
+    ~Input();
+
+    Backend backend() const;
+
+   private:
+    std::unique_ptr<ReadBuffer> buffer;
+};
+
+// Writes behind the caller: flushing hands the pending bytes over without
+// waiting for them. I/O errors are thrown from a later write, or from
+// `close`.
+class Output : public std::basic_ostream<character_type> {
+   public:
+    // Creates or truncates the file, or fails the stream if it cannot
+    explicit Output(const std::string& filename,
+                    Backend preferred = Backend::io_uring);
+    // Writes to `file`, such as the standard output, without closing it
+    explicit Output(int file, Backend preferred = Backend::io_uring);
+    // Closes the file, dropping any error
+    ~Output();
+
+    // Waits for every byte to be written
+    void close();
+    Backend backend() const;
+
+   private:
+    std::unique_ptr<WriteBuffer> buffer;
+};
+
+// Caps the bytes each io_uring write submits, 0 for none, so that tests
+// can make writes come up short as the kernel may
+void limit_ring_writes(std::size_t bytes);
+}  // namespace AsyncFile
@@ -0,0 +1,245 @@
+#include <benchmark/benchmark.h>
+
+#include <functional>
+#include <random>
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "container.hpp"
+#include "histogram.hpp"
+#include "huffman.hpp"
+#include "lz77.hpp"
+#include "transform.hpp"
+
+using namespace std;
+
+using character_type = Huffman::character_type;
+
+struct Corpus {
+    string name;
+    string text;
+};
+
+static string random_text(size_t size, unsigned seed,
+                          const function<int(mt19937&)>& letter) {
+    mt19937 generator(seed);
+    string text(size, '\0');
+    for (auto& c : text) {
+        c = static_cast<character_type>(letter(generator));
+    }
+    return text;
+}
+
+static vector<Corpus> corpora() {
+    constexpr size_t size = 1 << 20;
+    uniform_int_distribution<int> uniform(0, 255);
+    // Letter frequencies fall off like those of natural language text
+    geometric_distribution<int> skewed(0.08);
+    discrete_distribution<int> low_entropy({1000, 20, 5, 1});
+    return {
+        {"uniform", random_text(size, 1, [&](auto& g) { return uniform(g); })},
+        {"skewed",
+         random_text(size, 2, [&](auto& g) { return ' ' + skewed(g) % 95; })},
+        {"low_entropy",
+         random_text(size, 3, [&](auto& g) { return 'a' + low_entropy(g); })},
+        {"small",
+         random_text(64, 4, [&](auto& g) { return ' ' + skewed(g) % 95; })},
+    };
+}
+
+// Reports MB/s and the time per letter of the corpus
+static void set_throughput(benchmark::State& state, const string& text) {
+    state.SetBytesProcessed(state.iterations() * text.size());
+    state.counters["time/symbol"] = benchmark::Counter(
+        text.size(), benchmark::Counter::kIsIterationInvariantRate |
+                         benchmark::Counter::kInvert);
+}
+
+static void count(benchmark::State& state, const string& text) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Histogram::count(text));
+    }
+    set_throughput(state, text);
+}
+
+static void code_lengths(benchmark::State& state, const string& text) {
+    const auto counts = Histogram::count(text);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            Huffman::generate_code_lengths(counts, Huffman::max_code_length));
+    }
+}
+
+static void generate_mapping(benchmark::State& state, const string& text) {
+    const auto counts = Histogram::count(text);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Huffman::generate_mapping(counts));
+    }
+}
+
+static void generate_inverse_mapping(benchmark::State& state,
+                                     const string& text) {
+    const auto tree = Huffman::generate_mapping(Histogram::count(text));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Huffman::generate_inverse_mapping(tree));
+    }
+}
+
+static void generate_encode_table(benchmark::State& state,
+                                  const string& text) {
+    const auto lengths = Huffman::generate_code_lengths(
+        Histogram::count(text), Huffman::max_code_length);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Huffman::generate_encode_table(lengths));
+    }
+}
+
+static Huffman::CodeLengths lengths_of(const string& text) {
+    return Huffman::generate_code_lengths(Histogram::count(text),
+                                          Huffman::max_code_length);
+}
+
+static vector<character_type> encode(const string& text) {
+    vector<character_type> bytes;
+    BitStream::obitstream output(bytes);
+    Huffman::serialize_lengths(output, lengths_of(text));
+    Huffman::serialize_text(
+        text, output, Huffman::generate_encode_table(lengths_of(text)));
+    output.close();
+    return bytes;
+}
+
+static void serialize_text(benchmark::State& state, const string& text) {
+    const auto encode = Huffman::generate_encode_table(lengths_of(text));
+    vector<character_type> bytes;
+    for (auto _ : state) {
+        bytes.clear();
+        BitStream::obitstream output(bytes);
+        Huffman::serialize_text(text, output, encode);
+        output.close();
+        benchmark::DoNotOptimize(bytes.data());
+    }
+    set_throughput(state, text);
+}
+
+static void deserialize_tree(benchmark::State& state, const string& text) {
+    const auto bytes = encode(text);
+    for (auto _ : state) {
+        BitStream::ibitstream input{span<const character_type>(bytes)};
+        benchmark::DoNotOptimize(Huffman::deserialize_tree(input));
+    }
+}
+
+static void deserialize_text(benchmark::State& state, const string& text) {
+    const auto bytes = encode(text);
+    string decoded(text.size(), '\0');
+    for (auto _ : state) {
+        BitStream::ibitstream input{span<const character_type>(bytes)};
+        const auto decode =
+            Huffman::generate_decode_table(Huffman::deserialize_lengths(input));
+        Huffman::deserialize_text(input, decoded, decode);
+        benchmark::DoNotOptimize(decoded.data());
+    }
+    set_throughput(state, text);
+}
+
+static void sort_block(benchmark::State& state, const string& text) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Transform::forward(text));
+    }
+    set_throughput(state, text);
+}
+
+static void unsort_block(benchmark::State& state, const string& text) {
+    const auto transformed = Transform::forward(text);
+    string restored(text.size(), '\0');
+    for (auto _ : state) {
+        Transform::inverse(transformed, span(restored));
+        benchmark::DoNotOptimize(restored.data());
+    }
+    set_throughput(state, text);
+}
+
+static void match_block(benchmark::State& state, const string& text) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Lz77::parse(text));
+    }
+    set_throughput(state, text);
+}
+
+static void unmatch_block(benchmark::State& state, const string& text) {
+    const auto parse = Lz77::parse(text);
+    vector<character_type> bytes;
+    {
+        BitStream::obitstream output(bytes);
+        Lz77::serialize_text(text, parse, output);
+    }
+    string restored(text.size(), '\0');
+    for (auto _ : state) {
+        BitStream::ibitstream input{span<const character_type>(bytes)};
+        Lz77::deserialize_text(input, span(restored), parse.tables);
+        benchmark::DoNotOptimize(restored.data());
+    }
+    set_throughput(state, text);
+}
+
+static void container_compress(benchmark::State& state, const string& text) {
+    for (auto _ : state) {
+        basic_ostringstream<character_type> output;
+        Container::compress(span(text.data(), text.size()), output, {});
+        benchmark::DoNotOptimize(output.str().data());
+    }
+    set_throughput(state, text);
+}
+
+static void container_decompress(benchmark::State& state,
+                                 const string& text) {
+    basic_ostringstream<character_type> output;
+    Container::compress(span(text.data(), text.size()), output, {});
+    const auto compressed = output.str();
+    string decoded(text.size(), '\0');
+    for (auto _ : state) {
+        Container::decompress(span(compressed.data(), compressed.size()),
+                              span(decoded));
+        benchmark::DoNotOptimize(decoded.data());
+    }
+    set_throughput(state, text);
+}
+
+int main(int argc, char** argv) {
+    using Stage = void (*)(benchmark::State&, const string&);
+    const pair<const char*, Stage> stages[] = {
+        {"count", count},
+        {"code_lengths", code_lengths},
+        {"generate_mapping", generate_mapping},
+        {"generate_inverse_mapping", generate_inverse_mapping},
+        {"generate_encode_table", generate_encode_table},
+        {"serialize_text", serialize_text},
+        {"deserialize_tree", deserialize_tree},
+        {"deserialize_text", deserialize_text},
+        {"sort_block", sort_block},
+        {"unsort_block", unsort_block},
+        {"match_block", match_block},
+        {"unmatch_block", unmatch_block},
+        {"container_compress", container_compress},
+        {"container_decompress", container_decompress},
+    };
+    static const auto texts = corpora();
+    for (const auto& [name, stage] : stages) {
+        for (const auto& corpus : texts) {
+            benchmark::RegisterBenchmark(
+                (string(name) + "/" + corpus.name).c_str(),
+                [stage = stage, &corpus](benchmark::State& state) {
+                    stage(state, corpus.text);
+                })
+                // The container stages code on a pool's threads
+                ->UseRealTime();
+        }
+    }
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
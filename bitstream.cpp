@@ -1,5 +1,8 @@
 #include "bitstream.hpp"
 
+#include <bit>
+#include <cstring>
+
 using namespace std;
 
 BitStream::ibitstream& BitStream::ibitstream::operator>>(bool& bit) {
@@ -7,51 +10,88 @@ BitStream::ibitstream& BitStream::ibitstream::operator>>(bool& bit) {
     return *this;
 }
 
+void BitStream::ibitstream::reset() {
+    position = 0;
+    end = 0;
+    accumulator = 0;
+    bits = 0;
+    overrun = false;
+}
+
 void BitStream::ibitstream::refill() {
-    if (shifts != 0) {
+    if (end - position >= 8) {
+        // Loads all the whole bytes fitting the accumulator at once
+        std::uint64_t word;
+        std::memcpy(&word, data + position, sizeof(word));
+        if constexpr (std::endian::native == std::endian::little) {
+            word = __builtin_bswap64(word);
+        }
+        const auto bytes = (64 - bits) / 8;
+        if (bytes < 8) {
+            word &= ~(~std::uint64_t(0) >> (bytes * 8));
+        }
+        accumulator |= word >> bits;
+        position += bytes;
+        bits += bytes * 8;
         return;
     }
-    input.read(reinterpret_cast<character_type*>(&unit), 1);
-    shifts = 8;
+    while (bits <= 56) {
+        if (position == end) {
+            if (in_memory) {
+                return;
+            }
+            input.read(buffer.data(), buffer.size());
+            data = buffer.data();
+            position = 0;
+            end = input.gcount();
+            if (end == 0) {
+                return;
+            }
+        }
+        accumulator |= static_cast<std::uint64_t>(
+                           static_cast<std::uint8_t>(data[position++]))
+                       << (56 - bits);
+        bits += 8;
+    }
 }
 
 bool BitStream::ibitstream::read() {
-    refill();
-    --shifts;
-    bool ret = unit >> 7;
-    unit <<= 1;
+    const bool ret = peek_bits(1);
+    consume(1);
     return ret;
 }
 
 BitStream::character_type BitStream::ibitstream::read_unit() {
-    refill();
-    auto ret_byte = unit;
-    const auto remaining = 8 - shifts;
-    shifts = 0;
-    refill();
-    ret_byte |= unit >> (8 - remaining);
-    unit <<= remaining;
-    shifts -= remaining;
+    const auto ret_byte = static_cast<character_type>(peek_bits(8));
+    consume(8);
     return ret_byte;
 }
 
-void BitStream::ibitstream::align() {
-    if (shifts == 8) {
-        return;
+void BitStream::ibitstream::align() { consume(bits % 8); }
+
+void BitStream::obitstream::drain() {
+    auto& bytes = memory == nullptr ? buffer : *memory;
+    while (bits >= 8) {
+        bytes.push_back(static_cast<character_type>(accumulator >> 56));
+        accumulator <<= 8;
+        bits -= 8;
+    }
+    if (memory == nullptr && buffer.size() >= chunk_size) {
+        flush();
     }
-    shifts = 0;
 }
 
 void BitStream::obitstream::flush() {
-    if (shifts != 0) {
-        return;
-    }
-    output.write(reinterpret_cast<character_type*>(&unit), 1);
-    shifts = 8;
+    output.write(buffer.data(), buffer.size());
+    buffer.clear();
 }
 
 void BitStream::obitstream::close() {
     align();
+    drain();
+    if (memory != nullptr) {
+        return;
+    }
     flush();
     output.close();
 }
@@ -61,29 +101,11 @@ BitStream::obitstream& BitStream::obitstream::operator<<(bool bit) {
 }
 
 BitStream::obitstream& BitStream::obitstream::write(bool bit) {
-    flush();
-    --shifts;
-    unit <<= 1;
-    unit |= bit;
-    return *this;
+    return put_bits(bit, 1);
 }
 
 BitStream::obitstream& BitStream::obitstream::write_unit(std::uint8_t unit) {
-    flush();
-    const auto remaining = 8 - shifts;
-    this->unit <<= shifts;
-    this->unit |= unit >> remaining;
-    shifts = 0;
-    flush();
-    this->unit = unit;
-    shifts -= remaining;
-    return *this;
+    return put_bits(unit, 8);
 }
 
-void BitStream::obitstream::align() {
-    if (shifts == 8) {
-        return;
-    }
-    unit <<= shifts;
-    shifts = 0;
-}
+void BitStream::obitstream::align() { bits = (bits + 7) & ~7; }
@@ -2,20 +2,31 @@
 
 #include <cstdint>
 #include <fstream>
+#include <span>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace BitStream {
 using character_type = char;
 
+// Size of the chunks moved between the bitstreams and their files
+constexpr std::size_t chunk_size = 1 << 16;
+
 class ibitstream {
    public:
     ibitstream() = default;
     ibitstream(const std::string& filename)
-        : input(filename, std::ios::binary), shifts(0) {}
+        : input(filename, std::ios::binary), buffer(chunk_size) {}
+    // Reads the bits of `bytes`, which must outlive the stream
+    explicit ibitstream(std::span<const character_type> bytes)
+        : data(bytes.data()), end(bytes.size()), in_memory(true) {}
     ~ibitstream() = default;
     void open(const std::string& filename) {
         input.open(filename, std::ios::binary);
-        shifts = 0;
+        buffer.resize(chunk_size);
+        in_memory = false;
+        reset();
     }
     void close() { input.close(); }
     ibitstream(const ibitstream&) = delete;
@@ -23,43 +34,110 @@ class ibitstream {
     ibitstream& operator>>(bool& bit);
     bool read();
     character_type read_unit();
-    operator bool() const { return (bool)input; }
-    bool operator!() const { return !input; }
+    // Returns the next `count` (at most `max_peek`) bits without consuming
+    // them, zero-padded past the end of the file
+    std::uint64_t peek_bits(std::uint8_t count) {
+        if (bits < count) {
+            refill();
+        }
+        return count == 0 ? 0 : accumulator >> (64 - count);
+    }
+    void consume(std::uint8_t count) {
+        if (bits < count) {
+            refill();
+            if (bits < count) {
+                overrun = true;
+                accumulator = 0;
+                bits = 0;
+                return;
+            }
+        }
+        accumulator <<= count;
+        bits -= count;
+    }
+    operator bool() const {
+        return !overrun && (in_memory || input.is_open());
+    }
+    bool operator!() const { return !(bool)*this; }
     void align();
 
+    static constexpr std::uint8_t max_peek = 56;
+
    private:
     void refill();
+    void reset();
 
    private:
     std::basic_ifstream<character_type> input;
-    std::uint8_t unit;
-    std::uint8_t shifts;
+    std::vector<character_type> buffer;
+    const character_type* data = nullptr;
+    std::size_t position = 0;
+    std::size_t end = 0;
+    bool in_memory = false;
+    // Buffered bits, most significant first
+    std::uint64_t accumulator = 0;
+    std::uint8_t bits = 0;
+    bool overrun = false;
 };
 
 class obitstream {
    public:
     obitstream() = default;
     obitstream(const std::string& filename)
-        : output(filename, std::ios::binary), shifts(8) {}
+        : output(filename, std::ios::binary) {
+        buffer.reserve(chunk_size);
+    }
+    // Appends the bytes to `bytes`, which must outlive the stream
+    explicit obitstream(std::vector<character_type>& bytes) : memory(&bytes) {}
     ~obitstream() { close(); }
     void open(const std::string& filename) {
         output.open(filename, std::ios::binary);
-        shifts = 8;
+        memory = nullptr;
+        buffer.clear();
+        buffer.reserve(chunk_size);
+        accumulator = 0;
+        bits = 0;
     }
     void close();
     obitstream(const obitstream&) = delete;
-    obitstream(obitstream&&) = default;
+    // Leaves `other` without pending bits, so closing it writes nothing
+    obitstream(obitstream&& other)
+        : output(std::move(other.output)),
+          buffer(std::move(other.buffer)),
+          memory(std::exchange(other.memory, nullptr)),
+          accumulator(std::exchange(other.accumulator, 0)),
+          bits(std::exchange(other.bits, 0)) {}
     obitstream& operator<<(bool bit);
     obitstream& write(bool bit);
     obitstream& write_unit(std::uint8_t unit);
+    // Appends the low `length` (at most `max_put`) bits of `code`, most
+    // significant first; the bits of `code` above `length` must be zero
+    obitstream& put_bits(std::uint64_t code, std::uint8_t length) {
+        if (length == 0) {
+            return *this;
+        }
+        if (bits + length > 64) {
+            drain();
+        }
+        accumulator |= code << (64 - bits - length);
+        bits += length;
+        return *this;
+    }
     void align();
 
+    static constexpr std::uint8_t max_put = 57;
+
    private:
+    void drain();
     void flush();
 
    private:
     std::basic_ofstream<character_type> output;
-    std::uint8_t unit;
-    std::uint8_t shifts;
+    std::vector<character_type> buffer;
+    // Replaces the file and its buffer when writing to memory
+    std::vector<character_type>* memory = nullptr;
+    // Pending bits, most significant first
+    std::uint64_t accumulator = 0;
+    std::uint8_t bits = 0;
 };
 }  // namespace BitStream
@@ -0,0 +1,48 @@
+#include "canonical.hpp"
+
+#include <bit>
+#include <ios>
+
+void Canonical::invalid_file() {
+    throw std::ios::failure("Not a huf-compressed file!");
+}
+
+void Canonical::serialize_gamma(BitStream::obitstream& output,
+                                std::uint64_t n) {
+    const auto width = static_cast<std::uint8_t>(std::bit_width(n));
+    output.put_bits(0, width - 1);
+    output.put_bits(n, width);
+}
+
+std::uint64_t Canonical::deserialize_gamma(BitStream::ibitstream& input,
+                                           std::uint8_t max_width) {
+    std::uint8_t width = 1;
+    while (!input.read()) {
+        if (!input || ++width > max_width) {
+            invalid_file();
+        }
+    }
+    const auto n = std::uint64_t(1) << (width - 1) | input.peek_bits(width - 1);
+    input.consume(width - 1);
+    return n;
+}
+
+std::size_t Canonical::count_codes(std::span<const std::uint8_t> lengths) {
+    return lengths.size() -
+           std::count(lengths.begin(), lengths.end(), std::uint8_t(0));
+}
+
+bool Canonical::is_complete(std::span<const std::uint8_t> lengths) {
+    constexpr auto complete = std::uint64_t(1) << max_code_length;
+    std::uint64_t kraft = 0;
+    for (auto length : lengths) {
+        if (length != 0) {
+            kraft += std::uint64_t(1) << (max_code_length - length);
+            // Stops before many short codes overflow the sum
+            if (kraft > complete) {
+                return false;
+            }
+        }
+    }
+    return count_codes(lengths) <= 1 || kraft == complete;
+}
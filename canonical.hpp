@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+
+#include "bitstream.hpp"
+
+// Canonical prefix codes over alphabets of any size, given the code length
+// of every symbol: codes of equal length are consecutive and ordered by
+// symbol, and shorter codes precede longer ones. Huffman codes bytes with
+// them, Symbols its wider alphabets.
+namespace Canonical {
+
+// Longest code the decoders accept
+constexpr std::uint8_t max_code_length = BitStream::ibitstream::max_peek;
+
+[[noreturn]] void invalid_file();
+
+// Elias gamma code of `n`, which must not be 0
+void serialize_gamma(BitStream::obitstream& output, std::uint64_t n);
+
+// Throws on codes wider than `max_width` bits
+std::uint64_t deserialize_gamma(BitStream::ibitstream& input,
+                                std::uint8_t max_width);
+
+// Symbols with a code among `lengths`, 0 marking those without
+std::size_t count_codes(std::span<const std::uint8_t> lengths);
+
+// Whether `lengths`, none longer than `max_code_length`, form a complete
+// prefix code, as anything but a lone code must
+bool is_complete(std::span<const std::uint8_t> lengths);
+
+// Calls `visit(index, code, length)` for every symbol with a code, in
+// symbol order. A lone code is handed out like any other, though it is
+// coded with no bits at all.
+template <typename Visitor>
+void for_each_code(std::span<const std::uint8_t> lengths, Visitor&& visit) {
+    std::array<std::uint64_t, max_code_length + 1> next_code{};
+    std::array<std::size_t, max_code_length + 1> count{};
+    for (auto length : lengths) {
+        ++count[length];
+    }
+    count[0] = 0;
+    std::uint64_t code = 0;
+    for (std::size_t length = 1; length <= max_code_length; length++) {
+        code = (code + count[length - 1]) << 1;
+        next_code[length] = code;
+    }
+    for (std::size_t index = 0; index < lengths.size(); index++) {
+        const auto length = lengths[index];
+        if (length != 0) {
+            visit(index, next_code[length]++, length);
+        }
+    }
+}
+
+// Lookup table resolving up to `lookup_bits` bits of a code at once into
+// the index of its symbol, for alphabets of up to `Size` symbols. Codes
+// longer than `lookup_bits` are finished from the per-length canonical
+// ranges, so building and using the table never allocates.
+template <typename Symbol, std::size_t Size>
+struct DecodeTable {
+    static_assert(Size < 1 << 16, "Counts are held in 16 bits");
+    static constexpr std::uint8_t lookup_bits = 11;
+
+    struct Entry {
+        // Lengths above `lookup_bits` mark entries without a symbol
+        static constexpr std::uint8_t long_code = 0xFE;
+        static constexpr std::uint8_t no_code = 0xFF;
+
+        Symbol symbol;
+        std::uint8_t length;
+    };
+
+    std::array<Entry, 1 << lookup_bits> entries;
+    std::uint8_t max_length;
+    // First code, number of codes and index of the first symbol per length
+    std::array<std::uint64_t, max_code_length + 1> first_code;
+    std::array<std::uint16_t, max_code_length + 1> count;
+    std::array<std::uint16_t, max_code_length + 1> first_index;
+    std::array<Symbol, Size> symbols;
+};
+
+// `lengths` holds at most `Size` lengths, which form a complete prefix code
+// or hold a lone code
+template <typename Symbol, std::size_t Size>
+DecodeTable<Symbol, Size> generate_decode_table(
+    std::span<const std::uint8_t> lengths) {
+    using Table = DecodeTable<Symbol, Size>;
+    using Entry = typename Table::Entry;
+    constexpr auto lookup_bits = Table::lookup_bits;
+    Table table;
+    table.entries.fill(Entry{Symbol{}, Entry::no_code});
+    table.max_length = lengths.empty()
+                           ? 0
+                           : *std::max_element(lengths.begin(), lengths.end());
+    table.first_code.fill(0);
+    table.count.fill(0);
+    table.first_index.fill(0);
+    if (count_codes(lengths) == 1) {
+        const auto lone = std::find_if(lengths.begin(), lengths.end(),
+                                       [](auto length) { return length != 0; });
+        table.entries.fill(
+            Entry{static_cast<Symbol>(lone - lengths.begin()), 0});
+        return table;
+    }
+
+    for_each_code(lengths, [&table](std::size_t, std::uint64_t code,
+                                    std::uint8_t length) {
+        if (table.count[length]++ == 0) {
+            table.first_code[length] = code;
+        }
+    });
+    for (std::size_t length = 1, index = 0; length <= table.max_length;
+         length++) {
+        table.first_index[length] = static_cast<std::uint16_t>(index);
+        index += table.count[length];
+    }
+    auto next_index = table.first_index;
+    for_each_code(lengths, [&table, &next_index](std::size_t index,
+                                                 std::uint64_t code,
+                                                 std::uint8_t length) {
+        const auto symbol = static_cast<Symbol>(index);
+        table.symbols[next_index[length]++] = symbol;
+        if (length > lookup_bits) {
+            table.entries[code >> (length - lookup_bits)] =
+                Entry{Symbol{}, Entry::long_code};
+            return;
+        }
+        const auto shift = lookup_bits - length;
+        std::fill_n(table.entries.begin() + (code << shift), 1u << shift,
+                    Entry{symbol, length});
+    });
+    return table;
+}
+
+// The slow path of `decode`, kept out of line so that the lookup inlines
+// into the decoding loops
+template <typename Symbol, std::size_t Size>
+[[gnu::noinline]] Symbol decode_long(BitStream::ibitstream& input,
+                                     const DecodeTable<Symbol, Size>& table,
+                                     std::uint8_t entry_length) {
+    constexpr auto lookup_bits = DecodeTable<Symbol, Size>::lookup_bits;
+    if (entry_length == DecodeTable<Symbol, Size>::Entry::no_code) {
+        invalid_file();
+    }
+    const auto code = input.peek_bits(table.max_length);
+    for (std::uint8_t length = lookup_bits + 1; length <= table.max_length;
+         length++) {
+        const auto offset =
+            (code >> (table.max_length - length)) - table.first_code[length];
+        if (offset < table.count[length]) {
+            input.consume(length);
+            return table.symbols[table.first_index[length] + offset];
+        }
+    }
+    invalid_file();
+}
+
+// Decodes a single symbol. Past the end of the input it decodes padding,
+// which the caller checks the stream for once done.
+template <typename Symbol, std::size_t Size>
+inline Symbol decode(BitStream::ibitstream& input,
+                     const DecodeTable<Symbol, Size>& table) {
+    constexpr auto lookup_bits = DecodeTable<Symbol, Size>::lookup_bits;
+    const auto entry = table.entries[input.peek_bits(lookup_bits)];
+    if (entry.length <= lookup_bits) {
+        input.consume(entry.length);
+        return entry.symbol;
+    }
+    return decode_long(input, table, entry.length);
+}
+}  // namespace Canonical
@@ -0,0 +1,95 @@
+#include "checksum.hpp"
+
+#include <array>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace {
+// Reflected Castagnoli polynomial
+constexpr std::uint32_t polynomial = 0x82F63B78;
+
+using Tables = std::array<std::array<std::uint32_t, 256>, 8>;
+
+// `tables[k][byte]` is the CRC of `byte` followed by `k` zero bytes
+constexpr Tables make_tables() {
+    Tables tables{};
+    for (std::uint32_t byte = 0; byte < 256; byte++) {
+        auto crc = byte;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc >> 1 ^ (crc & 1 ? polynomial : 0);
+        }
+        tables[0][byte] = crc;
+    }
+    for (std::size_t k = 1; k < tables.size(); k++) {
+        for (std::size_t byte = 0; byte < 256; byte++) {
+            const auto previous = tables[k - 1][byte];
+            tables[k][byte] = previous >> 8 ^ tables[0][previous & 0xFF];
+        }
+    }
+    return tables;
+}
+
+constexpr Tables tables = make_tables();
+}  // namespace
+
+// Both take and return the CRC register, before the final inversion
+static std::uint32_t crc32c_tables(
+    std::span<const Checksum::character_type> data, std::uint32_t crc) {
+    const auto* bytes = reinterpret_cast<const std::uint8_t*>(data.data());
+    auto size = data.size();
+    for (; size >= 8; bytes += 8, size -= 8) {
+        std::uint32_t low;
+        std::uint32_t high;
+        std::memcpy(&low, bytes, sizeof(low));
+        std::memcpy(&high, bytes + 4, sizeof(high));
+        // Tables are indexed by bytes in memory order, which the loads
+        // keep on little-endian machines only
+        if constexpr (std::endian::native == std::endian::big) {
+            low = __builtin_bswap32(low);
+            high = __builtin_bswap32(high);
+        }
+        low ^= crc;
+        crc = tables[7][low & 0xFF] ^ tables[6][low >> 8 & 0xFF] ^
+              tables[5][low >> 16 & 0xFF] ^ tables[4][low >> 24] ^
+              tables[3][high & 0xFF] ^ tables[2][high >> 8 & 0xFF] ^
+              tables[1][high >> 16 & 0xFF] ^ tables[0][high >> 24];
+    }
+    for (; size > 0; bytes++, size--) {
+        crc = crc >> 8 ^ tables[0][(crc ^ *bytes) & 0xFF];
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static std::uint32_t crc32c_sse42(
+    std::span<const Checksum::character_type> data, std::uint32_t crc) {
+    const auto* bytes = reinterpret_cast<const std::uint8_t*>(data.data());
+    auto size = data.size();
+    std::uint64_t wide = crc;
+    for (; size >= 8; bytes += 8, size -= 8) {
+        std::uint64_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = static_cast<std::uint32_t>(wide);
+    for (; size > 0; bytes++, size--) {
+        crc = _mm_crc32_u8(crc, *bytes);
+    }
+    return crc;
+}
+#endif
+
+std::uint32_t Checksum::crc32c(std::span<const character_type> data,
+                               std::uint32_t crc) {
+#if defined(__x86_64__)
+    static const bool sse42 = __builtin_cpu_supports("sse4.2");
+    if (sse42) {
+        return ~::crc32c_sse42(data, ~crc);
+    }
+#endif
+    return ~::crc32c_tables(data, ~crc);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include "bitstream.hpp"
+
+namespace Checksum {
+
+using character_type = BitStream::character_type;
+
+// CRC-32C (Castagnoli) of `data`, continuing from the checksum `crc` of
+// the bytes before it. Runs on the SSE4.2 crc32 instruction where the CPU
+// has it, and on slicing-by-8 tables otherwise.
+std::uint32_t crc32c(std::span<const character_type> data,
+                     std::uint32_t crc = 0);
+}  // namespace Checksum
@@ -0,0 +1,1829 @@
+#include "container.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <deque>
+#include <future>
+#include <ios>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <utility>
+
+#include "checksum.hpp"
+#include "histogram.hpp"
+#include "lz77.hpp"
+#include "thread_pool.hpp"
+#include "transform.hpp"
+
+[[noreturn]] static void invalid_file() {
+    throw std::ios::failure("Not a huf-compressed file!");
+}
+
+[[noreturn]] static void invalid_dictionary() {
+    throw std::ios::failure("Not a huf dictionary!");
+}
+
+static void write_u32(std::vector<Container::character_type>& output,
+                      std::uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        output.push_back(
+            static_cast<Container::character_type>(value >> shift));
+    }
+}
+
+static void write_u64(std::vector<Container::character_type>& output,
+                      std::uint64_t value) {
+    ::write_u32(output, value);
+    ::write_u32(output, value >> 32);
+}
+
+static void set_u32(std::vector<Container::character_type>& output,
+                    std::size_t at, std::uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        output[at + i] =
+            static_cast<Container::character_type>(value >> (8 * i));
+    }
+}
+
+static std::uint32_t load_u32(std::span<const Container::character_type> bytes,
+                              std::size_t at) {
+    std::uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) {
+        value = value << 8 | static_cast<std::uint8_t>(bytes[at + i]);
+    }
+    return value;
+}
+
+template <typename T>
+static T read_integer(std::basic_istream<Container::character_type>& input) {
+    std::array<Container::character_type, sizeof(T)> bytes;
+    if (!input.read(bytes.data(), bytes.size())) {
+        ::invalid_file();
+    }
+    T value = 0;
+    for (auto byte = bytes.rbegin(); byte != bytes.rend(); ++byte) {
+        value = value << 8 | static_cast<std::uint8_t>(*byte);
+    }
+    return value;
+}
+
+static std::uint32_t read_u32(
+    std::basic_istream<Container::character_type>& input) {
+    return ::read_integer<std::uint32_t>(input);
+}
+
+static std::uint64_t read_u64(
+    std::basic_istream<Container::character_type>& input) {
+    return ::read_integer<std::uint64_t>(input);
+}
+
+namespace {
+struct Header {
+    std::uint8_t flags;
+    std::uint32_t block_size;
+    // Id of the dictionary, with Flags::dictionary
+    std::uint32_t dictionary;
+    // The container's own table, with Flags::table, and its size
+    std::optional<Container::Dictionary> table;
+    std::uint32_t table_size;
+};
+
+// A block as read from the container, not decoded yet
+struct RawBlock {
+    Container::BlockMode mode;
+    Container::TableMode table;
+    std::uint32_t size;
+    // With Flags::checksums
+    std::optional<std::uint32_t> checksum;
+    std::vector<Container::character_type> payload;
+};
+
+// A block after Transform::forward, and the code of its ranks
+struct Sorted {
+    Transform::Transformed transformed;
+    Huffman::CountTable counts;
+    Huffman::CodeLengths lengths;
+};
+
+// How a block is going to be coded. Its table may refer to the previous
+// block's, so plans are made in block order while the coding itself runs
+// in parallel
+struct Plan {
+    Container::BlockMode mode;
+    Container::TableMode table;
+    Huffman::CodeLengths lengths;
+    // Tables of context blocks
+    Context::Model model;
+    // Code of symbol blocks
+    Symbols::Model symbols;
+    // Ranks of sorted blocks
+    Sorted sorted;
+    // Sequences of LZ77 blocks
+    Lz77::Parse parse;
+    Container::Stats stats;
+};
+
+// Payload of an interleaved block, split into its parts
+struct InterleavedPayload {
+    std::span<const Container::character_type> table;
+    std::vector<std::span<const Container::character_type>> streams;
+};
+
+// Adds the time from its construction to its destruction to `total`
+class StageTimer {
+   public:
+    explicit StageTimer(std::chrono::nanoseconds& total)
+        : total(total), start(std::chrono::steady_clock::now()) {}
+    ~StageTimer() { total += std::chrono::steady_clock::now() - start; }
+
+   private:
+    std::chrono::nanoseconds& total;
+    std::chrono::steady_clock::time_point start;
+};
+
+constexpr std::size_t header_size = Container::magic.size() + 1 + 4;
+constexpr std::size_t index_entry_size = 8 + 8 + 4;
+constexpr std::size_t footer_size = 8 + 8 + Container::index_magic.size();
+}  // namespace
+
+static Container::character_type mode_byte(Container::BlockMode mode,
+                                           Container::TableMode table) {
+    return static_cast<Container::character_type>(
+        static_cast<std::uint8_t>(mode) |
+        static_cast<std::uint8_t>(table) << 4);
+}
+
+static void split_mode_byte(Container::character_type byte,
+                            Container::BlockMode& mode,
+                            Container::TableMode& table) {
+    const auto bits = static_cast<std::uint8_t>(byte);
+    mode = static_cast<Container::BlockMode>(bits & 0xF);
+    table = static_cast<Container::TableMode>(bits >> 4);
+}
+
+// A container's own table, which its blocks take as their dictionary
+static Container::Dictionary read_header_table(
+    std::span<const Container::character_type> bytes) {
+    BitStream::ibitstream input(bytes);
+    const auto lengths = Huffman::deserialize_lengths(input);
+    if (!input) {
+        ::invalid_file();
+    }
+    return Container::Dictionary{0, lengths};
+}
+
+// Rejects block sizes no compressor writes, before any block is allocated
+static void check_block_size(std::uint32_t block_size) {
+    if (block_size == 0 || block_size > Container::max_block_size) {
+        ::invalid_file();
+    }
+}
+
+// Whether a block of `size` bytes can have a payload of `payload` bytes:
+// stored blocks hold their bytes as they are, and the other modes are
+// only picked when they come out smaller
+static bool fits_block(Container::BlockMode mode, std::size_t size,
+                       std::size_t payload) {
+    return mode == Container::BlockMode::stored ? payload == size
+                                                : payload <= size;
+}
+
+static Header read_header(
+    std::basic_istream<Container::character_type>& input) {
+    std::array<Container::character_type, Container::magic.size()> signature;
+    Container::character_type flags;
+    if (!input.read(signature.data(), signature.size()) ||
+        signature != Container::magic || !input.get(flags)) {
+        ::invalid_file();
+    }
+    Header header{static_cast<std::uint8_t>(flags), ::read_u32(input), 0, {},
+                  0};
+    ::check_block_size(header.block_size);
+    if (header.flags & Container::Flags::dictionary) {
+        header.dictionary = ::read_u32(input);
+    }
+    if (header.flags & Container::Flags::table) {
+        header.table_size = ::read_u32(input);
+        std::vector<Container::character_type> table(header.table_size);
+        if (!input.read(table.data(), table.size())) {
+            ::invalid_file();
+        }
+        header.table = ::read_header_table(table);
+    }
+    return header;
+}
+
+// Removes the first `count` bytes of `input` and returns them
+static std::span<const Container::character_type> take(
+    std::span<const Container::character_type>& input, std::size_t count) {
+    if (input.size() < count) {
+        ::invalid_file();
+    }
+    const auto bytes = input.first(count);
+    input = input.subspan(count);
+    return bytes;
+}
+
+static Header read_header(std::span<const Container::character_type>& input) {
+    const auto signature = ::take(input, Container::magic.size());
+    if (!std::equal(signature.begin(), signature.end(),
+                    Container::magic.begin())) {
+        ::invalid_file();
+    }
+    Header header{static_cast<std::uint8_t>(::take(input, 1)[0]),
+                  ::load_u32(::take(input, 4), 0), 0, {}, 0};
+    ::check_block_size(header.block_size);
+    if (header.flags & Container::Flags::dictionary) {
+        header.dictionary = ::load_u32(::take(input, 4), 0);
+    }
+    if (header.flags & Container::Flags::table) {
+        header.table_size = ::load_u32(::take(input, 4), 0);
+        header.table = ::read_header_table(::take(input, header.table_size));
+    }
+    return header;
+}
+
+static std::size_t header_bytes(const Header& header) {
+    return header_size + (header.flags & Container::Flags::dictionary ? 4 : 0) +
+           (header.flags & Container::Flags::table ? 4 + header.table_size
+                                                  : 0);
+}
+
+// Size of a block's header, up to its payload
+static std::size_t block_header_bytes(const Header& header) {
+    return 4 + 1 + 4 + (header.flags & Container::Flags::checksums ? 4 : 0);
+}
+
+// The dictionary the blocks of a container may refer to: its own table, or
+// else the caller's, and then throws unless it is the one the container was
+// coded with
+static const Container::Dictionary* check_dictionary(
+    const Header& header, const Container::Dictionary* dictionary) {
+    if (header.table) {
+        return &*header.table;
+    }
+    if (!(header.flags & Container::Flags::dictionary)) {
+        return nullptr;
+    }
+    if (dictionary == nullptr) {
+        throw std::ios::failure("The huf-compressed file needs a dictionary!");
+    }
+    if (dictionary->id != header.dictionary) {
+        throw std::ios::failure(
+            "The dictionary does not match the huf-compressed file!");
+    }
+    return dictionary;
+}
+
+// Whether a block's table does not depend on the blocks before it
+static bool starts_tables(Container::BlockMode mode,
+                          Container::TableMode table) {
+    return (mode == Container::BlockMode::huffman ||
+            mode == Container::BlockMode::interleaved) &&
+           (table == Container::TableMode::fresh ||
+            table == Container::TableMode::dictionary);
+}
+
+// Reads a block up to its payload and returns the payload's size, leaving
+// `block.size` at 0 once the blocks end
+static std::uint32_t read_block_header(
+    std::basic_istream<Container::character_type>& input,
+    const Header& header, RawBlock& block) {
+    block.size = ::read_u32(input);
+    if (block.size == 0) {
+        return 0;
+    }
+    Container::character_type mode;
+    if (block.size > header.block_size || !input.get(mode)) {
+        ::invalid_file();
+    }
+    ::split_mode_byte(mode, block.mode, block.table);
+    const auto payload = ::read_u32(input);
+    if (!::fits_block(block.mode, block.size, payload)) {
+        ::invalid_file();
+    }
+    block.checksum = std::nullopt;
+    if (header.flags & Container::Flags::checksums) {
+        block.checksum = ::read_u32(input);
+    }
+    return payload;
+}
+
+// Returns false once the blocks end
+static bool read_block(std::basic_istream<Container::character_type>& input,
+                       const Header& header, RawBlock& block) {
+    const auto payload = ::read_block_header(input, header, block);
+    if (block.size == 0) {
+        return false;
+    }
+    block.payload.resize(payload);
+    if (!input.read(block.payload.data(), block.payload.size())) {
+        ::invalid_file();
+    }
+    return true;
+}
+
+// Walks the blocks of a container held in memory, its header already
+// read, handing `visit` each block's modes, size, checksum and payload
+// without copying it
+template <typename Visit>
+static void for_each_block(std::span<const Container::character_type> input,
+                           const Header& header, Visit visit) {
+    while (const auto size = ::load_u32(::take(input, 4), 0)) {
+        Container::BlockMode mode;
+        Container::TableMode table;
+        ::split_mode_byte(::take(input, 1)[0], mode, table);
+        const auto payload_size = ::load_u32(::take(input, 4), 0);
+        if (size > header.block_size ||
+            !::fits_block(mode, size, payload_size)) {
+            ::invalid_file();
+        }
+        std::optional<std::uint32_t> checksum;
+        if (header.flags & Container::Flags::checksums) {
+            checksum = ::load_u32(::take(input, 4), 0);
+        }
+        const auto payload = ::take(input, payload_size);
+        visit(mode, table, size, checksum, payload);
+    }
+}
+
+Container::Timings& Container::Timings::operator+=(const Timings& other) {
+    histogram += other.histogram;
+    transform += other.transform;
+    tables += other.tables;
+    headers += other.headers;
+    coding += other.coding;
+    checksum += other.checksum;
+    return *this;
+}
+
+Container::Stats& Container::Stats::operator+=(const Stats& other) {
+    input_size += other.input_size;
+    output_size += other.output_size;
+    blocks += other.blocks;
+    code_bits += other.code_bits;
+    optimal_bits += other.optimal_bits;
+    huffman_bits += other.huffman_bits;
+    huffman_optimal_bits += other.huffman_optimal_bits;
+    entropy_bits += other.entropy_bits;
+    header_size += other.header_size;
+    exact_bits += other.exact_bits;
+    for (std::size_t length = 0; length < code_lengths.size(); length++) {
+        code_lengths[length] += other.code_lengths[length];
+    }
+    timings += other.timings;
+    return *this;
+}
+
+// FNV-1a hash of the code lengths
+static std::uint32_t dictionary_id(const Huffman::CodeLengths& lengths) {
+    std::uint32_t hash = 2166136261;
+    for (auto length : lengths) {
+        hash = (hash ^ length) * 16777619;
+    }
+    return hash;
+}
+
+// A table that codes every letter, sampled or not
+static Huffman::CodeLengths smoothed_lengths(Huffman::CountTable counts,
+                                             std::uint8_t max_length) {
+    for (auto& count : counts) {
+        count = count == UINT64_MAX ? count : count + 1;
+    }
+    return Huffman::generate_code_lengths(counts, max_length);
+}
+
+Container::Dictionary Container::train(const Huffman::CountTable& counts,
+                                       std::uint8_t max_length) {
+    const auto lengths = ::smoothed_lengths(counts, max_length);
+    return Dictionary{::dictionary_id(lengths), lengths};
+}
+
+Huffman::CodeLengths Container::sample_table(
+    std::span<const character_type> input, const Options& options) {
+    return ::smoothed_lengths(Histogram::sample(input, options.sample),
+                              options.max_length);
+}
+
+void Container::write_dictionary(std::basic_ostream<character_type>& output,
+                                 const Dictionary& dictionary) {
+    std::vector<character_type> bytes(dictionary_magic.begin(),
+                                      dictionary_magic.end());
+    ::write_u32(bytes, dictionary.id);
+    {
+        BitStream::obitstream bits(bytes);
+        Huffman::serialize_lengths(bits, dictionary.lengths);
+    }
+    output.write(bytes.data(), bytes.size());
+}
+
+Container::Dictionary Container::read_dictionary(
+    std::basic_istream<character_type>& input) {
+    std::array<character_type, dictionary_magic.size()> signature;
+    if (!input.read(signature.data(), signature.size()) ||
+        signature != dictionary_magic) {
+        ::invalid_dictionary();
+    }
+    Dictionary dictionary;
+    dictionary.id = ::read_u32(input);
+    const std::vector<character_type> table(
+        std::istreambuf_iterator<character_type>(input), {});
+    BitStream::ibitstream bits{std::span<const character_type>(table)};
+    dictionary.lengths = Huffman::deserialize_lengths(bits);
+    if (::dictionary_id(dictionary.lengths) != dictionary.id) {
+        ::invalid_dictionary();
+    }
+    return dictionary;
+}
+
+static void write_table(BitStream::obitstream& output,
+                        Container::TableMode table,
+                        const Huffman::CodeLengths& lengths,
+                        const Container::Table& previous) {
+    switch (table) {
+        case Container::TableMode::fresh:
+            Huffman::serialize_lengths(output, lengths);
+            return;
+        case Container::TableMode::reused:
+            return;
+        case Container::TableMode::delta:
+            Huffman::serialize_length_deltas(output, *previous, lengths);
+            return;
+        case Container::TableMode::dictionary:
+            return;
+    }
+}
+
+static Huffman::CodeLengths read_table(
+    BitStream::ibitstream& input, Container::TableMode table,
+    const Container::Table& previous,
+    const Container::Dictionary* dictionary) {
+    if (table == Container::TableMode::fresh) {
+        return Huffman::deserialize_lengths(input);
+    }
+    if (table == Container::TableMode::dictionary) {
+        if (dictionary == nullptr) {
+            ::invalid_file();
+        }
+        return dictionary->lengths;
+    }
+    if (!previous) {
+        ::invalid_file();
+    }
+    switch (table) {
+        case Container::TableMode::reused:
+            return *previous;
+        case Container::TableMode::delta:
+            return Huffman::deserialize_length_deltas(input, *previous);
+        default:
+            ::invalid_file();
+    }
+}
+
+// Size in bytes of the table's header
+static std::size_t table_size(Container::TableMode table,
+                              const Huffman::CodeLengths& lengths,
+                              const Container::Table& previous) {
+    std::vector<Container::character_type> bytes;
+    {
+        BitStream::obitstream output(bytes);
+        ::write_table(output, table, lengths, previous);
+    }
+    return bytes.size();
+}
+
+// Size in bytes of an order-1 model's header
+static std::size_t model_size(const Context::Model& model) {
+    std::vector<Container::character_type> bytes;
+    {
+        BitStream::obitstream output(bytes);
+        Context::serialize_model(output, model);
+    }
+    return bytes.size();
+}
+
+// Size in bytes of a symbol model's header
+static std::size_t model_size(const Symbols::Model& model) {
+    std::vector<Container::character_type> bytes;
+    {
+        BitStream::obitstream output(bytes);
+        Symbols::serialize_model(output, model);
+    }
+    return bytes.size();
+}
+
+// Size in bytes of the tables of an LZ77 block
+static std::size_t tables_size(const Lz77::Tables& tables) {
+    std::vector<Container::character_type> bytes;
+    {
+        BitStream::obitstream output(bytes);
+        Lz77::serialize_tables(output, tables);
+    }
+    return bytes.size();
+}
+
+// Whether every letter of the block has a code in `lengths`
+static bool covers(const Huffman::CodeLengths& lengths,
+                   const Huffman::CountTable& counts) {
+    for (std::size_t index = 0; index < counts.size(); index++) {
+        if (counts[index] != 0 && lengths[index] == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Adds the entropy of the block's letters to the plan's stats and, when
+// the block is coded with `plan.lengths`, its code sizes and the letters
+// each length codes
+static void count_letters(Plan& plan, const Huffman::CountTable& counts,
+                          std::size_t size) {
+    using Container::BlockMode;
+    if (plan.mode == BlockMode::huffman ||
+        plan.mode == BlockMode::interleaved) {
+        plan.stats.huffman_bits = plan.stats.code_bits;
+        plan.stats.huffman_optimal_bits = plan.stats.optimal_bits;
+    }
+    for (std::size_t index = 0; index < counts.size(); index++) {
+        if (counts[index] != 0) {
+            plan.stats.entropy_bits +=
+                counts[index] * std::log2(static_cast<double>(size) /
+                                          counts[index]);
+            if (plan.mode == BlockMode::huffman ||
+                plan.mode == BlockMode::interleaved) {
+                plan.stats.code_lengths[plan.lengths[index]] += counts[index];
+            }
+        }
+    }
+}
+
+// Picks the cheapest of a fresh table, differences from `previous`,
+// `previous` itself, the dictionary's table, the order-1 `model`, the
+// wider `symbols`, the `sorted` block and the LZ77 `parse`, if any, then
+// whether the block is worth coding at all
+static Plan plan_block(std::size_t size, const Huffman::CountTable& counts,
+                       const Huffman::CodeLengths& lengths,
+                       const Container::Table& previous,
+                       const Context::Model* model,
+                       const Symbols::Model* symbols, const Sorted* sorted,
+                       const Lz77::Parse* parse,
+                       const Container::Options& options) {
+    using namespace Container;
+    Plan plan{.mode = options.streams > 1 && size >= min_interleaved_block
+                          ? BlockMode::interleaved
+                          : BlockMode::huffman,
+              .table = TableMode::fresh,
+              .lengths = lengths,
+              .model = {},
+              .symbols = {},
+              .sorted = {},
+              .parse = {},
+              .stats = {}};
+    plan.stats.input_size = size;
+    plan.stats.blocks = 1;
+    plan.stats.code_bits = Huffman::encoded_size(counts, lengths);
+    plan.stats.optimal_bits = Huffman::optimal_encoded_size(counts);
+    auto header = ::table_size(TableMode::fresh, lengths, previous);
+    if (previous && options.reuse_tables) {
+        const auto delta = ::table_size(TableMode::delta, lengths, previous);
+        if (delta < header) {
+            plan.table = TableMode::delta;
+            header = delta;
+        }
+        if (::covers(*previous, counts)) {
+            const auto bits = Huffman::encoded_size(counts, *previous);
+            if (bits < plan.stats.code_bits + 8 * header) {
+                plan.table = TableMode::reused;
+                plan.lengths = *previous;
+                plan.stats.code_bits = bits;
+                header = 0;
+            }
+        }
+    }
+    if (options.dictionary != nullptr &&
+        ::covers(options.dictionary->lengths, counts)) {
+        const auto bits =
+            Huffman::encoded_size(counts, options.dictionary->lengths);
+        if (bits < plan.stats.code_bits + 8 * header) {
+            plan.table = TableMode::dictionary;
+            plan.lengths = options.dictionary->lengths;
+            plan.stats.code_bits = bits;
+            header = 0;
+        }
+    }
+    if (model != nullptr) {
+        const auto model_header = ::model_size(*model);
+        if (model->code_bits + 8 * model_header <
+            plan.stats.code_bits + 8 * header) {
+            plan.mode = BlockMode::context;
+            plan.table = TableMode::fresh;
+            plan.model = *model;
+            plan.stats.code_bits = model->code_bits;
+            header = model_header;
+        }
+    }
+    if (symbols != nullptr) {
+        const auto symbols_header = ::model_size(*symbols);
+        if (symbols->code_bits + 8 * symbols_header <
+            plan.stats.code_bits + 8 * header) {
+            plan.mode = BlockMode::symbols;
+            plan.table = TableMode::fresh;
+            plan.symbols = *symbols;
+            plan.stats.code_bits = symbols->code_bits;
+            header = symbols_header;
+        }
+    }
+    if (sorted != nullptr) {
+        const auto sorted_header =
+            8 + ::table_size(TableMode::fresh, sorted->lengths, previous);
+        const auto bits =
+            Huffman::encoded_size(sorted->counts, sorted->lengths);
+        if (bits + 8 * sorted_header < plan.stats.code_bits + 8 * header) {
+            plan.mode = BlockMode::sorted;
+            plan.table = TableMode::fresh;
+            plan.sorted = *sorted;
+            plan.stats.code_bits = bits;
+            header = sorted_header;
+        }
+    }
+    if (parse != nullptr) {
+        const auto parse_header = ::tables_size(parse->tables);
+        if (parse->code_bits + 8 * parse_header <
+            plan.stats.code_bits + 8 * header) {
+            plan.mode = BlockMode::lz77;
+            plan.table = TableMode::fresh;
+            plan.parse = *parse;
+            plan.stats.code_bits = parse->code_bits;
+            header = parse_header;
+        }
+    }
+
+    // An upper bound of the payload, counting a byte of padding per stream
+    auto payload = header + (plan.stats.code_bits + 7) / 8;
+    if (plan.mode == BlockMode::interleaved) {
+        payload += 1 + 4 * options.streams + options.streams;
+    }
+    if (payload >= size) {
+        plan.mode = BlockMode::stored;
+        plan.table = TableMode::fresh;
+        plan.stats.code_bits = 8 * size;
+        header = 0;
+    }
+
+    plan.stats.header_size = header;
+    ::count_letters(plan, counts, size);
+    if (plan.mode == BlockMode::context) {
+        plan.stats.code_lengths = plan.model.code_lengths;
+    }
+    if (plan.mode == BlockMode::symbols) {
+        plan.stats.code_lengths = plan.symbols.code_lengths;
+    }
+    if (plan.mode == BlockMode::sorted) {
+        for (std::size_t index = 0; index < counts.size(); index++) {
+            plan.stats.code_lengths[plan.sorted.lengths[index]] +=
+                plan.sorted.counts[index];
+        }
+    }
+    if (plan.mode == BlockMode::lz77) {
+        plan.stats.code_lengths = plan.parse.code_lengths;
+    }
+    return plan;
+}
+
+static void write_huffman_payload(
+    std::span<const Container::character_type> block, const Plan& plan,
+    const Container::Table& previous,
+    std::vector<Container::character_type>& output,
+    Container::Timings& timings) {
+    BitStream::obitstream bits(output);
+    {
+        const StageTimer timer(timings.headers);
+        ::write_table(bits, plan.table, plan.lengths, previous);
+    }
+    const StageTimer timer(timings.coding);
+    // The pair table only pays off its construction on larger blocks
+    const auto encode = Huffman::generate_encode_table(
+        plan.lengths, block.size() >= (1 << 18));
+    Huffman::serialize_text(block, bits, encode);
+}
+
+static void write_interleaved_payload(
+    std::span<const Container::character_type> block, const Plan& plan,
+    const Container::Table& previous, std::size_t streams,
+    std::vector<Container::character_type>& output,
+    Container::Timings& timings) {
+    output.push_back(static_cast<Container::character_type>(streams));
+    const auto sizes = output.size();
+    output.resize(sizes + 4 * streams);
+    {
+        const StageTimer timer(timings.headers);
+        BitStream::obitstream bits(output);
+        ::write_table(bits, plan.table, plan.lengths, previous);
+    }
+    ::set_u32(output, sizes, output.size() - sizes - 4 * streams);
+
+    const StageTimer timer(timings.coding);
+    std::vector<std::vector<Container::character_type>> parts(streams);
+    {
+        std::vector<BitStream::obitstream> outputs;
+        outputs.reserve(streams);
+        for (auto& part : parts) {
+            outputs.emplace_back(part);
+        }
+        Huffman::serialize_interleaved(
+            block, outputs, Huffman::generate_encode_table(plan.lengths));
+    }
+    for (std::size_t stream = 0; stream + 1 < streams; stream++) {
+        ::set_u32(output, sizes + 4 * (stream + 1), parts[stream].size());
+    }
+    for (const auto& part : parts) {
+        output.insert(output.end(), part.begin(), part.end());
+    }
+}
+
+static void write_context_payload(
+    std::span<const Container::character_type> block, const Plan& plan,
+    std::vector<Container::character_type>& output,
+    Container::Timings& timings) {
+    BitStream::obitstream bits(output);
+    {
+        const StageTimer timer(timings.headers);
+        Context::serialize_model(bits, plan.model);
+    }
+    const StageTimer timer(timings.coding);
+    std::vector<Huffman::EncodeTable> tables;
+    for (const auto& lengths : plan.model.tables) {
+        tables.push_back(Huffman::generate_encode_table(lengths));
+    }
+    Huffman::serialize_text(block, bits,
+                            Context::by_context(plan.model, tables));
+}
+
+static void write_symbols_payload(
+    std::span<const Container::character_type> block, const Plan& plan,
+    std::vector<Container::character_type>& output,
+    Container::Timings& timings) {
+    BitStream::obitstream bits(output);
+    {
+        const StageTimer timer(timings.headers);
+        Symbols::serialize_model(bits, plan.symbols);
+    }
+    const StageTimer timer(timings.coding);
+    Symbols::serialize_text(block, bits, plan.symbols);
+}
+
+static void write_sorted_payload(
+    const Plan& plan, std::vector<Container::character_type>& output,
+    Container::Timings& timings) {
+    const auto& ranks = plan.sorted.transformed.ranks;
+    ::write_u32(output, plan.sorted.transformed.primary);
+    ::write_u32(output, ranks.size());
+    BitStream::obitstream bits(output);
+    {
+        const StageTimer timer(timings.headers);
+        Huffman::serialize_lengths(bits, plan.sorted.lengths);
+    }
+    const StageTimer timer(timings.coding);
+    Huffman::serialize_text(
+        ranks, bits, Huffman::generate_encode_table(plan.sorted.lengths));
+}
+
+static void write_lz77_payload(
+    std::span<const Container::character_type> block, const Plan& plan,
+    std::vector<Container::character_type>& output,
+    Container::Timings& timings) {
+    BitStream::obitstream bits(output);
+    {
+        const StageTimer timer(timings.headers);
+        Lz77::serialize_tables(bits, plan.parse.tables);
+    }
+    const StageTimer timer(timings.coding);
+    Lz77::serialize_text(block, plan.parse, bits);
+}
+
+// Appends the block as planned, header included, and returns its stats
+static Container::Stats code_block(
+    std::span<const Container::character_type> block, const Plan& plan,
+    const Container::Table& previous, const Container::Options& options,
+    std::vector<Container::character_type>& output) {
+    auto stats = plan.stats;
+    const auto begin = output.size();
+    ::write_u32(output, block.size());
+    output.push_back(::mode_byte(plan.mode, plan.table));
+    ::write_u32(output, 0);
+    if (options.checksums) {
+        const StageTimer timer(stats.timings.checksum);
+        ::write_u32(output, Checksum::crc32c(block));
+    }
+    const auto payload = output.size();
+    switch (plan.mode) {
+        case Container::BlockMode::huffman:
+            ::write_huffman_payload(block, plan, previous, output,
+                                    stats.timings);
+            break;
+        case Container::BlockMode::stored:
+            output.insert(output.end(), block.begin(), block.end());
+            break;
+        case Container::BlockMode::interleaved:
+            ::write_interleaved_payload(block, plan, previous,
+                                        options.streams, output,
+                                        stats.timings);
+            break;
+        case Container::BlockMode::context:
+            ::write_context_payload(block, plan, output, stats.timings);
+            break;
+        case Container::BlockMode::symbols:
+            ::write_symbols_payload(block, plan, output, stats.timings);
+            break;
+        case Container::BlockMode::sorted:
+            ::write_sorted_payload(plan, output, stats.timings);
+            break;
+        case Container::BlockMode::lz77:
+            ::write_lz77_payload(block, plan, output, stats.timings);
+            break;
+    }
+    ::set_u32(output, begin + 5, output.size() - payload);
+    stats.output_size = output.size() - begin;
+    return stats;
+}
+
+// Lengths of the block's own table. Small blocks coded with a dictionary
+// take its table instead, which saves building one they would hardly use.
+static Huffman::CodeLengths own_lengths(std::size_t size,
+                                        const Huffman::CountTable& counts,
+                                        const Container::Options& options) {
+    if (options.dictionary != nullptr &&
+        size <= Container::max_dictionary_block &&
+        ::covers(options.dictionary->lengths, counts)) {
+        return options.dictionary->lengths;
+    }
+    return Huffman::generate_code_lengths(counts, options.max_length);
+}
+
+// The table the decoder holds once `plan` is coded
+static Container::Table next_table(const Plan& plan,
+                                   const Container::Table& previous) {
+    if (plan.mode == Container::BlockMode::stored ||
+        plan.mode == Container::BlockMode::context ||
+        plan.mode == Container::BlockMode::symbols ||
+        plan.mode == Container::BlockMode::sorted ||
+        plan.mode == Container::BlockMode::lz77) {
+        return previous;
+    }
+    return plan.lengths;
+}
+
+// The block's order-1 model, if it is worth building
+static std::optional<Context::Model> context_model(
+    std::span<const Container::character_type> block,
+    const Container::Options& options) {
+    if (!options.contexts || block.size() < Container::min_context_block) {
+        return std::nullopt;
+    }
+    return Context::build_model(block, options.max_length);
+}
+
+// The block's symbol model, if the options ask for wider symbols
+static std::optional<Symbols::Model> symbol_model(
+    std::span<const Container::character_type> block,
+    const Container::Options& options) {
+    if (options.symbols == Symbols::Kind::bytes) {
+        return std::nullopt;
+    }
+    return Symbols::build_model(block, options.symbols, options.max_length);
+}
+
+// The block after the block-sorting transform, if the options ask for it
+static std::optional<Sorted> sort_block(
+    std::span<const Container::character_type> block,
+    const Container::Options& options, Container::Timings& timings) {
+    if (!options.sort_blocks || block.size() > Transform::max_block) {
+        return std::nullopt;
+    }
+    Sorted sorted{.transformed = {}, .counts = {}, .lengths = {}};
+    {
+        const StageTimer timer(timings.transform);
+        sorted.transformed = Transform::forward(block);
+    }
+    const StageTimer timer(timings.tables);
+    sorted.counts = Histogram::count(sorted.transformed.ranks);
+    sorted.lengths =
+        Huffman::generate_code_lengths(sorted.counts, options.max_length);
+    return sorted;
+}
+
+// The block's LZ77 sequences, if the options ask for them
+static std::optional<Lz77::Parse> lz77_parse(
+    std::span<const Container::character_type> block,
+    const Container::Options& options, Container::Timings& timings) {
+    if (options.lz77 == 0) {
+        return std::nullopt;
+    }
+    const StageTimer timer(timings.transform);
+    return Lz77::parse(block, options.lz77, options.max_length);
+}
+
+Container::Stats Container::compress_block(
+    std::span<const character_type> block,
+    std::vector<character_type>& output, const Options& options,
+    Table& previous) {
+    Timings timings;
+    Histogram::CountTable counts;
+    {
+        const StageTimer timer(timings.histogram);
+        counts = Histogram::count(block);
+    }
+    Huffman::CodeLengths lengths;
+    std::optional<Context::Model> model;
+    std::optional<Symbols::Model> symbols;
+    {
+        const StageTimer timer(timings.tables);
+        lengths = ::own_lengths(block.size(), counts, options);
+        model = ::context_model(block, options);
+        symbols = ::symbol_model(block, options);
+    }
+    const auto sorted = ::sort_block(block, options, timings);
+    const auto parse = ::lz77_parse(block, options, timings);
+    Plan plan;
+    {
+        const StageTimer timer(timings.tables);
+        plan = ::plan_block(block.size(), counts, lengths, previous,
+                            model ? &*model : nullptr,
+                            symbols ? &*symbols : nullptr,
+                            sorted ? &*sorted : nullptr,
+                            parse ? &*parse : nullptr, options);
+    }
+    auto stats = ::code_block(block, plan, previous, options, output);
+    stats.timings += timings;
+    previous = ::next_table(plan, previous);
+    return stats;
+}
+
+static InterleavedPayload split_interleaved_payload(
+    std::span<const Container::character_type> payload) {
+    if (payload.empty()) {
+        ::invalid_file();
+    }
+    const std::size_t streams = static_cast<std::uint8_t>(payload[0]);
+    if (streams < 2 || streams > Container::max_streams ||
+        payload.size() < 1 + 4 * streams) {
+        ::invalid_file();
+    }
+    // Sizes of the table header and of every stream but the last
+    std::vector<std::size_t> sizes(streams + 1);
+    std::size_t total = 1 + 4 * streams;
+    for (std::size_t i = 0; i < streams; i++) {
+        sizes[i] = ::load_u32(payload, 1 + 4 * i);
+        total += sizes[i];
+    }
+    if (total > payload.size()) {
+        ::invalid_file();
+    }
+    sizes[streams] = payload.size() - total;
+
+    InterleavedPayload parts;
+    auto rest = payload.subspan(1 + 4 * streams);
+    parts.table = rest.first(sizes[0]);
+    rest = rest.subspan(sizes[0]);
+    for (std::size_t stream = 0; stream < streams; stream++) {
+        parts.streams.push_back(rest.first(sizes[stream + 1]));
+        rest = rest.subspan(sizes[stream + 1]);
+    }
+    return parts;
+}
+
+Container::Table Container::next_table(BlockMode mode, TableMode table,
+                                       std::span<const character_type> payload,
+                                       const Table& previous,
+                                       const Dictionary* dictionary) {
+    switch (mode) {
+        case BlockMode::huffman: {
+            BitStream::ibitstream input(payload);
+            return ::read_table(input, table, previous, dictionary);
+        }
+        case BlockMode::stored:
+        case BlockMode::context:
+        case BlockMode::symbols:
+        case BlockMode::sorted:
+        case BlockMode::lz77:
+            return previous;
+        case BlockMode::interleaved: {
+            BitStream::ibitstream input(
+                ::split_interleaved_payload(payload).table);
+            return ::read_table(input, table, previous, dictionary);
+        }
+    }
+    ::invalid_file();
+}
+
+Container::Stats Container::decompress_block(
+    BlockMode mode, TableMode table, std::span<const character_type> payload,
+    std::span<character_type> block, const Table& previous,
+    const Dictionary* dictionary, std::optional<std::uint32_t> checksum) {
+    Stats stats;
+    stats.input_size = block.size();
+    stats.output_size = 4 + 1 + 4 + (checksum ? 4 : 0) + payload.size();
+    stats.blocks = 1;
+    auto& timings = stats.timings;
+    switch (mode) {
+        case BlockMode::huffman: {
+            BitStream::ibitstream input(payload);
+            Huffman::DecodeTable decode;
+            {
+                const StageTimer timer(timings.tables);
+                decode = Huffman::generate_decode_table(
+                    ::read_table(input, table, previous, dictionary));
+            }
+            const StageTimer timer(timings.coding);
+            Huffman::deserialize_text(input, block, decode);
+            break;
+        }
+        case BlockMode::stored: {
+            if (table != TableMode::fresh || payload.size() != block.size()) {
+                ::invalid_file();
+            }
+            const StageTimer timer(timings.coding);
+            std::copy(payload.begin(), payload.end(), block.begin());
+            break;
+        }
+        case BlockMode::interleaved: {
+            const auto parts = ::split_interleaved_payload(payload);
+            Huffman::DecodeTable decode;
+            {
+                const StageTimer timer(timings.tables);
+                BitStream::ibitstream header(parts.table);
+                decode = Huffman::generate_decode_table(
+                    ::read_table(header, table, previous, dictionary));
+            }
+            const StageTimer timer(timings.coding);
+            std::vector<BitStream::ibitstream> inputs;
+            inputs.reserve(parts.streams.size());
+            for (const auto& stream : parts.streams) {
+                inputs.emplace_back(stream);
+            }
+            Huffman::deserialize_interleaved(inputs, block, decode);
+            break;
+        }
+        case BlockMode::context: {
+            if (table != TableMode::fresh) {
+                ::invalid_file();
+            }
+            BitStream::ibitstream input(payload);
+            std::vector<Huffman::DecodeTable> tables;
+            Context::Model model;
+            {
+                const StageTimer timer(timings.tables);
+                model = Context::deserialize_model(input);
+                for (const auto& lengths : model.tables) {
+                    tables.push_back(Huffman::generate_decode_table(lengths));
+                }
+            }
+            const StageTimer timer(timings.coding);
+            Huffman::deserialize_text(input, block,
+                                      Context::by_context(model, tables));
+            break;
+        }
+        case BlockMode::symbols: {
+            if (table != TableMode::fresh) {
+                ::invalid_file();
+            }
+            BitStream::ibitstream input(payload);
+            Symbols::Model model;
+            {
+                const StageTimer timer(timings.tables);
+                model = Symbols::deserialize_model(input);
+            }
+            const StageTimer timer(timings.coding);
+            Symbols::deserialize_text(input, block, model);
+            break;
+        }
+        case BlockMode::sorted: {
+            if (table != TableMode::fresh || payload.size() < 8) {
+                ::invalid_file();
+            }
+            Transform::Transformed transformed{
+                .primary = ::load_u32(payload, 0),
+                .ranks = {}};
+            const std::size_t ranks = ::load_u32(payload, 4);
+            // Every letter takes two ranks at most
+            if (ranks > 2 * block.size()) {
+                ::invalid_file();
+            }
+            BitStream::ibitstream input(payload.subspan(8));
+            Huffman::DecodeTable decode;
+            {
+                const StageTimer timer(timings.tables);
+                decode = Huffman::generate_decode_table(
+                    Huffman::deserialize_lengths(input));
+            }
+            {
+                const StageTimer timer(timings.coding);
+                transformed.ranks.resize(ranks);
+                Huffman::deserialize_text(input, transformed.ranks, decode);
+            }
+            const StageTimer timer(timings.transform);
+            Transform::inverse(transformed, block);
+            break;
+        }
+        case BlockMode::lz77: {
+            if (table != TableMode::fresh) {
+                ::invalid_file();
+            }
+            BitStream::ibitstream input(payload);
+            Lz77::Tables tables;
+            {
+                const StageTimer timer(timings.tables);
+                tables = Lz77::deserialize_tables(input);
+            }
+            const StageTimer timer(timings.coding);
+            Lz77::deserialize_text(input, block, tables);
+            break;
+        }
+        default:
+            ::invalid_file();
+    }
+    if (checksum) {
+        const StageTimer timer(timings.checksum);
+        if (Checksum::crc32c(block) != *checksum) {
+            throw std::ios::failure("Block checksum mismatch!");
+        }
+    }
+    return stats;
+}
+
+namespace {
+struct Decoded {
+    std::vector<Container::character_type> block;
+    Container::Stats stats;
+};
+}  // namespace
+
+static Decoded decompress_block(const RawBlock& raw,
+                                const Container::Table& previous,
+                                const Container::Dictionary* dictionary) {
+    Decoded decoded;
+    decoded.block.resize(raw.size);
+    decoded.stats = Container::decompress_block(raw.mode, raw.table,
+                                                raw.payload, decoded.block,
+                                                previous, dictionary,
+                                                raw.checksum);
+    return decoded;
+}
+
+// Hands the table of `raw` over to the next block and returns the one
+// `raw` itself refers to
+// No table header, fresh or delta, takes more bytes than this: each letter
+// starts at most one run, whose length or difference takes at most
+// `bit_width(2 * max_code_length + 1)` bits and whose gamma-coded size at
+// most twice its letters
+constexpr std::size_t max_table_bytes =
+    (Huffman::alphabet_size * 2 *
+         std::bit_width(2u * Huffman::max_code_length + 1) +
+     3 + 7) /
+    8;
+
+// The table the decoder holds after the block whose header `raw` holds and
+// whose payload of `payload` bytes `input` is at, reading its table header
+// but not its codes
+static Container::Table read_block_table(
+    std::basic_istream<Container::character_type>& input,
+    const RawBlock& raw, std::size_t payload,
+    const Container::Table& previous,
+    const Container::Dictionary* dictionary) {
+    using Container::BlockMode;
+    if (raw.mode != BlockMode::huffman &&
+        raw.mode != BlockMode::interleaved) {
+        return previous;
+    }
+    std::size_t size = std::min(payload, max_table_bytes);
+    if (raw.mode == BlockMode::interleaved) {
+        // The streams' count, then the table header's size
+        std::array<Container::character_type, 5> sizes;
+        if (payload < sizes.size() ||
+            !input.read(sizes.data(), sizes.size())) {
+            ::invalid_file();
+        }
+        const std::size_t streams = static_cast<std::uint8_t>(sizes[0]);
+        size = ::load_u32(sizes, 1);
+        if (streams < 2 || streams > Container::max_streams ||
+            payload < 1 + 4 * streams || size > payload - 1 - 4 * streams) {
+            ::invalid_file();
+        }
+        input.seekg(4 * (streams - 1), std::ios::cur);
+    }
+    std::vector<Container::character_type> bytes(size);
+    if (!input.read(bytes.data(), bytes.size())) {
+        ::invalid_file();
+    }
+    BitStream::ibitstream bits{
+        std::span<const Container::character_type>(bytes)};
+    return ::read_table(bits, raw.table, previous, dictionary);
+}
+
+static Container::Table advance_table(
+    const RawBlock& raw, Container::Table& table,
+    const Container::Dictionary* dictionary) {
+    return std::exchange(
+        table, Container::next_table(raw.mode, raw.table, raw.payload, table,
+                                     dictionary));
+}
+
+// Codes a block with the container's own table, or stores it if the table
+// would grow it. The block's letters are still counted, for the stats and
+// to tell what tables of its own would have cost.
+static Container::Stats code_sampled_block(
+    std::span<const Container::character_type> block,
+    const Huffman::CodeLengths& sampled, const Container::Options& options,
+    std::vector<Container::character_type>& output) {
+    using namespace Container;
+    Timings timings;
+    Huffman::CountTable counts;
+    {
+        const StageTimer timer(timings.histogram);
+        counts = Histogram::count(block);
+    }
+    const bool interleaved =
+        options.streams > 1 && block.size() >= min_interleaved_block;
+    Plan plan{.mode = interleaved ? BlockMode::interleaved : BlockMode::huffman,
+              .table = TableMode::dictionary,
+              .lengths = sampled,
+              .model = {},
+              .symbols = {},
+              .sorted = {},
+              .parse = {},
+              .stats = {}};
+    {
+        const StageTimer timer(timings.tables);
+        plan.stats.input_size = block.size();
+        plan.stats.blocks = 1;
+        plan.stats.code_bits = Huffman::encoded_size(counts, sampled);
+        plan.stats.optimal_bits = Huffman::optimal_encoded_size(counts);
+        const auto own =
+            Huffman::generate_code_lengths(counts, options.max_length);
+        plan.stats.exact_bits = std::min<std::uint64_t>(
+            Huffman::encoded_size(counts, own) +
+                8 * ::table_size(TableMode::fresh, own, {}),
+            8 * block.size());
+    }
+    auto header = ::table_size(TableMode::dictionary, sampled, {});
+    auto payload = header + (plan.stats.code_bits + 7) / 8;
+    if (interleaved) {
+        payload += 1 + 4 * options.streams + options.streams;
+    }
+    if (payload >= block.size()) {
+        plan.mode = BlockMode::stored;
+        plan.table = TableMode::fresh;
+        plan.stats.code_bits = 8 * block.size();
+        header = 0;
+    }
+    plan.stats.header_size = header;
+    ::count_letters(plan, counts, block.size());
+    auto stats = ::code_block(block, plan, {}, options, output);
+    stats.timings += timings;
+    return stats;
+}
+
+// Codes the blocks handed out by `next`, which returns an empty optional
+// once the input ends, followed by the end marker and the index. With a
+// `sampled` table, the header carries it and every block is coded with it.
+template <typename Next>
+static Container::Stats compress_blocks(
+    Next next, std::basic_ostream<Container::character_type>& output,
+    const Container::Options& options, const Container::Table& sampled = {}) {
+    using namespace Container;
+    using Block = typename decltype(next())::value_type;
+    if (options.block_size == 0 || options.block_size > max_block_size) {
+        throw std::invalid_argument("Block size is out of range");
+    }
+    if (options.sample != 0 && options.dictionary != nullptr) {
+        throw std::invalid_argument(
+            "A sampled table does not combine with a dictionary");
+    }
+    Stats stats;
+    std::vector<character_type> header(magic.begin(), magic.end());
+    header.push_back((options.index ? Flags::indexed : 0) |
+                     (options.dictionary != nullptr ? Flags::dictionary : 0) |
+                     (options.checksums ? Flags::checksums : 0) |
+                     (sampled ? Flags::table : 0));
+    ::write_u32(header, options.block_size);
+    if (options.dictionary != nullptr) {
+        ::write_u32(header, options.dictionary->id);
+    }
+    if (sampled) {
+        const auto sizes = header.size();
+        ::write_u32(header, 0);
+        {
+            BitStream::obitstream bits(header);
+            Huffman::serialize_lengths(bits, *sampled);
+        }
+        ::set_u32(header, sizes, header.size() - sizes - 4);
+        stats.header_size = header.size() - sizes;
+    }
+    output.write(header.data(), header.size());
+    stats.output_size = header.size();
+
+    struct Analysed {
+        Block block;
+        Huffman::CountTable counts;
+        Huffman::CodeLengths lengths;
+        std::optional<Context::Model> model;
+        std::optional<Symbols::Model> symbols;
+        std::optional<Sorted> sorted;
+        std::optional<Lz77::Parse> parse;
+        Timings timings;
+    };
+    struct Coded {
+        std::vector<character_type> bytes;
+        Stats stats;
+    };
+    Index index;
+    Parallel::ThreadPool pool(options.threads);
+    // Planning and coding hold a block per thread each, and sampled blocks,
+    // which skip planning, two in coding, so at most two blocks per thread
+    // are held besides the one being read, planned or written
+    const auto limit = sampled ? 2 * pool.size() : pool.size();
+    Parallel::InOrder<Coded> coder(
+        pool,
+        [&output, &stats, &index](Coded coded) {
+            index.push_back(IndexEntry{stats.output_size, stats.input_size,
+                                       static_cast<std::uint32_t>(
+                                           coded.stats.input_size)});
+            output.write(coded.bytes.data(), coded.bytes.size());
+            stats += coded.stats;
+        },
+        limit);
+    // Blocks are analysed in parallel, planned in order against the table
+    // the decoder will hold, then coded in parallel again
+    Table table;
+    std::size_t since_fresh = 0;
+    Parallel::InOrder<Analysed> planner(
+        pool,
+        [&](Analysed analysed) {
+            auto previous = since_fresh < table_refresh ? table : Table();
+            Plan plan;
+            {
+                const StageTimer timer(analysed.timings.tables);
+                plan = ::plan_block(
+                    analysed.block.size(), analysed.counts, analysed.lengths,
+                    previous, analysed.model ? &*analysed.model : nullptr,
+                    analysed.symbols ? &*analysed.symbols : nullptr,
+                    analysed.sorted ? &*analysed.sorted : nullptr,
+                    analysed.parse ? &*analysed.parse : nullptr, options);
+            }
+            table = ::next_table(plan, table);
+            const bool fresh = ::starts_tables(plan.mode, plan.table);
+            since_fresh = fresh ? 1 : since_fresh + 1;
+            coder.submit([block = std::move(analysed.block), plan,
+                          previous = std::move(previous), &options,
+                          timings = analysed.timings]() -> Coded {
+                Coded coded;
+                coded.stats =
+                    ::code_block(block, plan, previous, options, coded.bytes);
+                coded.stats.timings += timings;
+                return coded;
+            });
+        },
+        limit);
+    while (auto block = next()) {
+        // The table is settled, so blocks need no planning
+        if (sampled) {
+            coder.submit([block = std::move(*block), &sampled,
+                          &options]() -> Coded {
+                Coded coded;
+                coded.stats = ::code_sampled_block(block, *sampled, options,
+                                                   coded.bytes);
+                return coded;
+            });
+            continue;
+        }
+        planner.submit([block = std::move(*block), &options]() -> Analysed {
+            Analysed analysed{.block = std::move(block),
+                              .counts = {},
+                              .lengths = {},
+                              .model = {},
+                              .symbols = {},
+                              .sorted = {},
+                              .parse = {},
+                              .timings = {}};
+            {
+                const StageTimer timer(analysed.timings.histogram);
+                analysed.counts = Histogram::count(analysed.block);
+            }
+            {
+                const StageTimer timer(analysed.timings.tables);
+                analysed.lengths = ::own_lengths(analysed.block.size(),
+                                                 analysed.counts, options);
+                analysed.model = ::context_model(analysed.block, options);
+                analysed.symbols = ::symbol_model(analysed.block, options);
+            }
+            analysed.sorted =
+                ::sort_block(analysed.block, options, analysed.timings);
+            analysed.parse =
+                ::lz77_parse(analysed.block, options, analysed.timings);
+            return analysed;
+        });
+    }
+    planner.finish();
+    coder.finish();
+
+    std::vector<character_type> end;
+    ::write_u32(end, 0);
+    if (options.index) {
+        const auto index_offset = stats.output_size + end.size();
+        for (const auto& entry : index) {
+            ::write_u64(end, entry.compressed_offset);
+            ::write_u64(end, entry.uncompressed_offset);
+            ::write_u32(end, entry.size);
+        }
+        ::write_u64(end, index.size());
+        ::write_u64(end, index_offset);
+        end.insert(end.end(), index_magic.begin(), index_magic.end());
+    }
+    output.write(end.data(), end.size());
+    stats.output_size += end.size();
+    return stats;
+}
+
+Container::Stats Container::compress(
+    std::basic_istream<character_type>& input,
+    std::basic_ostream<character_type>& output, const Options& options) {
+    const auto read =
+        [&input, &options]() -> std::optional<std::vector<character_type>> {
+        std::vector<character_type> block(options.block_size);
+        input.read(block.data(), block.size());
+        block.resize(input.gcount());
+        if (block.empty()) {
+            return std::nullopt;
+        }
+        return block;
+    };
+    // A stream cannot be sampled ahead, so its first block stands in for it
+    auto first = options.sample != 0 ? read() : std::nullopt;
+    Table sampled;
+    if (first) {
+        sampled = sample_table(*first, options);
+    }
+    return ::compress_blocks(
+        [&first, &read] {
+            return first ? std::exchange(first, std::nullopt) : read();
+        },
+        output, options, sampled);
+}
+
+Container::Stats Container::compress(
+    std::span<const character_type> input,
+    std::basic_ostream<character_type>& output, const Options& options) {
+    return ::compress_blocks(
+        [&input, &options]() -> std::optional<std::span<const character_type>> {
+            if (input.empty()) {
+                return std::nullopt;
+            }
+            const auto block =
+                input.first(std::min(input.size(), options.block_size));
+            input = input.subspan(block.size());
+            return block;
+        },
+        output, options,
+        options.sample != 0 ? Table(sample_table(input, options)) : Table());
+}
+
+Container::Stats Container::decompress(
+    std::basic_istream<character_type>& input,
+    std::basic_ostream<character_type>& output, std::size_t threads,
+    const Dictionary* dictionary) {
+    const auto header = ::read_header(input);
+    dictionary = ::check_dictionary(header, dictionary);
+    Stats stats;
+    Parallel::ThreadPool pool(threads);
+    Parallel::InOrder<Decoded> decoder(
+        pool, [&output, &stats](Decoded decoded) {
+            output.write(decoded.block.data(), decoded.block.size());
+            stats += decoded.stats;
+        });
+    // Tables are followed in order, blocks are then decoded independently
+    Table table;
+    for (RawBlock raw; ::read_block(input, header, raw);) {
+        auto previous = ::advance_table(raw, table, dictionary);
+        decoder.submit([raw = std::move(raw), previous = std::move(previous),
+                        dictionary] {
+            return ::decompress_block(raw, previous, dictionary);
+        });
+    }
+    decoder.finish();
+    // The index is not needed, but belongs to the container all the same
+    input.ignore(std::numeric_limits<std::streamsize>::max());
+    stats.output_size += ::header_bytes(header) + 4 + input.gcount();
+    return stats;
+}
+
+std::uint64_t Container::decompressed_size(
+    std::span<const character_type> input) {
+    std::uint64_t size = 0;
+    const auto header = ::read_header(input);
+    ::for_each_block(input, header,
+                     [&size](BlockMode, TableMode, std::uint32_t block_size,
+                             std::optional<std::uint32_t>,
+                             std::span<const character_type>) {
+                         size += block_size;
+                     });
+    return size;
+}
+
+Container::Stats Container::decompress(std::span<const character_type> input,
+                                       std::span<character_type> output,
+                                       std::size_t threads,
+                                       const Dictionary* dictionary) {
+    auto blocks = input;
+    const auto header = ::read_header(blocks);
+    dictionary = ::check_dictionary(header, dictionary);
+    // Every block owns its slice of the output, so they decode in any order
+    Parallel::ThreadPool pool(threads);
+    std::vector<std::future<Stats>> decoded;
+    Table table;
+    const auto visit = [&](BlockMode mode, TableMode table_mode,
+                           std::uint32_t size,
+                           std::optional<std::uint32_t> checksum,
+                           std::span<const character_type> payload) {
+        if (output.size() < size) {
+            ::invalid_file();
+        }
+        const auto block = output.first(size);
+        auto previous = std::exchange(
+            table, next_table(mode, table_mode, payload, table, dictionary));
+        decoded.push_back(pool.submit([mode, table_mode, payload, block,
+                                       previous = std::move(previous),
+                                       dictionary, checksum] {
+            return decompress_block(mode, table_mode, payload, block,
+                                    previous, dictionary, checksum);
+        }));
+        output = output.subspan(size);
+    };
+    ::for_each_block(blocks, header, visit);
+    if (!output.empty()) {
+        ::invalid_file();
+    }
+    Stats stats;
+    for (auto& block : decoded) {
+        stats += block.get();
+    }
+    // Count the whole container, index included, rather than the blocks
+    stats.output_size = input.size();
+    return stats;
+}
+
+namespace {
+struct Checked {
+    Container::Stats stats;
+    std::optional<Container::BadBlock> bad;
+};
+}  // namespace
+
+// Hands the table of a block over to the next one as ::advance_table does,
+// but notes a table that does not read in `where` rather than throwing.
+// It leaves no table, so the blocks that refer to it turn out bad too.
+static Container::Table follow_table(
+    Container::BlockMode mode, Container::TableMode table_mode,
+    std::span<const Container::character_type> payload,
+    Container::Table& table, const Container::Dictionary* dictionary,
+    Container::BadBlock& where) {
+    try {
+        return std::exchange(table,
+                             Container::next_table(mode, table_mode, payload,
+                                                   table, dictionary));
+    } catch (const std::ios::failure& error) {
+        where.error = error.what();
+        table.reset();
+        return {};
+    }
+}
+
+// Decodes a block into a buffer its thread keeps, noting it as `where` if
+// it does not decode or match its checksum
+static Checked check_block(Container::BlockMode mode,
+                           Container::TableMode table,
+                           std::span<const Container::character_type> payload,
+                           const Container::Table& previous,
+                           const Container::Dictionary* dictionary,
+                           std::optional<std::uint32_t> checksum,
+                           Container::BadBlock where) {
+    Checked checked;
+    if (where.error.empty()) {
+        thread_local std::vector<Container::character_type> block;
+        block.resize(where.size);
+        try {
+            checked.stats = Container::decompress_block(
+                mode, table, payload, block, previous, dictionary, checksum);
+            return checked;
+        } catch (const std::ios::failure& error) {
+            where.error = error.what();
+        }
+    }
+    checked.bad = std::move(where);
+    return checked;
+}
+
+static void add_checked(Container::Verification& verification,
+                        Checked checked) {
+    verification.stats += checked.stats;
+    if (checked.bad) {
+        verification.bad_blocks.push_back(std::move(*checked.bad));
+    }
+}
+
+Container::Verification Container::verify(
+    std::basic_istream<character_type>& input, std::size_t threads,
+    const Dictionary* dictionary) {
+    const auto header = ::read_header(input);
+    dictionary = ::check_dictionary(header, dictionary);
+    Verification verification;
+    verification.checksums = header.flags & Flags::checksums;
+    Parallel::ThreadPool pool(threads);
+    Parallel::InOrder<Checked> checker(
+        pool, [&verification](Checked checked) {
+            ::add_checked(verification, std::move(checked));
+        });
+    Table table;
+    BadBlock where{::header_bytes(header), 0, 0, {}};
+    for (RawBlock raw; ::read_block(input, header, raw);) {
+        where.size = raw.size;
+        where.error.clear();
+        auto previous = ::follow_table(raw.mode, raw.table, raw.payload,
+                                       table, dictionary, where);
+        const auto payload_size = raw.payload.size();
+        checker.submit([raw = std::move(raw), previous = std::move(previous),
+                        dictionary, where] {
+            return ::check_block(raw.mode, raw.table, raw.payload, previous,
+                                 dictionary, raw.checksum, where);
+        });
+        where.compressed_offset += ::block_header_bytes(header) + payload_size;
+        where.uncompressed_offset += where.size;
+    }
+    checker.finish();
+    input.ignore(std::numeric_limits<std::streamsize>::max());
+    verification.stats.output_size +=
+        ::header_bytes(header) + 4 + input.gcount();
+    return verification;
+}
+
+Container::Verification Container::verify(
+    std::span<const character_type> input, std::size_t threads,
+    const Dictionary* dictionary) {
+    auto blocks = input;
+    const auto header = ::read_header(blocks);
+    dictionary = ::check_dictionary(header, dictionary);
+    Verification verification;
+    verification.checksums = header.flags & Flags::checksums;
+    Parallel::ThreadPool pool(threads);
+    std::vector<std::future<Checked>> checked;
+    Table table;
+    BadBlock where{::header_bytes(header), 0, 0, {}};
+    const auto visit = [&](BlockMode mode, TableMode table_mode,
+                           std::uint32_t size,
+                           std::optional<std::uint32_t> checksum,
+                           std::span<const character_type> payload) {
+        where.size = size;
+        where.error.clear();
+        auto previous = ::follow_table(mode, table_mode, payload, table,
+                                       dictionary, where);
+        checked.push_back(pool.submit([mode, table_mode, payload,
+                                       previous = std::move(previous),
+                                       dictionary, checksum, where] {
+            return ::check_block(mode, table_mode, payload, previous,
+                                 dictionary, checksum, where);
+        }));
+        where.compressed_offset +=
+            ::block_header_bytes(header) + payload.size();
+        where.uncompressed_offset += size;
+    };
+    ::for_each_block(blocks, header, visit);
+    for (auto& block : checked) {
+        ::add_checked(verification, block.get());
+    }
+    verification.stats.output_size = input.size();
+    return verification;
+}
+
+Container::Index Container::read_index(
+    std::basic_istream<character_type>& input) {
+    input.seekg(0);
+    const auto header = ::read_header(input);
+    if (!(header.flags & Flags::indexed)) {
+        throw std::ios::failure("The huf-compressed file has no index!");
+    }
+    input.seekg(0, std::ios::end);
+    const std::uint64_t size = input.tellg();
+    if (size < header_size + footer_size) {
+        ::invalid_file();
+    }
+    input.seekg(size - footer_size);
+    const auto count = ::read_u64(input);
+    const auto offset = ::read_u64(input);
+    std::array<character_type, index_magic.size()> signature;
+    // The footer is not trusted until the entries it counts fit the file,
+    // which keeps the sums below from overflowing
+    if (!input.read(signature.data(), signature.size()) ||
+        signature != index_magic ||
+        count > (size - header_size - footer_size) / index_entry_size ||
+        offset != size - footer_size - count * index_entry_size) {
+        ::invalid_file();
+    }
+    input.seekg(offset);
+    Index index(count);
+    std::uint64_t uncompressed_offset = 0;
+    for (auto& entry : index) {
+        entry.compressed_offset = ::read_u64(input);
+        entry.uncompressed_offset = ::read_u64(input);
+        entry.size = ::read_u32(input);
+        if (entry.uncompressed_offset != uncompressed_offset ||
+            entry.compressed_offset >= offset) {
+            ::invalid_file();
+        }
+        uncompressed_offset += entry.size;
+    }
+    return index;
+}
+
+void Container::extract(std::basic_istream<character_type>& input,
+                        std::basic_ostream<character_type>& output,
+                        std::uint64_t offset, std::uint64_t length,
+                        std::size_t threads, const Dictionary* dictionary) {
+    const auto index = read_index(input);
+    input.seekg(0);
+    const auto header = ::read_header(input);
+    dictionary = ::check_dictionary(header, dictionary);
+    const auto end = offset + std::min(length, UINT64_MAX - offset);
+    auto block = std::upper_bound(
+        index.begin(), index.end(), offset,
+        [](std::uint64_t offset, const IndexEntry& entry) {
+            return offset < entry.uncompressed_offset + entry.size;
+        });
+
+    Parallel::ThreadPool pool(threads);
+    Parallel::InOrder<std::vector<character_type>> decoder(
+        pool, [&output](std::vector<character_type> slice) {
+            output.write(slice.data(), slice.size());
+        });
+    const auto read_indexed_block = [&input, &header](
+                                            const IndexEntry& entry,
+                                            RawBlock& raw) {
+        input.seekg(entry.compressed_offset);
+        if (!::read_block(input, header, raw) || raw.size != entry.size) {
+            ::invalid_file();
+        }
+    };
+    const auto read_indexed_header = [&input, &header](
+                                             const IndexEntry& entry,
+                                             RawBlock& raw) {
+        input.seekg(entry.compressed_offset);
+        const auto payload = ::read_block_header(input, header, raw);
+        if (raw.size != entry.size) {
+            ::invalid_file();
+        }
+        return payload;
+    };
+
+    // A first block that reuses or delta-codes the table before it needs
+    // the blocks back to the last one with a table of its own, which comes
+    // at most `table_refresh` blocks earlier. Only their headers and table
+    // headers are read.
+    Table table;
+    RawBlock raw;
+    if (block != index.end()) {
+        read_indexed_header(*block, raw);
+    }
+    if (block != index.end() && (raw.table == TableMode::reused ||
+                                 raw.table == TableMode::delta)) {
+        auto replay = block;
+        while (replay != index.begin()) {
+            read_indexed_header(*--replay, raw);
+            if (::starts_tables(raw.mode, raw.table)) {
+                break;
+            }
+        }
+        for (; replay != block; ++replay) {
+            const auto payload = read_indexed_header(*replay, raw);
+            table = ::read_block_table(input, raw, payload, table,
+                                       dictionary);
+        }
+    }
+
+    for (; block != index.end() && block->uncompressed_offset < end;
+         ++block) {
+        read_indexed_block(*block, raw);
+        const auto first = std::max(offset, block->uncompressed_offset) -
+                           block->uncompressed_offset;
+        const auto last =
+            std::min(end, block->uncompressed_offset + block->size) -
+            block->uncompressed_offset;
+        auto previous = ::advance_table(raw, table, dictionary);
+        decoder.submit([raw = std::move(raw), previous = std::move(previous),
+                        dictionary, first, last] {
+            auto block = ::decompress_block(raw, previous, dictionary).block;
+            return std::vector<character_type>(block.begin() + first,
+                                               block.begin() + last);
+        });
+    }
+    decoder.finish();
+}
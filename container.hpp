@@ -0,0 +1,316 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "bitstream.hpp"
+#include "context.hpp"
+#include "huffman.hpp"
+#include "symbols.hpp"
+
+// A container starts with `magic`, a byte of `Flags`, the block size,
+// with `Flags::dictionary` the id of the dictionary it was coded with, and
+// with `Flags::table` the u32 size of a table written by
+// Huffman::serialize_lengths followed by the table, which blocks then take
+// as their dictionary. It then holds the input as a sequence of
+// independently coded blocks:
+//
+//   uncompressed size  u32 (0 ends the blocks)
+//   mode               u8  (BlockMode, ored with TableMode shifted left by 4)
+//   payload size       u32
+//   checksum           u32 (with `Flags::checksums`: CRC-32C of the
+//                      uncompressed bytes)
+//   payload            depends on the mode, see BlockMode
+//
+// With `Flags::indexed`, the blocks are followed by an index of
+// `IndexEntry`s (u64 compressed offset, u64 uncompressed offset, u32 size)
+// and a footer: u64 entry count, u64 index offset and `index_magic`.
+// Integers are little-endian.
+namespace Container {
+
+using character_type = BitStream::character_type;
+
+constexpr std::array<character_type, 4> magic = {'H', 'U', 'F', 1};
+constexpr std::array<character_type, 4> index_magic = {'H', 'U', 'F', 'I'};
+
+enum Flags : std::uint8_t {
+    indexed = 1 << 0,
+    dictionary = 1 << 1,
+    checksums = 1 << 2,
+    table = 1 << 3,
+};
+
+constexpr std::size_t default_block_size = 1 << 20;
+constexpr std::size_t max_block_size = std::size_t(1) << 31;
+
+enum class BlockMode : std::uint8_t {
+    // Table header and codes, padded to a byte
+    huffman = 0,
+    // Blocks that Huffman coding would grow are copied as they are
+    stored = 1,
+    // u8 stream count N, u32 size of the table header, N - 1 u32 sizes of
+    // the streams but the last, the header, then the streams as written by
+    // Huffman::serialize_interleaved, each padded to a byte
+    interleaved = 2,
+    // Order-1 model as written by Context::serialize_model, then codes
+    // written by Huffman::serialize_text with the model's tables, padded to
+    // a byte. The block leaves the table the decoder holds as it was
+    context = 3,
+    // Symbol model as written by Symbols::serialize_model, then codes
+    // written by Symbols::serialize_text, padded to a byte. The block leaves
+    // the table the decoder holds as it was
+    symbols = 4,
+    // u32 primary row and u32 size of the ranks of Transform::forward, a
+    // table as written by Huffman::serialize_lengths, then the ranks' codes,
+    // padded to a byte. The block leaves the table the decoder holds as it
+    // was
+    sorted = 5,
+    // Tables as written by Lz77::serialize_tables, then sequences written by
+    // Lz77::serialize_text, padded to a byte. The block leaves the table the
+    // decoder holds as it was
+    lz77 = 6,
+};
+
+// Where a Huffman-coded block gets its code lengths from. Reused and delta
+// tables refer to the table of the last Huffman-coded block before them
+enum class TableMode : std::uint8_t {
+    // Huffman::serialize_lengths
+    fresh = 0,
+    // No header, the previous table codes this block too
+    reused = 1,
+    // Huffman::serialize_length_deltas from the previous table
+    delta = 2,
+    // No header, the dictionary's table, or the container's own with
+    // `Flags::table`, codes this block
+    dictionary = 3,
+};
+
+// Blocks between fresh tables at most, which bounds how far back random
+// access has to follow tables
+constexpr std::size_t table_refresh = 16;
+
+// Code lengths the decoder holds from the last Huffman-coded block
+using Table = std::optional<Huffman::CodeLengths>;
+
+// A table trained on sample inputs and shared by the coder and the decoder,
+// so that small inputs do without a table of their own. Dictionary files
+// hold `dictionary_magic`, the u32 id, then the table as written by
+// Huffman::serialize_lengths.
+struct Dictionary {
+    // Hash of the code lengths, which containers refer to the table by
+    std::uint32_t id;
+    Huffman::CodeLengths lengths;
+};
+
+constexpr std::array<character_type, 4> dictionary_magic = {'H', 'U', 'F',
+                                                             'D'};
+
+// Blocks coded with a dictionary up to this size take its table rather
+// than building one of their own
+constexpr std::size_t max_dictionary_block = 1 << 16;
+
+// Smaller blocks do not make up for the extra tables of an order-1 model
+constexpr std::size_t min_context_block = 1 << 16;
+
+// Sampling a few MiB is plenty for inputs with stable statistics
+constexpr std::size_t default_sample = 1 << 22;
+
+constexpr std::size_t max_streams = 16;
+// Smaller blocks do not make up for the extra stream headers
+constexpr std::size_t min_interleaved_block = 1 << 14;
+
+struct Options {
+    std::size_t block_size = default_block_size;
+    std::size_t threads = 1;
+    std::uint8_t max_length = Huffman::max_code_length;
+    bool index = true;
+    // Streams to interleave the codes of a block over; 1 keeps one stream
+    std::size_t streams = 4;
+    // Let blocks reuse or delta-code the previous block's table when that
+    // comes out smaller than a table of their own
+    bool reuse_tables = true;
+    // Lets blocks use the dictionary's table when that comes out smaller;
+    // the container can then only be decoded with the same dictionary
+    const Dictionary* dictionary = nullptr;
+    // Let blocks code each letter with a table picked by the letter before
+    // it when that comes out smaller; costs time to build the tables
+    bool contexts = false;
+    // Let blocks code the input as 16-bit units or UTF-8 code points rather
+    // than bytes when that comes out smaller
+    Symbols::Kind symbols = Symbols::Kind::bytes;
+    // Let blocks go through the Burrows-Wheeler transform, move-to-front and
+    // zero runs before coding when that comes out smaller; costs time to
+    // sort the blocks and about 9 times the block size of memory per
+    // thread, see Transform::max_kept_block
+    bool sort_blocks = false;
+    // Let blocks code copies of earlier bytes as LZ77 matches when that
+    // comes out smaller, searching harder at higher levels up to
+    // Lz77::max_level; 0 keeps blocks to literals
+    std::uint8_t lz77 = 0;
+    // Store a checksum of every block, which decoding checks it against
+    bool checksums = true;
+    // Bytes to sample across the input for one table that codes every
+    // block, which then skips planning, table headers and the other modes;
+    // 0 gives every block its own. A stream samples its first block.
+    std::size_t sample = 0;
+};
+
+struct IndexEntry {
+    // Offset of the block's header from the start of the container
+    std::uint64_t compressed_offset;
+    std::uint64_t uncompressed_offset;
+    std::uint32_t size;
+};
+
+using Index = std::vector<IndexEntry>;
+
+// Time spent in each stage, summed over the threads that ran it
+struct Timings {
+    std::chrono::nanoseconds histogram{};
+    // Block-sorting, forward or inverse, and LZ77 match finding
+    std::chrono::nanoseconds transform{};
+    // Building tables when compressing, reading them when decompressing
+    std::chrono::nanoseconds tables{};
+    std::chrono::nanoseconds headers{};
+    std::chrono::nanoseconds coding{};
+    // Checksumming blocks, or checking them
+    std::chrono::nanoseconds checksum{};
+
+    Timings& operator+=(const Timings& other);
+};
+
+// Sizes are those of the uncompressed input and of the container, whichever
+// way it is coded
+struct Stats {
+    std::uint64_t input_size = 0;
+    std::uint64_t output_size = 0;
+    std::uint64_t blocks = 0;
+    // Size of the codes, and of an unbounded Huffman code for the same text
+    std::uint64_t code_bits = 0;
+    std::uint64_t optimal_bits = 0;
+    // The same over the blocks coded with a single Huffman table only, as
+    // the other modes code another text than the block's letters
+    std::uint64_t huffman_bits = 0;
+    std::uint64_t huffman_optimal_bits = 0;
+    // Shannon bound of every block's letters, which no code reaches below
+    double entropy_bits = 0;
+    // Size of the table headers
+    std::uint64_t header_size = 0;
+    // With a sampled table, the bits the blocks would have taken with
+    // tables of their own, headers included
+    std::uint64_t exact_bits = 0;
+    // Letters coded with each code length; stored blocks are left out
+    std::array<std::uint64_t, Huffman::max_code_length + 1> code_lengths{};
+    Timings timings;
+
+    Stats& operator+=(const Stats& other);
+};
+
+// Builds a dictionary from the letter counts of sample inputs. Letters the
+// samples lack get a code too, so the table can code any input.
+Dictionary train(const Huffman::CountTable& counts,
+                 std::uint8_t max_length = Huffman::max_code_length);
+
+// The table `compress` codes `input` with when `options.sample` is set,
+// built from the letters of the sample like a dictionary
+Huffman::CodeLengths sample_table(std::span<const character_type> input,
+                                  const Options& options);
+
+void write_dictionary(std::basic_ostream<character_type>& output,
+                      const Dictionary& dictionary);
+
+Dictionary read_dictionary(std::basic_istream<character_type>& input);
+
+// Appends the coded block, header included, to `output`. The block may
+// refer to `previous`, the table the decoder holds before it, which is
+// then replaced by the one it holds after it
+Stats compress_block(std::span<const character_type> block,
+                     std::vector<character_type>& output,
+                     const Options& options, Table& previous);
+
+// The table the decoder holds after a block, given the one before it;
+// reads only the block's table header
+Table next_table(BlockMode mode, TableMode table,
+                 std::span<const character_type> payload,
+                 const Table& previous,
+                 const Dictionary* dictionary = nullptr);
+
+// Throws if the decoded block does not match `checksum`, when given
+Stats decompress_block(BlockMode mode, TableMode table,
+                       std::span<const character_type> payload,
+                       std::span<character_type> block, const Table& previous,
+                       const Dictionary* dictionary = nullptr,
+                       std::optional<std::uint32_t> checksum = std::nullopt);
+
+// Blocks are coded on `options.threads` threads; the output does not
+// depend on their number
+Stats compress(std::basic_istream<character_type>& input,
+               std::basic_ostream<character_type>& output,
+               const Options& options);
+
+// Codes an input held in memory, such as a mapped file, without copying
+// its blocks
+Stats compress(std::span<const character_type> input,
+               std::basic_ostream<character_type>& output,
+               const Options& options);
+
+// Containers coded with a dictionary need the same `dictionary` to decode
+Stats decompress(std::basic_istream<character_type>& input,
+                 std::basic_ostream<character_type>& output,
+                 std::size_t threads = 1,
+                 const Dictionary* dictionary = nullptr);
+
+// Sums the block sizes of a container held in memory
+std::uint64_t decompressed_size(std::span<const character_type> input);
+
+// Decodes a container held in memory straight into `output`, which must be
+// exactly `decompressed_size(input)` bytes long
+Stats decompress(std::span<const character_type> input,
+                 std::span<character_type> output, std::size_t threads = 1,
+                 const Dictionary* dictionary = nullptr);
+
+// A block that failed to decode, or whose checksum did not match
+struct BadBlock {
+    // Offset of the block's header from the start of the container
+    std::uint64_t compressed_offset;
+    std::uint64_t uncompressed_offset;
+    std::uint32_t size;
+    std::string error;
+};
+
+struct Verification {
+    Stats stats;
+    // Whether the container holds checksums; without them only blocks that
+    // fail to decode are found
+    bool checksums = false;
+    std::vector<BadBlock> bad_blocks;
+};
+
+// Decodes every block on `threads` threads without writing it anywhere,
+// and lists the bad ones. Containers that are not well-formed past a bad
+// block, such as truncated ones, throw.
+Verification verify(std::basic_istream<character_type>& input,
+                    std::size_t threads = 1,
+                    const Dictionary* dictionary = nullptr);
+
+Verification verify(std::span<const character_type> input,
+                    std::size_t threads = 1,
+                    const Dictionary* dictionary = nullptr);
+
+// Reads the index of a seekable container; throws if it has none
+Index read_index(std::basic_istream<character_type>& input);
+
+// Decompresses `length` bytes starting at `offset`, decoding only the
+// blocks they span; the range is clipped to the end of the input
+void extract(std::basic_istream<character_type>& input,
+             std::basic_ostream<character_type>& output, std::uint64_t offset,
+             std::uint64_t length, std::size_t threads = 1,
+             const Dictionary* dictionary = nullptr);
+}  // namespace Container
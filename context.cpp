@@ -0,0 +1,164 @@
+#include "context.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <ios>
+#include <numeric>
+
+namespace {
+// Counts of the letters following each context
+using PairCounts =
+    std::vector<std::array<std::uint32_t, Huffman::alphabet_size>>;
+
+// Rounds of moving every context to the group that codes it cheapest
+constexpr int refinements = 4;
+}  // namespace
+
+// Letter counts of every group
+static std::vector<Huffman::CountTable> group_counts(
+    const PairCounts& pairs, const Context::GroupMap& groups,
+    std::size_t group_count) {
+    std::vector<Huffman::CountTable> counts(group_count);
+    for (std::size_t context = 0; context < pairs.size(); context++) {
+        auto& count = counts[groups[context]];
+        for (std::size_t letter = 0; letter < count.size(); letter++) {
+            count[letter] += pairs[context][letter];
+        }
+    }
+    return counts;
+}
+
+// Bits a letter costs with the statistics of `counts`, smoothed so that
+// letters they lack cost more rather than infinitely more
+static std::array<float, Huffman::alphabet_size> letter_costs(
+    const Huffman::CountTable& counts) {
+    const auto total =
+        std::accumulate(counts.begin(), counts.end(), std::uint64_t(0));
+    std::array<float, Huffman::alphabet_size> costs;
+    for (std::size_t letter = 0; letter < costs.size(); letter++) {
+        costs[letter] = static_cast<float>(
+            std::log2((total + 128.0) / (counts[letter] + 0.5)));
+    }
+    return costs;
+}
+
+Context::Model Context::build_model(std::span<const character_type> text,
+                                    std::uint8_t max_length) {
+    PairCounts pairs(Huffman::alphabet_size);
+    std::uint8_t previous = 0;
+    for (auto letter : text) {
+        const auto index = Huffman::symbol_index(letter);
+        ++pairs[previous][index];
+        previous = index;
+    }
+    std::array<std::uint64_t, Huffman::alphabet_size> totals;
+    std::vector<std::size_t> active;
+    for (std::size_t context = 0; context < pairs.size(); context++) {
+        totals[context] = std::accumulate(
+            pairs[context].begin(), pairs[context].end(), std::uint64_t(0));
+        if (totals[context] != 0) {
+            active.push_back(context);
+        }
+    }
+
+    // The busiest contexts seed the groups, then contexts move to whichever
+    // group codes them cheapest until the groups settle
+    Model model;
+    std::stable_sort(active.begin(), active.end(),
+                     [&totals](std::size_t first, std::size_t second) {
+                         return totals[first] > totals[second];
+                     });
+    auto group_count = std::max<std::size_t>(
+        std::min(active.size(), max_groups), 1);
+    for (std::size_t rank = 0; rank < active.size(); rank++) {
+        model.groups[active[rank]] =
+            static_cast<std::uint8_t>(std::min(rank, group_count - 1));
+    }
+    for (int round = 0; round < refinements && active.size() > max_groups;
+         round++) {
+        std::vector<std::array<float, Huffman::alphabet_size>> costs;
+        for (const auto& counts :
+             ::group_counts(pairs, model.groups, group_count)) {
+            costs.push_back(::letter_costs(counts));
+        }
+        for (auto context : active) {
+            float best = INFINITY;
+            for (std::size_t group = 0; group < group_count; group++) {
+                float cost = 0;
+                for (std::size_t letter = 0; letter < Huffman::alphabet_size;
+                     letter++) {
+                    cost += pairs[context][letter] * costs[group][letter];
+                }
+                if (cost < best) {
+                    best = cost;
+                    model.groups[context] = static_cast<std::uint8_t>(group);
+                }
+            }
+        }
+    }
+
+    // Groups left without contexts are dropped
+    std::array<std::uint8_t, max_groups> renumbered{};
+    std::array<bool, max_groups> used{};
+    for (auto context : active) {
+        used[model.groups[context]] = true;
+    }
+    std::size_t used_count = 0;
+    for (std::size_t group = 0; group < group_count; group++) {
+        renumbered[group] = static_cast<std::uint8_t>(used_count);
+        used_count += used[group];
+    }
+    for (auto& group : model.groups) {
+        group = renumbered[group];
+    }
+    group_count = std::max<std::size_t>(used_count, 1);
+
+    for (const auto& counts :
+         ::group_counts(pairs, model.groups, group_count)) {
+        auto lengths = Huffman::generate_code_lengths(counts, max_length);
+        model.code_bits += Huffman::encoded_size(counts, lengths);
+        for (std::size_t letter = 0; letter < counts.size(); letter++) {
+            model.code_lengths[lengths[letter]] += counts[letter];
+        }
+        model.tables.push_back(lengths);
+    }
+    return model;
+}
+
+// Bits the group of a context takes
+static std::uint8_t group_width(std::size_t group_count) {
+    return static_cast<std::uint8_t>(std::bit_width(group_count - 1));
+}
+
+void Context::serialize_model(BitStream::obitstream& output,
+                              const Model& model) {
+    output.put_bits(model.tables.size() - 1, 4);
+    if (const auto width = ::group_width(model.tables.size()); width != 0) {
+        for (auto group : model.groups) {
+            output.put_bits(group, width);
+        }
+    }
+    for (const auto& lengths : model.tables) {
+        Huffman::serialize_lengths(output, lengths);
+    }
+}
+
+Context::Model Context::deserialize_model(BitStream::ibitstream& input) {
+    Model model;
+    const std::size_t group_count = input.peek_bits(4) + 1;
+    input.consume(4);
+    if (const auto width = ::group_width(group_count); width != 0) {
+        for (auto& group : model.groups) {
+            group = static_cast<std::uint8_t>(input.peek_bits(width));
+            input.consume(width);
+            if (group >= group_count) {
+                throw std::ios::failure("Not a huf-compressed file!");
+            }
+        }
+    }
+    for (std::size_t group = 0; group < group_count; group++) {
+        model.tables.push_back(Huffman::deserialize_lengths(input));
+    }
+    return model;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "bitstream.hpp"
+#include "huffman.hpp"
+
+// Order-1 modelling: each letter is coded with a table picked by the letter
+// before it, its context. Contexts with similar statistics share a group,
+// and so a table, which bounds what the tables cost to store.
+namespace Context {
+
+using character_type = Huffman::character_type;
+
+constexpr std::size_t max_groups = 16;
+
+// Group of the table coding the letters that follow each letter
+using GroupMap = std::array<std::uint8_t, Huffman::alphabet_size>;
+
+struct Model {
+    GroupMap groups{};
+    std::vector<Huffman::CodeLengths> tables;
+    // Size of the codes in bits, and letters coded with each code length;
+    // left empty by deserialize_model
+    std::uint64_t code_bits = 0;
+    std::array<std::uint64_t, Huffman::max_code_length + 1> code_lengths{};
+};
+
+// Clusters the contexts of `text`, the first letter being taken to follow
+// letter 0, into at most `max_groups` groups and builds a table per group
+Model build_model(std::span<const character_type> text,
+                  std::uint8_t max_length = Huffman::max_code_length);
+
+// Writes the group count less one in 4 bits, the group of every context in
+// just enough bits, then every group's table as written by
+// Huffman::serialize_lengths
+void serialize_model(BitStream::obitstream& output, const Model& model);
+
+Model deserialize_model(BitStream::ibitstream& input);
+
+// The tables of every context, pointing into `tables`, which holds one
+// table per group
+template <typename Table>
+std::array<const Table*, Huffman::alphabet_size> by_context(
+    const Model& model, const std::vector<Table>& tables) {
+    std::array<const Table*, Huffman::alphabet_size> contexts;
+    for (std::size_t context = 0; context < contexts.size(); context++) {
+        contexts[context] = &tables[model.groups[context]];
+    }
+    return contexts;
+}
+}  // namespace Context
@@ -0,0 +1,123 @@
+#include "histogram.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+// Consecutive bytes go to different tables so that repeated letters do not
+// wait on each other's increments
+constexpr std::size_t tables = 4;
+// Keeps every 32-bit table counter below overflow
+constexpr std::size_t max_segment = std::size_t(1) << 32;
+
+using SubTables =
+    std::array<std::array<std::uint32_t, Histogram::alphabet_size>, tables>;
+
+void count_segment(const Histogram::character_type* text, std::size_t size,
+                   SubTables& counts) {
+    std::size_t position = 0;
+    for (; position + 8 <= size; position += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, text + position, sizeof(word));
+        ++counts[0][word & 0xFF];
+        ++counts[1][word >> 8 & 0xFF];
+        ++counts[2][word >> 16 & 0xFF];
+        ++counts[3][word >> 24 & 0xFF];
+        ++counts[0][word >> 32 & 0xFF];
+        ++counts[1][word >> 40 & 0xFF];
+        ++counts[2][word >> 48 & 0xFF];
+        ++counts[3][word >> 56];
+    }
+    for (; position < size; position++) {
+        ++counts[0][static_cast<std::uint8_t>(text[position])];
+    }
+}
+}  // namespace
+
+Histogram::CountTable Histogram::count(std::span<const character_type> text) {
+    CountTable counts{};
+    SubTables sub_counts;
+    for (std::size_t begin = 0; begin < text.size(); begin += max_segment) {
+        for (auto& table : sub_counts) {
+            table.fill(0);
+        }
+        ::count_segment(text.data() + begin,
+                        std::min(max_segment, text.size() - begin),
+                        sub_counts);
+        for (const auto& table : sub_counts) {
+            for (std::size_t letter = 0; letter < alphabet_size; letter++) {
+                counts[letter] += table[letter];
+            }
+        }
+    }
+    return counts;
+}
+
+Histogram::CountTable Histogram::count(std::span<const character_type> text,
+                                       std::size_t threads) {
+    threads = std::clamp<std::size_t>(text.size() / min_thread_share, 1,
+                                      std::max<std::size_t>(threads, 1));
+    if (threads == 1) {
+        return count(text);
+    }
+    std::vector<CountTable> partial(threads);
+    {
+        std::vector<std::jthread> workers;
+        const auto share = text.size() / threads;
+        for (std::size_t i = 0; i < threads; i++) {
+            const auto slice =
+                i + 1 == threads ? text.subspan(i * share)
+                                 : text.subspan(i * share, share);
+            workers.emplace_back(
+                [slice, &counts = partial[i]] { counts = count(slice); });
+        }
+    }
+    for (std::size_t i = 1; i < threads; i++) {
+        merge(partial[0], partial[i]);
+    }
+    return partial[0];
+}
+
+Histogram::CountTable Histogram::count(
+    std::basic_istream<character_type>& input, std::size_t threads) {
+    CountTable counts{};
+    std::vector<character_type> buffer(
+        std::max<std::size_t>(threads * min_thread_share, 1 << 20));
+    while (input.read(buffer.data(), buffer.size()) || input.gcount() > 0) {
+        merge(counts,
+              count(std::span(buffer.data(), input.gcount()), threads));
+    }
+    return counts;
+}
+
+Histogram::CountTable Histogram::sample(std::span<const character_type> text,
+                                        std::size_t bytes) {
+    if (bytes >= text.size()) {
+        return count(text);
+    }
+    const auto slices = std::max<std::size_t>(
+        (bytes + sample_slice - 1) / sample_slice, 1);
+    const auto slice = bytes / slices;
+    const auto stride = text.size() / slices;
+    CountTable counts{};
+    for (std::size_t i = 0; i < slices; i++) {
+        merge(counts, count(text.subspan(i * stride, slice)));
+    }
+    return counts;
+}
+
+void Histogram::merge(CountTable& into, const CountTable& from) {
+    for (std::size_t letter = 0; letter < alphabet_size; letter++) {
+        into[letter] += from[letter];
+    }
+}
+
+std::uint64_t Histogram::total(const CountTable& counts) {
+    std::uint64_t sum = 0;
+    for (auto count : counts) {
+        sum += count;
+    }
+    return sum;
+}
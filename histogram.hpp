@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <span>
+
+#include "bitstream.hpp"
+
+namespace Histogram {
+
+using character_type = BitStream::character_type;
+
+constexpr std::size_t alphabet_size = 256;
+
+// Occurrences of every letter, indexed by its unsigned value
+using CountTable = std::array<std::uint64_t, alphabet_size>;
+
+// Inputs shorter than this per extra thread are counted on the calling
+// thread
+constexpr std::size_t min_thread_share = 1 << 22;
+
+CountTable count(std::span<const character_type> text);
+
+// Splits `text` into contiguous slices counted by up to `threads` threads
+CountTable count(std::span<const character_type> text, std::size_t threads);
+
+// Reads `input` in chunks large enough to keep `threads` threads busy
+CountTable count(std::basic_istream<character_type>& input,
+                 std::size_t threads = 1);
+
+// Slices that `sample` counts are at most this long, so that even a small
+// sample spreads over the whole text
+constexpr std::size_t sample_slice = 1 << 16;
+
+// Counts about `bytes` letters of `text` in slices spread evenly across it,
+// or all of it if it is no longer
+CountTable sample(std::span<const character_type> text, std::size_t bytes);
+
+void merge(CountTable& into, const CountTable& from);
+
+std::uint64_t total(const CountTable& counts);
+}  // namespace Histogram
@@ -1,24 +1,266 @@
 #include "huffman.hpp"
 
+#include <bit>
+#include <deque>
+#include <stdexcept>
+
+[[noreturn]] static void invalid_file() {
+    throw std::ios::failure("Not a huf-compressed file!");
+}
+
 static void check_invalid_file(BitStream::ibitstream& input) {
     if (input) {
         return;
     }
-    throw std::ios::failure("Not a huf-compressed file!");
+    ::invalid_file();
+}
+
+static std::size_t count_letters(const Huffman::CodeLengths& lengths) {
+    return Canonical::count_codes(lengths);
+}
+
+static Huffman::character_type first_letter(
+    const Huffman::CodeLengths& lengths) {
+    const auto it = std::find_if(lengths.begin(), lengths.end(),
+                                 [](auto length) { return length != 0; });
+    return static_cast<Huffman::character_type>(it - lengths.begin());
+}
+
+Huffman::CodeLengths Huffman::generate_code_lengths(const HuffmanTree& tree) {
+    CodeLengths lengths{};
+    if (tree.nodes.empty()) {
+        return lengths;
+    }
+    // Children come after their parent, so one pass hands out every depth
+    std::vector<std::uint16_t> depths(tree.nodes.size());
+    for (std::size_t index = 0; index < tree.nodes.size(); index++) {
+        const auto& node = tree.nodes[index];
+        if (!node.is_leaf()) {
+            depths[node.left] = depths[node.right] = depths[index] + 1;
+            continue;
+        }
+        if (depths[index] > max_code_length) {
+            throw std::length_error("Huffman code is too long");
+        }
+        lengths[symbol_index(node.letter)] =
+            std::max<std::uint8_t>(depths[index], 1);
+    }
+    return lengths;
+}
+
+Huffman::HuffmanTree Huffman::generate_canonical_tree(
+    const CodeLengths& lengths) {
+    const auto letters = ::count_letters(lengths);
+    if (letters == 1) {
+        return HuffmanTree(::first_letter(lengths));
+    }
+    HuffmanTree tree;
+    auto& nodes = tree.nodes;
+    nodes.reserve(std::max<std::size_t>(2 * letters, 1) - 1);
+    nodes.emplace_back();
+    Canonical::for_each_code(lengths, [&nodes](std::size_t letter,
+                                               std::uint64_t code,
+                                               std::uint8_t length) {
+        HuffmanTree::Index node = 0;
+        while (length-- > 0) {
+            const auto child = (code >> length & 1) ? &HuffmanTree::Node::right
+                                                    : &HuffmanTree::Node::left;
+            if (nodes[node].*child == 0) {
+                nodes[node].*child =
+                    static_cast<HuffmanTree::Index>(nodes.size());
+                nodes.emplace_back();
+            }
+            node = nodes[node].*child;
+        }
+        nodes[node].letter = static_cast<character_type>(letter);
+    });
+    return tree;
+}
+
+Huffman::HuffmanTree Huffman::generate_mapping(const CountTable& counts) {
+    std::vector<character_type> leaves;
+    for (std::size_t index = 0; index < counts.size(); index++) {
+        if (counts[index] != 0) {
+            leaves.push_back(static_cast<character_type>(index));
+        }
+    }
+    std::stable_sort(leaves.begin(), leaves.end(),
+                     [&counts](character_type first, character_type second) {
+                         return counts[symbol_index(first)] <
+                                counts[symbol_index(second)];
+                     });
+    CodeLengths lengths{};
+    if (leaves.size() <= 1) {
+        for (auto letter : leaves) {
+            lengths[symbol_index(letter)] = 1;
+        }
+        return generate_canonical_tree(lengths);
+    }
+
+    // Two queues: the sorted leaves, numbered first, and the merged nodes,
+    // which are made in order of weight. The two lightest nodes are always
+    // at their fronts, so merging takes linear time.
+    const auto size = leaves.size();
+    std::vector<std::uint64_t> weights(2 * size - 1);
+    std::vector<std::uint16_t> parents(2 * size - 1);
+    for (std::size_t index = 0; index < size; index++) {
+        weights[index] = counts[symbol_index(leaves[index])];
+    }
+    std::size_t next_leaf = 0;
+    std::size_t next_merged = size;
+    std::size_t merged = size;
+    auto lightest = [&] {
+        return next_leaf < size && (next_merged == merged ||
+                                    weights[next_leaf] <= weights[next_merged])
+                   ? next_leaf++
+                   : next_merged++;
+    };
+    for (; merged < weights.size(); merged++) {
+        const auto first = lightest();
+        const auto second = lightest();
+        weights[merged] = weights[first] + weights[second];
+        parents[first] = parents[second] = static_cast<std::uint16_t>(merged);
+    }
+
+    // Parents come after their children, so walking back from the root
+    // hands out every depth
+    std::vector<std::uint16_t> depths(weights.size());
+    for (auto index = weights.size() - 1; index-- > 0;) {
+        depths[index] = depths[parents[index]] + 1;
+    }
+    for (std::size_t index = 0; index < size; index++) {
+        if (depths[index] > max_code_length) {
+            throw std::length_error("Huffman code is too long");
+        }
+        lengths[symbol_index(leaves[index])] =
+            static_cast<std::uint8_t>(depths[index]);
+    }
+    return generate_canonical_tree(lengths);
+}
+
+Huffman::HuffmanTree Huffman::generate_mapping(const CountTable& counts,
+                                               std::uint8_t max_length) {
+    return generate_canonical_tree(generate_code_lengths(counts, max_length));
+}
+
+Huffman::CodeLengths Huffman::generate_code_lengths(const CountTable& counts,
+                                                   std::uint8_t max_length) {
+    const auto wide = generate_code_lengths(std::span(counts), max_length);
+    CodeLengths lengths;
+    std::copy(wide.begin(), wide.end(), lengths.begin());
+    return lengths;
+}
+
+std::vector<std::uint8_t> Huffman::generate_code_lengths(
+    std::span<const std::uint64_t> counts, std::uint8_t max_length) {
+    struct Item {
+        std::uint64_t weight;
+        // Letter of a leaf, or -1 for a package of two items of the
+        // previous level
+        std::int32_t letter;
+    };
+    std::vector<Item> leaves;
+    for (std::size_t index = 0; index < counts.size(); index++) {
+        if (counts[index] != 0) {
+            leaves.push_back(Item{counts[index], std::int32_t(index)});
+        }
+    }
+    std::vector<std::uint8_t> lengths(counts.size());
+    if (leaves.size() <= 1) {
+        for (auto leaf : leaves) {
+            lengths[leaf.letter] = 1;
+        }
+        return lengths;
+    }
+    if (max_length > max_code_length ||
+        leaves.size() > std::uint64_t(1) << max_length) {
+        throw std::invalid_argument("Maximum code length is out of range");
+    }
+    std::stable_sort(leaves.begin(), leaves.end(),
+                     [](const Item& a, const Item& b) {
+                         return a.weight < b.weight;
+                     });
+
+    // Level `i` merges the leaves with the packages of level `i - 1`
+    std::vector<std::vector<Item>> levels(max_length);
+    levels[0] = leaves;
+    for (std::size_t level = 1; level < max_length; level++) {
+        const auto& previous = levels[level - 1];
+        auto& merged = levels[level];
+        merged.reserve(leaves.size() + previous.size() / 2);
+        auto leaf = leaves.begin();
+        for (std::size_t i = 0; i + 1 < previous.size(); i += 2) {
+            const auto weight = previous[i].weight + previous[i + 1].weight;
+            for (; leaf != leaves.end() && leaf->weight <= weight; ++leaf) {
+                merged.push_back(*leaf);
+            }
+            merged.push_back(Item{weight, -1});
+        }
+        merged.insert(merged.end(), leaf, leaves.end());
+    }
+
+    // The cheapest 2n - 2 items of the last level make up the code; every
+    // level they reach through packages adds one bit to their leaves
+    std::size_t selected = 2 * leaves.size() - 2;
+    for (auto level = levels.rbegin(); level != levels.rend(); ++level) {
+        std::size_t packages = 0;
+        for (std::size_t i = 0; i < selected; i++) {
+            const auto letter = (*level)[i].letter;
+            if (letter < 0) {
+                ++packages;
+            } else {
+                ++lengths[letter];
+            }
+        }
+        selected = 2 * packages;
+    }
+    return lengths;
+}
+
+std::uint64_t Huffman::encoded_size(const CountTable& counts,
+                                    const CodeLengths& lengths) {
+    std::uint64_t size = 0;
+    const bool lone_letter = ::count_letters(lengths) == 1;
+    for (std::size_t index = 0; index < counts.size(); index++) {
+        size += counts[index] * (lone_letter ? 0 : lengths[index]);
+    }
+    return size;
+}
+
+std::uint64_t Huffman::optimal_encoded_size(const CountTable& counts) {
+    // Every merge of two subtrees pushes all of their letters one bit deeper
+    std::vector<std::uint64_t> weights;
+    for (auto count : counts) {
+        if (count != 0) {
+            weights.push_back(count);
+        }
+    }
+    std::make_heap(weights.begin(), weights.end(), std::greater<>());
+    std::uint64_t size = 0;
+    while (weights.size() > 1) {
+        std::pop_heap(weights.begin(), weights.end(), std::greater<>());
+        const auto smallest = weights.back();
+        weights.pop_back();
+        std::pop_heap(weights.begin(), weights.end(), std::greater<>());
+        weights.back() += smallest;
+        size += weights.back();
+        std::push_heap(weights.begin(), weights.end(), std::greater<>());
+    }
+    return size;
 }
 
 static void generate_inverse_mapping(
-    const Huffman::HuffmanTree& tree,
+    const Huffman::HuffmanTree& tree, const Huffman::HuffmanTree::Node& node,
     std::unordered_map<Huffman::character_type, std::vector<bool>>& table,
     std::vector<bool>& encoding) {
-    if (tree.left == nullptr) {
-        table.insert_or_assign(tree.letter, encoding);
+    if (node.is_leaf()) {
+        table.insert_or_assign(node.letter, encoding);
         return;
     }
     encoding.push_back(0);
-    generate_inverse_mapping(*tree.left, table, encoding);
+    generate_inverse_mapping(tree, tree.left(node), table, encoding);
     encoding.back() = 1;
-    generate_inverse_mapping(*tree.right, table, encoding);
+    generate_inverse_mapping(tree, tree.right(node), table, encoding);
     encoding.pop_back();
 }
 
@@ -26,20 +268,49 @@ std::unordered_map<Huffman::character_type, std::vector<bool>>
 Huffman::generate_inverse_mapping(const HuffmanTree& tree) {
     std::unordered_map<character_type, std::vector<bool>> table;
     std::vector<bool> encoding;
-    ::generate_inverse_mapping(tree, table, encoding);
+    if (!tree.nodes.empty()) {
+        ::generate_inverse_mapping(tree, tree.root(), table, encoding);
+    }
     return table;
 }
 
+void Huffman::serialize_lengths(BitStream::obitstream& output,
+                                const CodeLengths& lengths) {
+    const auto width = static_cast<std::uint8_t>(
+        std::bit_width(*std::max_element(lengths.begin(), lengths.end())));
+    output.put_bits(width, 3);
+    for (std::size_t begin = 0, end; begin < lengths.size(); begin = end) {
+        end = begin + 1;
+        while (end < lengths.size() && lengths[end] == lengths[begin]) {
+            ++end;
+        }
+        output.put_bits(lengths[begin], width);
+        Canonical::serialize_gamma(output, end - begin);
+    }
+}
+
+void Huffman::serialize_length_deltas(BitStream::obitstream& output,
+                                      const CodeLengths& previous,
+                                      const CodeLengths& lengths) {
+    const auto delta = [&](std::size_t index) {
+        return static_cast<int>(lengths[index]) - previous[index];
+    };
+    for (std::size_t begin = 0, end; begin < lengths.size(); begin = end) {
+        end = begin + 1;
+        while (end < lengths.size() && delta(end) == delta(begin)) {
+            ++end;
+        }
+        const auto difference = delta(begin);
+        const auto zigzag =
+            difference < 0 ? -2 * difference - 1 : 2 * difference;
+        Canonical::serialize_gamma(output, zigzag + 1);
+        Canonical::serialize_gamma(output, end - begin);
+    }
+}
+
 void Huffman::serialize_tree(BitStream::obitstream& output,
                              const HuffmanTree& tree) {
-    if (tree.left == nullptr) {
-        output.write(1);
-        output.write_unit(static_cast<uint8_t>(tree.letter));
-        return;
-    }
-    output.write(0);
-    serialize_tree(output, *tree.left);
-    serialize_tree(output, *tree.right);
+    serialize_lengths(output, generate_code_lengths(tree));
 }
 
 static void serialize_letter(
@@ -61,36 +332,304 @@ void Huffman::serialize_text(
     ::serialize_letter(output, encode, EOF);
 }
 
-Huffman::HuffmanTree Huffman::deserialize_tree(BitStream::ibitstream& input) {
-    bool bit;
-    input >> bit;
+Huffman::EncodeTable Huffman::generate_encode_table(const CodeLengths& lengths,
+                                                   bool pairs) {
+    using PairCode = EncodeTable::PairCode;
+    EncodeTable table;
+    table.codes.fill(EncodeTable::Code{0, 0});
+    if (::count_letters(lengths) > 1) {
+        Canonical::for_each_code(lengths, [&table](std::size_t letter,
+                                                   std::uint64_t code,
+                                                   std::uint8_t length) {
+            table.codes[letter] = {code, length};
+        });
+    }
+    if (!pairs) {
+        return table;
+    }
+    table.pairs.resize(alphabet_size * alphabet_size);
+    for (std::size_t first = 0; first < alphabet_size; first++) {
+        const auto [first_code, first_length] = table.codes[first];
+        for (std::size_t second = 0; second < alphabet_size; second++) {
+            const auto [second_code, second_length] = table.codes[second];
+            auto& pair = table.pairs[first << 8 | second];
+            if (first_length + second_length > 32) {
+                pair = PairCode{0, PairCode::no_pair};
+                continue;
+            }
+            pair = PairCode{static_cast<std::uint32_t>(
+                                first_code << second_length | second_code),
+                            static_cast<std::uint8_t>(first_length +
+                                                      second_length)};
+        }
+    }
+    return table;
+}
+
+Huffman::EncodeTable Huffman::generate_encode_table(const HuffmanTree& tree,
+                                                   bool pairs) {
+    return generate_encode_table(generate_code_lengths(tree), pairs);
+}
+
+namespace {
+// Packs codes into a register and hands them to the stream once no more fit
+class CodePacker {
+   public:
+    explicit CodePacker(BitStream::obitstream& output) : output(output) {}
+    ~CodePacker() { output.put_bits(pending, bits); }
+
+    void put(std::uint64_t code, std::uint8_t length) {
+        if (bits + length > BitStream::obitstream::max_put) {
+            output.put_bits(pending, bits);
+            pending = 0;
+            bits = 0;
+        }
+        pending = pending << length | code;
+        bits += length;
+    }
+
+   private:
+    BitStream::obitstream& output;
+    std::uint64_t pending = 0;
+    std::uint8_t bits = 0;
+};
+}  // namespace
+
+void Huffman::serialize_text(std::span<const character_type> text,
+                             BitStream::obitstream& output,
+                             const EncodeTable& encode) {
+    using PairCode = EncodeTable::PairCode;
+    CodePacker packer(output);
+    auto put_letter = [&encode, &packer](character_type letter) {
+        const auto [code, length] = encode.codes[symbol_index(letter)];
+        packer.put(code, length);
+    };
+    std::size_t position = 0;
+    if (!encode.pairs.empty()) {
+        for (; position + 1 < text.size(); position += 2) {
+            const auto pair = encode.pairs[symbol_index(text[position]) << 8 |
+                                           symbol_index(text[position + 1])];
+            if (pair.length == PairCode::no_pair) {
+                put_letter(text[position]);
+                put_letter(text[position + 1]);
+                continue;
+            }
+            packer.put(pair.code, pair.length);
+        }
+    }
+    for (; position < text.size(); position++) {
+        put_letter(text[position]);
+    }
+}
+
+void Huffman::serialize_text(std::basic_istream<character_type>& input,
+                             BitStream::obitstream& output,
+                             const EncodeTable& encode) {
+    std::vector<character_type> buffer(BitStream::chunk_size);
+    while (input.read(buffer.data(), buffer.size()) || input.gcount() > 0) {
+        serialize_text(std::span(buffer.data(), input.gcount()), output,
+                       encode);
+    }
+    const auto [code, length] =
+        encode.codes[symbol_index(static_cast<character_type>(EOF))];
+    output.put_bits(code, length);
+}
+
+void Huffman::serialize_interleaved(std::span<const character_type> text,
+                                    std::span<BitStream::obitstream> outputs,
+                                    const EncodeTable& encode) {
+    const auto streams = outputs.size();
+    std::deque<CodePacker> packers;
+    for (auto& output : outputs) {
+        packers.emplace_back(output);
+    }
+    for (std::size_t position = 0; position < text.size(); position++) {
+        const auto [code, length] = encode.codes[symbol_index(text[position])];
+        packers[position % streams].put(code, length);
+    }
+}
+
+void Huffman::serialize_text(std::span<const character_type> text,
+                             BitStream::obitstream& output,
+                             const ContextEncode& encode) {
+    CodePacker packer(output);
+    std::uint8_t previous = 0;
+    for (auto letter : text) {
+        const auto index = symbol_index(letter);
+        const auto [code, length] = encode[previous]->codes[index];
+        packer.put(code, length);
+        previous = index;
+    }
+}
+
+// Runs and differences never take more than the alphabet's width
+static std::size_t deserialize_gamma(BitStream::ibitstream& input) {
+    constexpr auto max_width = std::bit_width(Huffman::alphabet_size);
+    return Canonical::deserialize_gamma(input, max_width);
+}
+
+static void check_lengths(const Huffman::CodeLengths& lengths) {
+    if (::count_letters(lengths) == 0 || !Canonical::is_complete(lengths)) {
+        ::invalid_file();
+    }
+}
+
+Huffman::CodeLengths Huffman::deserialize_lengths(
+    BitStream::ibitstream& input) {
+    const auto width = static_cast<std::uint8_t>(input.peek_bits(3));
+    input.consume(3);
     ::check_invalid_file(input);
-    HuffmanTree node;
-    if (bit) {
-        node.letter = input.read_unit();
+    if (width == 0) {
+        ::invalid_file();
+    }
+    CodeLengths lengths;
+    for (std::size_t begin = 0; begin < lengths.size();) {
+        const auto length = static_cast<std::uint8_t>(input.peek_bits(width));
+        input.consume(width);
+        const auto run = ::deserialize_gamma(input);
         ::check_invalid_file(input);
-    } else {
-        node.left = std::make_unique<HuffmanTree>(deserialize_tree(input));
-        node.right = std::make_unique<HuffmanTree>(deserialize_tree(input));
+        if (length > max_code_length || run > lengths.size() - begin) {
+            ::invalid_file();
+        }
+        std::fill_n(lengths.begin() + begin, run, length);
+        begin += run;
     }
-    return node;
+    ::check_lengths(lengths);
+    return lengths;
+}
+
+Huffman::CodeLengths Huffman::deserialize_length_deltas(
+    BitStream::ibitstream& input, const CodeLengths& previous) {
+    CodeLengths lengths;
+    for (std::size_t begin = 0; begin < lengths.size();) {
+        const auto zigzag = static_cast<int>(::deserialize_gamma(input)) - 1;
+        const auto run = ::deserialize_gamma(input);
+        ::check_invalid_file(input);
+        if (run > lengths.size() - begin) {
+            ::invalid_file();
+        }
+        const auto difference = zigzag % 2 ? -(zigzag + 1) / 2 : zigzag / 2;
+        for (auto end = begin + run; begin < end; begin++) {
+            const auto length = previous[begin] + difference;
+            if (length < 0 || length > max_code_length) {
+                ::invalid_file();
+            }
+            lengths[begin] = length;
+        }
+    }
+    ::check_lengths(lengths);
+    return lengths;
+}
+
+Huffman::HuffmanTree Huffman::deserialize_tree(BitStream::ibitstream& input) {
+    return generate_canonical_tree(deserialize_lengths(input));
+}
+
+Huffman::DecodeTable Huffman::generate_decode_table(
+    const CodeLengths& lengths) {
+    return Canonical::generate_decode_table<character_type, alphabet_size>(
+        lengths);
+}
+
+Huffman::DecodeTable Huffman::generate_decode_table(const HuffmanTree& tree) {
+    return generate_decode_table(generate_code_lengths(tree));
+}
+
+static inline Huffman::character_type deserialize_letter(
+    BitStream::ibitstream& input, const Huffman::DecodeTable& decode) {
+    return Canonical::decode(input, decode);
+}
+
+Huffman::character_type Huffman::deserialize_letter(
+    BitStream::ibitstream& input, const DecodeTable& decode) {
+    return ::deserialize_letter(input, decode);
 }
 
 void Huffman::deserialize_text(BitStream::ibitstream& input,
                                std::basic_ostream<character_type>& output,
-                               const HuffmanTree& decode) {
+                               const DecodeTable& decode) {
+    constexpr std::size_t buffer_size = 1 << 16;
+    std::vector<character_type> buffer;
+    buffer.reserve(buffer_size);
     while (true) {
-        HuffmanTree const* node = &decode;
-        bool bit;
-        while (node->left != nullptr && (input >> bit)) {
-            node = bit ? node->right.get() : node->left.get();
+        const auto letter = ::deserialize_letter(input, decode);
+        ::check_invalid_file(input);
+        if (letter == static_cast<character_type>(EOF)) {
+            break;
         }
-        if (node->left != nullptr) {
-            ::check_invalid_file(input);
+        buffer.push_back(letter);
+        if (buffer.size() == buffer_size) {
+            output.write(buffer.data(), buffer.size());
+            buffer.clear();
         }
-        if (node->letter == static_cast<character_type>(EOF)) {
-            break;
+    }
+    output.write(buffer.data(), buffer.size());
+}
+
+void Huffman::deserialize_text(BitStream::ibitstream& input,
+                               std::span<character_type> text,
+                               const DecodeTable& decode) {
+    // Running past the end only yields padding, so checking once suffices
+    for (auto& letter : text) {
+        letter = ::deserialize_letter(input, decode);
+    }
+    ::check_invalid_file(input);
+}
+
+void Huffman::deserialize_text(BitStream::ibitstream& input,
+                               std::span<character_type> text,
+                               const ContextDecode& decode) {
+    std::uint8_t previous = 0;
+    for (auto& letter : text) {
+        letter = ::deserialize_letter(input, *decode[previous]);
+        previous = symbol_index(letter);
+    }
+    ::check_invalid_file(input);
+}
+
+// Advances `Streams` independent streams per iteration, so the lookups of
+// one stream overlap with those of the others
+template <std::size_t Streams>
+static std::size_t deserialize_interleaved(
+    std::span<BitStream::ibitstream> inputs,
+    std::span<Huffman::character_type> text,
+    const Huffman::DecodeTable& decode) {
+    std::size_t position = 0;
+    for (; position + Streams <= text.size(); position += Streams) {
+        for (std::size_t stream = 0; stream < Streams; stream++) {
+            text[position + stream] =
+                ::deserialize_letter(inputs[stream], decode);
         }
-        output << node->letter;
     }
+    return position;
+}
+
+void Huffman::deserialize_interleaved(std::span<BitStream::ibitstream> inputs,
+                                      std::span<character_type> text,
+                                      const DecodeTable& decode) {
+    std::size_t position = 0;
+    switch (inputs.size()) {
+        case 2:
+            position = ::deserialize_interleaved<2>(inputs, text, decode);
+            break;
+        case 4:
+            position = ::deserialize_interleaved<4>(inputs, text, decode);
+            break;
+        case 8:
+            position = ::deserialize_interleaved<8>(inputs, text, decode);
+            break;
+    }
+    for (; position < text.size(); position++) {
+        text[position] =
+            ::deserialize_letter(inputs[position % inputs.size()], decode);
+    }
+    for (auto& input : inputs) {
+        ::check_invalid_file(input);
+    }
+}
+
+void Huffman::deserialize_text(BitStream::ibitstream& input,
+                               std::basic_ostream<character_type>& output,
+                               const HuffmanTree& decode) {
+    deserialize_text(input, output, generate_decode_table(decode));
 }
@@ -1,10 +1,10 @@
 #pragma once
 
 #include <algorithm>
-#include <compare>
+#include <array>
 #include <cstdint>
 #include <iostream>
-#include <memory>
+#include <span>
 #include <sstream>
 #include <stack>
 #include <string>
@@ -14,89 +14,220 @@
 #include <vector>
 
 #include "bitstream.hpp"
+#include "canonical.hpp"
+#include "histogram.hpp"
 
 namespace Huffman {
 
 using character_type = BitStream::character_type;
 
+// Code tree held in a single array, where nodes refer to their children by
+// index: a tree is one allocation however many letters it codes, and
+// walking it stays within one buffer. Children come after their parent.
 struct HuffmanTree {
-    std::unique_ptr<HuffmanTree> left;
-    std::unique_ptr<HuffmanTree> right;
-    character_type letter;
-
-    HuffmanTree() : left(nullptr), right(nullptr) {}
-    HuffmanTree(character_type letter)
-        : left(nullptr), right(nullptr), letter(letter) {}
-
-    HuffmanTree(HuffmanTree&& left, HuffmanTree&& right)
-        : left(std::make_unique<HuffmanTree>(std::move(left))),
-          right(std::make_unique<HuffmanTree>(std::move(right))) {}
-    HuffmanTree(std::unique_ptr<HuffmanTree> left,
-                std::unique_ptr<HuffmanTree> right)
-        : left(left.release()), right(right.release()) {}
-
-    HuffmanTree(character_type letter, HuffmanTree&& left, HuffmanTree&& right)
-        : left(std::make_unique<HuffmanTree>(std::move(left))),
-          right(std::make_unique<HuffmanTree>(std::move(right))),
-          letter(letter) {}
-    HuffmanTree(character_type letter, std::unique_ptr<HuffmanTree> left,
-                std::unique_ptr<HuffmanTree> right)
-        : left(left.release()), right(right.release()), letter(letter) {}
-
-    ~HuffmanTree() = default;
-
-    HuffmanTree(const HuffmanTree&) = delete;
-    HuffmanTree(HuffmanTree&&) = default;
-
-    HuffmanTree& operator=(const HuffmanTree&) = delete;
-    HuffmanTree& operator=(HuffmanTree&&) = default;
-
-    std::weak_ordering operator<=>(const HuffmanTree& other) const {
-        return letter <=> other.letter;
-    }
+    using Index = std::uint16_t;
+
+    struct Node {
+        // The root is nobody's child, so index 0 marks a leaf
+        Index left = 0;
+        Index right = 0;
+        character_type letter = 0;
+
+        bool is_leaf() const { return left == 0; }
+    };
+
+    // The root comes first
+    std::vector<Node> nodes;
+
+    HuffmanTree() = default;
+    explicit HuffmanTree(character_type letter) : nodes{Node{0, 0, letter}} {}
+
+    const Node& root() const { return nodes.front(); }
+    const Node& left(const Node& node) const { return nodes[node.left]; }
+    const Node& right(const Node& node) const { return nodes[node.right]; }
 };
 
+constexpr std::size_t alphabet_size = Histogram::alphabet_size;
+// Longest code the header and the decoders accept
+constexpr std::uint8_t max_code_length = Canonical::max_code_length;
+
+// Code length of every letter, indexed by its unsigned value; 0 marks a
+// letter that does not occur. A lone letter is stored with length 1 but is
+// coded with no bits at all.
+using CodeLengths = std::array<std::uint8_t, alphabet_size>;
+
+inline std::uint8_t symbol_index(character_type letter) {
+    return static_cast<std::uint8_t>(letter);
+}
+
+CodeLengths generate_code_lengths(const HuffmanTree& tree);
+
+// Builds the canonical tree for `lengths`: codes of equal length are
+// consecutive and ordered by letter, and shorter codes precede longer ones
+HuffmanTree generate_canonical_tree(const CodeLengths& lengths);
+
+using CountTable = Histogram::CountTable;
+
 template <typename U>
     requires std::is_integral_v<U> && std::is_unsigned_v<U>
-HuffmanTree generate_mapping(
+CountTable to_count_table(
     const std::unordered_map<character_type, U>& count_table) {
-    using Node = std::pair<U, HuffmanTree>;
-    std::vector<Node> trees;
-    trees.reserve(count_table.size());
+    CountTable counts{};
     for (auto& [letter, count] : count_table) {
-        trees.emplace_back(count, HuffmanTree(letter));
+        counts[symbol_index(letter)] = count;
     }
-    std::make_heap(trees.begin(), trees.end(), std::greater<Node>());
+    return counts;
+}
 
-    while (trees.size() > 1) {
-        std::pop_heap(trees.begin(), trees.end(), std::greater<Node>());
-        auto smallest = std::move(trees.back());
-        trees.pop_back();
+// Optimal code lengths no longer than `max_length` bits, found with the
+// package-merge algorithm
+CodeLengths generate_code_lengths(const CountTable& counts,
+                                  std::uint8_t max_length);
 
-        std::pop_heap(trees.begin(), trees.end(), std::greater<Node>());
-        auto larger = std::move(trees.back());
+// The same for alphabets of any size, such as the symbols of Symbols
+std::vector<std::uint8_t> generate_code_lengths(
+    std::span<const std::uint64_t> counts, std::uint8_t max_length);
 
-        // Tree will be heavier (has more nodes) to the right
-        trees.back() = std::make_pair(
-            smallest.first + larger.first,
-            HuffmanTree(std::move(smallest.second), std::move(larger.second)));
-        std::push_heap(trees.begin(), trees.end(), std::greater<Node>());
-    }
-    return std::move(trees.back().second);
+// Size in bits of the text coded with `lengths`
+std::uint64_t encoded_size(const CountTable& counts,
+                           const CodeLengths& lengths);
+
+// Size in bits of the text coded with an unbounded Huffman code
+std::uint64_t optimal_encoded_size(const CountTable& counts);
+
+HuffmanTree generate_mapping(const CountTable& counts);
+
+HuffmanTree generate_mapping(const CountTable& counts,
+                             std::uint8_t max_length);
+
+template <typename U>
+    requires std::is_integral_v<U> && std::is_unsigned_v<U>
+HuffmanTree generate_mapping(
+    const std::unordered_map<character_type, U>& count_table) {
+    return generate_mapping(to_count_table(count_table));
+}
+
+template <typename U>
+    requires std::is_integral_v<U> && std::is_unsigned_v<U>
+HuffmanTree generate_mapping(
+    const std::unordered_map<character_type, U>& count_table,
+    std::uint8_t max_length) {
+    return generate_mapping(to_count_table(count_table), max_length);
 }
 
 std::unordered_map<Huffman::character_type, std::vector<bool>>
 generate_inverse_mapping(const HuffmanTree& tree);
 
+// Writes the code lengths run-length coded: the bit width of the longest
+// length, then (length, Elias-gamma run) pairs covering the alphabet
+void serialize_lengths(BitStream::obitstream& output,
+                       const CodeLengths& lengths);
+
+// Writes `lengths` as differences from `previous`: (Elias-gamma zigzagged
+// difference plus one, Elias-gamma run) pairs covering the alphabet. Tables
+// of neighbouring blocks mostly differ in a few letters, which this codes
+// in a handful of bits
+void serialize_length_deltas(BitStream::obitstream& output,
+                             const CodeLengths& previous,
+                             const CodeLengths& lengths);
+
+// Trees are canonical, so only their code lengths are stored
 void serialize_tree(BitStream::obitstream& output, const HuffmanTree& tree);
 
 void serialize_text(
     std::basic_istream<character_type>& input, BitStream::obitstream& output,
     const std::unordered_map<character_type, std::vector<bool>>& encode);
 
+// Canonical code of every letter, indexed by its unsigned value, plus an
+// optional table coding two consecutive letters with a single lookup
+struct EncodeTable {
+    struct Code {
+        std::uint64_t code;
+        std::uint8_t length;
+    };
+    struct PairCode {
+        // Pairs whose codes do not fit `code` are coded letter by letter
+        static constexpr std::uint8_t no_pair = 0xFF;
+
+        std::uint32_t code;
+        std::uint8_t length;
+    };
+
+    std::array<Code, alphabet_size> codes;
+    // Indexed by the first letter's index shifted left by 8, ored with the
+    // second's; empty unless requested
+    std::vector<PairCode> pairs;
+};
+
+EncodeTable generate_encode_table(const CodeLengths& lengths,
+                                  bool pairs = false);
+
+EncodeTable generate_encode_table(const HuffmanTree& tree,
+                                  bool pairs = false);
+
+// Codes exactly the letters of `text`, without a terminating EOF
+void serialize_text(std::span<const character_type> text,
+                    BitStream::obitstream& output, const EncodeTable& encode);
+
+void serialize_text(std::basic_istream<character_type>& input,
+                    BitStream::obitstream& output, const EncodeTable& encode);
+
+// Codes `text` as interleaved streams sharing one code: letter `i` goes to
+// `outputs[i % outputs.size()]`, so decoding can follow all streams at once
+void serialize_interleaved(std::span<const character_type> text,
+                           std::span<BitStream::obitstream> outputs,
+                           const EncodeTable& encode);
+
+// Table coding each letter, picked by the letter before it
+using ContextEncode = std::array<const EncodeTable*, alphabet_size>;
+
+// Codes each letter of `text` with the table its previous letter picks,
+// the first letter being taken to follow letter 0
+void serialize_text(std::span<const character_type> text,
+                    BitStream::obitstream& output,
+                    const ContextEncode& encode);
+
+CodeLengths deserialize_lengths(BitStream::ibitstream& input);
+
+CodeLengths deserialize_length_deltas(BitStream::ibitstream& input,
+                                      const CodeLengths& previous);
+
 HuffmanTree deserialize_tree(BitStream::ibitstream& input);
 
+// Resolves the codes of a table to their letters
+using DecodeTable = Canonical::DecodeTable<character_type, alphabet_size>;
+
+DecodeTable generate_decode_table(const CodeLengths& lengths);
+
+DecodeTable generate_decode_table(const HuffmanTree& tree);
+
+// Decodes a single letter. Past the end of the input it decodes padding,
+// which the caller checks the stream for once done.
+character_type deserialize_letter(BitStream::ibitstream& input,
+                                  const DecodeTable& decode);
+
+void deserialize_text(BitStream::ibitstream& input,
+                      std::basic_ostream<character_type>& output,
+                      const DecodeTable& decode);
+
+// Decodes exactly `text.size()` letters, without expecting an EOF
+void deserialize_text(BitStream::ibitstream& input,
+                      std::span<character_type> text,
+                      const DecodeTable& decode);
+
 void deserialize_text(BitStream::ibitstream& input,
                       std::basic_ostream<character_type>& output,
                       const HuffmanTree& decode);
+
+using ContextDecode = std::array<const DecodeTable*, alphabet_size>;
+
+// Decodes `text.size()` letters coded with a ContextEncode
+void deserialize_text(BitStream::ibitstream& input,
+                      std::span<character_type> text,
+                      const ContextDecode& decode);
+
+// Decodes `text.size()` letters coded by serialize_interleaved
+void deserialize_interleaved(std::span<BitStream::ibitstream> inputs,
+                             std::span<character_type> text,
+                             const DecodeTable& decode);
 }  // namespace Huffman
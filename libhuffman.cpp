@@ -0,0 +1,104 @@
+#include "libhuffman.h"
+
+#include <exception>
+#include <ios>
+#include <stdexcept>
+
+#include "memory.hpp"
+#include "thread_pool.hpp"
+
+struct huf_dictionary {
+    Container::Dictionary dictionary;
+};
+
+// Runs `action`, turning the exceptions it throws into status codes
+template <typename Action>
+static huf_status guard(Action action) {
+    try {
+        action();
+        return HUF_OK;
+    } catch (const std::ios::failure&) {
+        return HUF_INVALID_INPUT;
+    } catch (const std::length_error&) {
+        return HUF_BUFFER_TOO_SMALL;
+    } catch (...) {
+        return HUF_ERROR;
+    }
+}
+
+static std::span<const std::byte> input_bytes(const void* input,
+                                              size_t size) {
+    return {static_cast<const std::byte*>(input), size};
+}
+
+static std::span<std::byte> output_bytes(void* output, size_t size) {
+    return {static_cast<std::byte*>(output), size};
+}
+
+static size_t thread_count(size_t threads) {
+    return threads == 0 ? Parallel::default_threads() : threads;
+}
+
+huf_status huf_dictionary_load(const void* input, size_t input_size,
+                               huf_dictionary** dictionary) {
+    return ::guard([&] {
+        *dictionary = new huf_dictionary{
+            Memory::read_dictionary(::input_bytes(input, input_size))};
+    });
+}
+
+void huf_dictionary_free(huf_dictionary* dictionary) { delete dictionary; }
+
+size_t huf_compress_bound(size_t size) {
+    // Covers the dictionary id that huf_compress_dict adds
+    const Container::Dictionary any{};
+    return Memory::compress_bound(size, {.dictionary = &any});
+}
+
+huf_status huf_compress(const void* input, size_t input_size, void* output,
+                        size_t output_capacity, size_t* output_size,
+                        size_t threads) {
+    return huf_compress_dict(input, input_size, output, output_capacity,
+                             output_size, threads, nullptr);
+}
+
+huf_status huf_compress_dict(const void* input, size_t input_size,
+                             void* output, size_t output_capacity,
+                             size_t* output_size, size_t threads,
+                             const huf_dictionary* dictionary) {
+    return ::guard([&] {
+        *output_size = Memory::compress(
+            ::input_bytes(input, input_size),
+            ::output_bytes(output, output_capacity),
+            Container::Options{.threads = ::thread_count(threads),
+                               .dictionary = dictionary != nullptr
+                                                 ? &dictionary->dictionary
+                                                 : nullptr});
+    });
+}
+
+huf_status huf_decompressed_size(const void* input, size_t input_size,
+                                 uint64_t* size) {
+    return ::guard([&] {
+        *size = Memory::decompressed_size(::input_bytes(input, input_size));
+    });
+}
+
+huf_status huf_decompress(const void* input, size_t input_size, void* output,
+                          size_t output_capacity, size_t* output_size,
+                          size_t threads) {
+    return huf_decompress_dict(input, input_size, output, output_capacity,
+                               output_size, threads, nullptr);
+}
+
+huf_status huf_decompress_dict(const void* input, size_t input_size,
+                               void* output, size_t output_capacity,
+                               size_t* output_size, size_t threads,
+                               const huf_dictionary* dictionary) {
+    return ::guard([&] {
+        *output_size = Memory::decompress(
+            ::input_bytes(input, input_size),
+            ::output_bytes(output, output_capacity), ::thread_count(threads),
+            dictionary != nullptr ? &dictionary->dictionary : nullptr);
+    });
+}
@@ -0,0 +1,63 @@
+/* C interface of the library; functions return HUF_OK or an error code and
+ * never throw */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum huf_status {
+    HUF_OK = 0,
+    /* The input is not a container, or is corrupt */
+    HUF_INVALID_INPUT = 1,
+    /* The output buffer cannot hold the result */
+    HUF_BUFFER_TOO_SMALL = 2,
+    HUF_ERROR = 3,
+} huf_status;
+
+/* A dictionary written by the train operation; containers coded with one
+ * are decoded with the same one */
+typedef struct huf_dictionary huf_dictionary;
+
+/* Reads the bytes of a dictionary file into a handle that
+ * huf_dictionary_free releases */
+huf_status huf_dictionary_load(const void* input, size_t input_size,
+                               huf_dictionary** dictionary);
+
+void huf_dictionary_free(huf_dictionary* dictionary);
+
+/* Largest container huf_compress or huf_compress_dict writes for `size`
+ * bytes of input */
+size_t huf_compress_bound(size_t size);
+
+/* Compresses `input` with the default options on `threads` threads (0 for
+ * one per core) and stores the container's size in `output_size` */
+huf_status huf_compress(const void* input, size_t input_size, void* output,
+                        size_t output_capacity, size_t* output_size,
+                        size_t threads);
+
+/* As huf_compress, letting blocks use the table of `dictionary` */
+huf_status huf_compress_dict(const void* input, size_t input_size,
+                             void* output, size_t output_capacity,
+                             size_t* output_size, size_t threads,
+                             const huf_dictionary* dictionary);
+
+huf_status huf_decompressed_size(const void* input, size_t input_size,
+                                 uint64_t* size);
+
+huf_status huf_decompress(const void* input, size_t input_size, void* output,
+                          size_t output_capacity, size_t* output_size,
+                          size_t threads);
+
+/* As huf_decompress, for containers coded with `dictionary` */
+huf_status huf_decompress_dict(const void* input, size_t input_size,
+                               void* output, size_t output_capacity,
+                               size_t* output_size, size_t threads,
+                               const huf_dictionary* dictionary);
+
+#ifdef __cplusplus
+}
+#endif
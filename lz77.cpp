@@ -0,0 +1,355 @@
+#include "lz77.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <ios>
+#include <limits>
+#include <stdexcept>
+
+[[noreturn]] static void invalid_file() {
+    throw std::ios::failure("Not a huf-compressed file!");
+}
+
+static void check_invalid_file(BitStream::ibitstream& input) {
+    if (input) {
+        return;
+    }
+    ::invalid_file();
+}
+
+namespace {
+constexpr std::uint8_t max_hash_bits = 16;
+constexpr std::uint32_t no_position = std::numeric_limits<std::uint32_t>::max();
+constexpr std::uint64_t direct_values = 16;
+
+// How hard a level searches
+struct Effort {
+    // Chain entries to try per position
+    std::size_t max_chain;
+    // Matches this long end the search
+    std::size_t nice_length;
+    // Whether a match waits for a longer one at the next byte
+    bool lazy;
+};
+
+constexpr std::array<Effort, Lz77::max_level + 1> efforts = {{
+    {0, 0, false},
+    {1, 8, false},
+    {4, 16, false},
+    {8, 32, false},
+    {16, 32, true},
+    {32, 64, true},
+    {64, 128, true},
+    {128, 256, true},
+    {512, 1024, true},
+    {4096, 1 << 16, true},
+}};
+
+struct Match {
+    std::size_t length;
+    std::size_t distance;
+};
+
+// Hash chains over the last `window_size` positions of a block: `head`
+// holds the latest position of every hash, `previous` the position before
+// each one with the same hash
+class MatchFinder {
+   public:
+    explicit MatchFinder(std::span<const Lz77::character_type> block)
+        : block(block),
+          // Small blocks spare themselves clearing a large table
+          hash_bits(std::clamp<std::uint8_t>(
+              static_cast<std::uint8_t>(std::bit_width(block.size())), 8,
+              max_hash_bits)),
+          head(std::size_t(1) << hash_bits, no_position),
+          previous(std::min(block.size(), Lz77::window_size)) {}
+
+    // Needs `min_match` bytes from `position`
+    void insert(std::size_t position) {
+        auto& latest = head[hash(position)];
+        previous[position % previous.size()] = latest;
+        latest = static_cast<std::uint32_t>(position);
+    }
+
+    // Longest earlier match of the bytes from `position`, which is not
+    // inserted yet
+    Match find(std::size_t position, const Effort& effort) const {
+        Match best{0, 0};
+        const auto limit = block.size() - position;
+        auto candidate = head[hash(position)];
+        for (std::size_t chain = 0; chain < effort.max_chain &&
+                                    candidate != no_position &&
+                                    position - candidate <= Lz77::window_size;
+             chain++) {
+            const auto length = match_length(candidate, position, limit);
+            if (length > best.length) {
+                best = Match{length, position - candidate};
+                if (length >= effort.nice_length) {
+                    break;
+                }
+            }
+            const auto next = previous[candidate % previous.size()];
+            // Slots past the window have been reused by later positions
+            if (next != no_position && next >= candidate) {
+                break;
+            }
+            candidate = next;
+        }
+        return best;
+    }
+
+   private:
+    std::size_t hash(std::size_t position) const {
+        std::uint32_t bytes;
+        std::memcpy(&bytes, block.data() + position, sizeof(bytes));
+        return (bytes * 2654435761u) >> (32 - hash_bits);
+    }
+
+    std::size_t match_length(std::size_t from, std::size_t to,
+                             std::size_t limit) const {
+        const auto* a = block.data() + from;
+        const auto* b = block.data() + to;
+        std::size_t length = 0;
+        if constexpr (std::endian::native == std::endian::little) {
+            for (; length + 8 <= limit; length += 8) {
+                std::uint64_t x;
+                std::uint64_t y;
+                std::memcpy(&x, a + length, sizeof(x));
+                std::memcpy(&y, b + length, sizeof(y));
+                if (x != y) {
+                    return length + std::countr_zero(x ^ y) / 8;
+                }
+            }
+        }
+        while (length < limit && a[length] == b[length]) {
+            ++length;
+        }
+        return length;
+    }
+
+    std::span<const Lz77::character_type> block;
+    std::uint8_t hash_bits;
+    std::vector<std::uint32_t> head;
+    std::vector<std::uint32_t> previous;
+};
+}  // namespace
+
+Lz77::ValueCode Lz77::value_code(std::uint64_t value) {
+    if (value < direct_values) {
+        return ValueCode{static_cast<std::uint8_t>(value), 0, 0};
+    }
+    const auto width = static_cast<std::uint8_t>(std::bit_width(value));
+    const auto extra_bits = static_cast<std::uint8_t>(width - 2);
+    return ValueCode{
+        static_cast<std::uint8_t>(direct_values + 2 * (width - 5) +
+                                  (value >> extra_bits & 1)),
+        extra_bits, value & ((std::uint64_t(1) << extra_bits) - 1)};
+}
+
+std::uint64_t Lz77::read_value(BitStream::ibitstream& input,
+                               std::uint8_t code) {
+    if (code < direct_values) {
+        return code;
+    }
+    const std::uint8_t width = (code - direct_values) / 2 + 5;
+    // Block sizes fit 32 bits
+    if (width > 32) {
+        ::invalid_file();
+    }
+    const auto extra_bits = static_cast<std::uint8_t>(width - 2);
+    const auto value =
+        (std::uint64_t(2) | ((code - direct_values) & 1)) << extra_bits |
+        input.peek_bits(extra_bits);
+    input.consume(extra_bits);
+    return value;
+}
+
+// Calls `visit(table, value)` for every value a sequence codes through
+// value codes, and `visit(literals, letter)` for its literals
+template <typename Visitor>
+static void for_each_code(std::span<const Lz77::character_type> block,
+                          const std::vector<Lz77::Sequence>& sequences,
+                          Visitor&& visit) {
+    std::size_t position = 0;
+    for (const auto& sequence : sequences) {
+        visit(Lz77::runs, sequence.literals);
+        for (auto letter : block.subspan(position, sequence.literals)) {
+            visit(Lz77::literals, static_cast<std::uint8_t>(letter));
+        }
+        position += sequence.literals;
+        if (sequence.length != 0) {
+            visit(Lz77::lengths, sequence.length - Lz77::min_match);
+            visit(Lz77::distances, sequence.distance - 1);
+            position += sequence.length;
+        }
+    }
+}
+
+static std::vector<Lz77::Sequence> find_sequences(
+    std::span<const Lz77::character_type> block, const Effort& effort) {
+    std::vector<Lz77::Sequence> sequences;
+    MatchFinder finder(block);
+    std::size_t start = 0;
+    std::size_t position = 0;
+    while (position + Lz77::min_match <= block.size()) {
+        auto match = finder.find(position, effort);
+        finder.insert(position);
+        if (match.length < Lz77::min_match) {
+            ++position;
+            continue;
+        }
+        while (effort.lazy && match.length < effort.nice_length &&
+               position + 1 + Lz77::min_match <= block.size()) {
+            const auto next = finder.find(position + 1, effort);
+            if (next.length <= match.length) {
+                break;
+            }
+            finder.insert(++position);
+            match = next;
+        }
+        sequences.push_back(
+            Lz77::Sequence{static_cast<std::uint32_t>(position - start),
+                           static_cast<std::uint32_t>(match.length),
+                           static_cast<std::uint32_t>(match.distance)});
+        const auto end = position + match.length;
+        while (++position < end &&
+               position + Lz77::min_match <= block.size()) {
+            finder.insert(position);
+        }
+        position = start = end;
+    }
+    if (start < block.size()) {
+        sequences.push_back(Lz77::Sequence{
+            static_cast<std::uint32_t>(block.size() - start), 0, 0});
+    }
+    return sequences;
+}
+
+Lz77::Parse Lz77::parse(std::span<const character_type> block,
+                        std::uint8_t level, std::uint8_t max_length) {
+    if (level == 0 || level > max_level) {
+        throw std::invalid_argument("LZ77 level is out of range");
+    }
+    Parse parse;
+    parse.sequences = ::find_sequences(block, efforts[level]);
+    std::array<Huffman::CountTable, table_count> counts{};
+    ::for_each_code(block, parse.sequences,
+                    [&](Table table, std::uint64_t value) {
+                        if (table == literals) {
+                            ++counts[table][value];
+                            return;
+                        }
+                        const auto code = value_code(value);
+                        ++counts[table][code.code];
+                        parse.code_bits += code.extra_bits;
+                    });
+    for (std::size_t table = 0; table < table_count; table++) {
+        auto& lengths = parse.tables[table];
+        lengths = Huffman::generate_code_lengths(counts[table], max_length);
+        parse.code_bits += Huffman::encoded_size(counts[table], lengths);
+        for (std::size_t letter = 0; letter < lengths.size(); letter++) {
+            parse.code_lengths[lengths[letter]] += counts[table][letter];
+        }
+    }
+    return parse;
+}
+
+static bool in_use(const Huffman::CodeLengths& lengths) {
+    return std::any_of(lengths.begin(), lengths.end(),
+                       [](auto length) { return length != 0; });
+}
+
+void Lz77::serialize_tables(BitStream::obitstream& output,
+                            const Tables& tables) {
+    for (const auto& lengths : tables) {
+        output.write(::in_use(lengths));
+    }
+    for (const auto& lengths : tables) {
+        if (::in_use(lengths)) {
+            Huffman::serialize_lengths(output, lengths);
+        }
+    }
+}
+
+Lz77::Tables Lz77::deserialize_tables(BitStream::ibitstream& input) {
+    std::array<bool, table_count> used;
+    for (auto& table : used) {
+        table = input.read();
+    }
+    Tables tables{};
+    for (std::size_t table = 0; table < table_count; table++) {
+        if (used[table]) {
+            tables[table] = Huffman::deserialize_lengths(input);
+        }
+    }
+    ::check_invalid_file(input);
+    return tables;
+}
+
+void Lz77::serialize_text(std::span<const character_type> block,
+                          const Parse& parse, BitStream::obitstream& output) {
+    std::array<Huffman::EncodeTable, table_count> encode;
+    for (std::size_t table = 0; table < table_count; table++) {
+        encode[table] = Huffman::generate_encode_table(parse.tables[table]);
+    }
+    ::for_each_code(block, parse.sequences,
+                    [&](Table table, std::uint64_t value) {
+                        if (table == literals) {
+                            const auto [code, length] =
+                                encode[table].codes[value];
+                            output.put_bits(code, length);
+                            return;
+                        }
+                        const auto [letter, extra_bits, extra] =
+                            value_code(value);
+                        const auto [code, length] = encode[table].codes[letter];
+                        output.put_bits(code, length);
+                        output.put_bits(extra, extra_bits);
+                    });
+}
+
+void Lz77::deserialize_text(BitStream::ibitstream& input,
+                            std::span<character_type> block,
+                            const Tables& tables) {
+    std::array<Huffman::DecodeTable, table_count> decode;
+    for (std::size_t table = 0; table < table_count; table++) {
+        decode[table] = Huffman::generate_decode_table(tables[table]);
+    }
+    const auto read = [&input, &decode](Table table) {
+        const auto code = Huffman::deserialize_letter(input, decode[table]);
+        return read_value(input, static_cast<std::uint8_t>(code));
+    };
+    auto* const begin = block.data();
+    std::size_t position = 0;
+    while (position < block.size()) {
+        const auto run = read(runs);
+        if (run > block.size() - position) {
+            ::invalid_file();
+        }
+        Huffman::deserialize_text(input, block.subspan(position, run),
+                                  decode[literals]);
+        position += run;
+        if (position == block.size()) {
+            break;
+        }
+        const auto length = read(lengths) + min_match;
+        const auto distance = read(distances) + 1;
+        ::check_invalid_file(input);
+        if (length > block.size() - position || distance > position) {
+            ::invalid_file();
+        }
+        auto* const to = begin + position;
+        const auto* from = to - distance;
+        if (distance >= length) {
+            std::memcpy(to, from, length);
+        } else {
+            // Overlapping copies repeat the last `distance` bytes
+            for (std::size_t i = 0; i < length; i++) {
+                to[i] = from[i];
+            }
+        }
+        position += length;
+    }
+    ::check_invalid_file(input);
+}
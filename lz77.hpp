@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "bitstream.hpp"
+#include "huffman.hpp"
+
+// LZ77 front end: a block is parsed into sequences of literals followed by
+// a copy of earlier bytes of the block, found with hash chains over a
+// sliding window. Literals, literal run lengths, match lengths and
+// distances are each coded with a Huffman table of their own, as Deflate
+// does with its literal/length and distance tables.
+namespace Lz77 {
+
+using character_type = Huffman::character_type;
+
+// Matches reach back this far at most, which bounds the match finder's
+// memory whatever the block size
+constexpr std::size_t window_size = 1 << 18;
+constexpr std::size_t min_match = 4;
+constexpr std::uint8_t default_level = 6;
+constexpr std::uint8_t max_level = 9;
+
+struct Sequence {
+    std::uint32_t literals;
+    // Match length and distance; 0 for the literals that end a block
+    std::uint32_t length;
+    std::uint32_t distance;
+};
+
+// What each table codes. Run and match lengths, less `min_match`, and
+// distances, less one, are coded as values: values below 16 are codes of
+// their own, larger ones take two codes per power of two, picked by their
+// bit width and the bit below the top one, followed by the bits below
+// those two as they are.
+enum Table : std::uint8_t {
+    literals = 0,
+    runs = 1,
+    lengths = 2,
+    distances = 3,
+};
+
+constexpr std::size_t table_count = 4;
+
+// A value's code and the bits written after it
+struct ValueCode {
+    std::uint8_t code;
+    std::uint8_t extra_bits;
+    std::uint64_t extra;
+};
+
+ValueCode value_code(std::uint64_t value);
+
+// Reads the extra bits of the value coded by `code`, up to 32 bits wide
+std::uint64_t read_value(BitStream::ibitstream& input, std::uint8_t code);
+
+using Tables = std::array<Huffman::CodeLengths, table_count>;
+
+struct Parse {
+    std::vector<Sequence> sequences;
+    // Tables the block uses hold at least one code, the others none
+    Tables tables{};
+    // Size of the codes in bits, extra bits included, and codes of each
+    // length over every table
+    std::uint64_t code_bits = 0;
+    std::array<std::uint64_t, Huffman::max_code_length + 1> code_lengths{};
+};
+
+// Finds the sequences of `block`, searching longer chains and deferring
+// matches for a longer one at the next byte at higher levels, from 1 to
+// `max_level`, then builds their tables
+Parse parse(std::span<const character_type> block,
+            std::uint8_t level = default_level,
+            std::uint8_t max_length = Huffman::max_code_length);
+
+// Writes a 4-bit mask of the tables in use, then each of them as written
+// by Huffman::serialize_lengths
+void serialize_tables(BitStream::obitstream& output, const Tables& tables);
+
+Tables deserialize_tables(BitStream::ibitstream& input);
+
+// Writes every sequence as its run code, its literals, then its match
+// length and distance codes, the extra bits of each value following its
+// code
+void serialize_text(std::span<const character_type> block,
+                    const Parse& parse, BitStream::obitstream& output);
+
+// Decodes exactly `block.size()` bytes
+void deserialize_text(BitStream::ibitstream& input,
+                      std::span<character_type> block, const Tables& tables);
+}  // namespace Lz77
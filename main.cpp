@@ -1,65 +1,624 @@
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <optional>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <vector>
 
-#include "huffman.hpp"
+#include "archive.hpp"
+#include "async_file.hpp"
+#include "container.hpp"
+#include "histogram.hpp"
+#include "lz77.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
 
 using namespace std;
 
 using character_type = BitStream::character_type;
-using count_type = std::size_t;
 
-unordered_map<character_type, count_type> generate_count_table(
-    basic_istream<character_type>& buffer) {
-    unordered_map<character_type, count_type> count;
-    for (character_type letter; buffer.get(letter);) {
-        ++count[letter];
+enum class StatsFormat { none, text, json };
+
+// What coding with a sampled table cost against tables of each block's own,
+// headers included
+struct Sampling {
+    uint64_t sampled_bytes;
+    uint64_t sampled_bits;
+    uint64_t exact_bits;
+};
+
+struct Options {
+    Container::Options container{.threads = Parallel::default_threads()};
+    bool limit_length = false;
+    StatsFormat stats = StatsFormat::none;
+    uint64_t offset = 0;
+    uint64_t length = UINT64_MAX;
+    // Dictionary file to train, or to code with
+    string dictionary;
+    // Archive to write, and member of one to extract
+    string archive;
+    string member;
+    vector<string> files;
+};
+
+// Compares the blocks coded with a single Huffman table against unbounded
+// codes; blocks of the other modes code another text and are left out
+void report_length_limit(const Container::Stats& stats, uint8_t max_length) {
+    const auto limited = stats.huffman_bits;
+    const auto unbounded = stats.huffman_optimal_bits;
+    if (unbounded == 0) {
+        clog << "Codes limited to " << +max_length
+             << " bits: no block was coded with a single Huffman table"
+             << endl;
+        return;
     }
-    ++count[EOF];
-    return count;
+    const auto loss = 100.0 *
+                      (static_cast<double>(limited) -
+                       static_cast<double>(unbounded)) /
+                      unbounded;
+    clog << "Codes limited to " << +max_length << " bits: " << limited
+         << " bits, " << loss << "% above the unbounded code (" << unbounded
+         << " bits)" << endl;
 }
 
-void compress(const char* filename) {
-    basic_ifstream<character_type> input(filename);
-    if (!input) {
-        throw ios::failure("No such file to compress!");
+// "-" stands for the standard input and output, so the tool fits in pipes
+bool is_standard(const char* filename) { return filename == "-"sv; }
+
+// Peak resident set size of the process, in KiB
+long peak_rss() {
+    rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+double milliseconds(chrono::nanoseconds time) {
+    return chrono::duration<double, milli>(time).count();
+}
+
+void report_stats(const Container::Stats& stats, chrono::nanoseconds wall,
+                  bool compressing, StatsFormat format,
+                  const optional<Sampling>& sampling = nullopt) {
+    const auto symbols =
+        static_cast<double>(max<uint64_t>(stats.input_size, 1));
+    const auto ratio = 100.0 * stats.output_size /
+                       max<uint64_t>(stats.input_size, 1);
+    const auto penalty =
+        !sampling || sampling->exact_bits == 0
+            ? 0.0
+            : 100.0 *
+                  (static_cast<double>(sampling->sampled_bits) -
+                   static_cast<double>(sampling->exact_bits)) /
+                  sampling->exact_bits;
+    const pair<const char*, chrono::nanoseconds> stages[] = {
+        {"histogram", stats.timings.histogram},
+        {"transform", stats.timings.transform},
+        {"tables", stats.timings.tables},
+        {"headers", stats.timings.headers},
+        {compressing ? "encode" : "decode", stats.timings.coding},
+        {"checksum", stats.timings.checksum},
+    };
+    if (format == StatsFormat::json) {
+        clog << "{\"input_bytes\": " << stats.input_size
+             << ", \"output_bytes\": " << stats.output_size
+             << ", \"blocks\": " << stats.blocks;
+        if (compressing) {
+            clog << ", \"entropy_bits\": " << stats.entropy_bits
+                 << ", \"code_bits\": " << stats.code_bits
+                 << ", \"header_bytes\": " << stats.header_size
+                 << ", \"code_lengths\": {";
+            const char* separator = "";
+            for (size_t length = 0; length < stats.code_lengths.size();
+                 length++) {
+                if (stats.code_lengths[length] != 0) {
+                    clog << separator << '"' << length
+                         << "\": " << stats.code_lengths[length];
+                    separator = ", ";
+                }
+            }
+            clog << "}";
+        }
+        if (sampling) {
+            clog << ", \"sampling\": {\"sampled_bytes\": "
+                 << sampling->sampled_bytes
+                 << ", \"sampled_bits\": " << sampling->sampled_bits
+                 << ", \"exact_bits\": " << sampling->exact_bits
+                 << ", \"penalty_percent\": " << penalty << "}";
+        }
+        clog << ", \"wall_ms\": " << milliseconds(wall)
+             << ", \"stage_ms\": {";
+        const char* separator = "";
+        for (const auto& [stage, time] : stages) {
+            clog << separator << '"' << stage << "\": " << milliseconds(time);
+            separator = ", ";
+        }
+        clog << "}, \"peak_rss_kib\": " << peak_rss() << "}" << endl;
+        return;
     }
-    auto count_table = generate_count_table(input);
-    auto tree = Huffman::generate_mapping(count_table);
-    auto encode = Huffman::generate_inverse_mapping(tree);
-    BitStream::obitstream output(filename + ".huf"s);
-    Huffman::serialize_tree(output, tree);
 
-    input.clear();
-    input.seekg(ios::beg);
-    Huffman::serialize_text(input, output, encode);
+    clog << "Input:        " << stats.input_size << " bytes\n"
+         << "Output:       " << stats.output_size << " bytes (" << ratio
+         << "% of the input)\n"
+         << "Blocks:       " << stats.blocks << "\n";
+    if (compressing) {
+        const auto entropy = stats.entropy_bits / symbols;
+        const auto achieved = stats.code_bits / symbols;
+        const auto overhead =
+            entropy == 0 ? 0.0 : 100.0 * (achieved - entropy) / entropy;
+        clog << "Entropy:      " << entropy << " bits/symbol\n"
+             << "Achieved:     " << achieved << " bits/symbol (" << overhead
+             << "% above entropy)\n"
+             << "Headers:      " << stats.header_size << " bytes ("
+             << 100.0 * stats.header_size /
+                    max<uint64_t>(stats.output_size, 1)
+             << "% of the output)\n"
+             << "Code lengths:";
+        for (size_t length = 0; length < stats.code_lengths.size();
+             length++) {
+            if (stats.code_lengths[length] != 0) {
+                clog << ' ' << length << ':' << stats.code_lengths[length];
+            }
+        }
+        clog << " (bits:letters coded)\n";
+    }
+    if (sampling) {
+        clog << "Sampling:     " << sampling->sampled_bytes
+             << " bytes sampled, " << penalty
+             << "% against tables of each block's own ("
+             << sampling->sampled_bits << " against "
+             << sampling->exact_bits << " bits)\n";
+    }
+    clog << "Wall time:    " << milliseconds(wall) << " ms\n"
+         << "Stage time:  ";
+    for (const auto& [stage, time] : stages) {
+        clog << ' ' << stage << ' ' << milliseconds(time) << " ms";
+    }
+    clog << " (summed over threads)\n"
+         << "Peak RSS:     " << peak_rss() << " KiB" << endl;
 }
 
-void decompress(const char* filename) {
-    BitStream::ibitstream input(filename);
+Container::Stats compress(const char* filename, const Options& options) {
+    if (is_standard(filename)) {
+        // Each block is written and flushed once it and the blocks before
+        // it are coded, so a slow stream such as a log comes out about two
+        // blocks behind its input. A stream faster than the coding holds up
+        // to two blocks per thread, plus the one being read.
+        AsyncFile::Input input(STDIN_FILENO);
+        AsyncFile::Output output(STDOUT_FILENO);
+        output << unitbuf;
+        const auto stats =
+            Container::compress(input, output, options.container);
+        output.close();
+        return stats;
+    }
+    // Regular files are mapped, anything else is streamed. Streams read
+    // ahead and write behind on threads of their own.
+    const MappedFile::Input mapped(filename);
+    optional<AsyncFile::Input> input;
+    if (!mapped) {
+        input.emplace(filename);
+        if (!*input) {
+            throw ios::failure("No such file to compress!");
+        }
+    }
+    AsyncFile::Output output(filename + ".huf"s);
+    const auto stats =
+        mapped ? Container::compress(mapped.data(), output, options.container)
+               : Container::compress(*input, output, options.container);
+    output.close();
+    return stats;
+}
+
+// What the sampled table cost against tables of each block's own, from
+// the letters the blocks counted while they were coded
+Sampling measure_sampling(const char* filename, const Options& options,
+                          const Container::Stats& stats) {
+    const auto& container = options.container;
+    // A stream samples its first block
+    const auto sampled = is_standard(filename)
+                             ? min<uint64_t>(container.sample,
+                                             container.block_size)
+                             : container.sample;
+    return Sampling{min(sampled, stats.input_size),
+                    stats.code_bits + 8 * stats.header_size,
+                    stats.exact_bits};
+}
+
+// The files given, and the regular files under the directories given, in
+// an order that does not depend on the file system
+vector<string> archive_members(const vector<string>& inputs) {
+    vector<string> files;
+    for (const auto& input : inputs) {
+        if (is_standard(input.c_str())) {
+            throw invalid_argument("The standard input cannot be archived");
+        }
+        if (!filesystem::is_directory(input)) {
+            files.push_back(input);
+            continue;
+        }
+        vector<string> found;
+        for (const auto& entry :
+             filesystem::recursive_directory_iterator(input)) {
+            if (entry.is_regular_file()) {
+                found.push_back(entry.path().generic_string());
+            }
+        }
+        sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    }
+    return files;
+}
+
+// Several files, or a directory, go to one archive, named after the first
+// of them unless --archive names it
+Container::Stats compress_archive(const Options& options) {
+    auto name = options.archive;
+    if (name.empty()) {
+        name = options.files.front();
+        while (name.size() > 1 && name.back() == '/') {
+            name.pop_back();
+        }
+        name += ".huf";
+    }
+    const auto files = archive_members(options.files);
+    basic_ofstream<character_type> output(name, ios::binary);
+    return Archive::create(files, output, options.container);
+}
+
+// Where a member is extracted to: its root and any leading parent
+// directories are dropped from its name, so that it lands under the
+// current directory
+filesystem::path extraction_path(const string& name) {
+    filesystem::path path;
+    for (const auto& part :
+         filesystem::path(name).lexically_normal().relative_path()) {
+        if (!path.empty() || part != "..") {
+            path /= part;
+        }
+    }
+    if (path.empty()) {
+        throw ios::failure("Invalid member name: " + name);
+    }
+    return path;
+}
+
+// Decompresses every member to its name suffixed with .fuh
+Container::Stats decompress_archive(basic_istream<character_type>& input,
+                                    const Options& options) {
+    Container::Stats stats;
+    for (const auto& member : Archive::read_directory(input)) {
+        const auto path = extraction_path(member.name);
+        if (path.has_parent_path()) {
+            filesystem::create_directories(path.parent_path());
+        }
+        Archive::MemberInput container(input, member);
+        const auto output_name = path.string() + ".fuh";
+        AsyncFile::Output output(output_name);
+        if (!output) {
+            throw ios::failure("Cannot write " + output_name);
+        }
+        stats += Container::decompress(container, output,
+                                       options.container.threads,
+                                       options.container.dictionary);
+        output.close();
+    }
+    return stats;
+}
+
+Container::Stats decompress(const char* filename, const Options& options) {
+    const auto threads = options.container.threads;
+    const auto dictionary = options.container.dictionary;
+    if (is_standard(filename)) {
+        AsyncFile::Input input(STDIN_FILENO);
+        AsyncFile::Output output(STDOUT_FILENO);
+        output << unitbuf;
+        const auto stats =
+            Container::decompress(input, output, threads, dictionary);
+        output.close();
+        return stats;
+    }
+    if (basic_ifstream<character_type> input(filename, ios::binary);
+        input && Archive::is_archive(input)) {
+        return decompress_archive(input, options);
+    }
+    const auto output_name = filename + ".fuh"s;
+    if (const MappedFile::Input mapped(filename); mapped) {
+        const auto size = Container::decompressed_size(mapped.data());
+        if (const MappedFile::Output output(output_name, size); output) {
+            return Container::decompress(mapped.data(), output.data(),
+                                         threads, dictionary);
+        }
+    }
+    AsyncFile::Input input(filename);
     if (!input) {
         throw ios::failure("No such file to decompress!");
     }
-    auto tree = Huffman::deserialize_tree(input);
-    basic_ofstream<character_type> output(filename + ".fuh"s);
-    Huffman::deserialize_text(input, output, tree);
+    AsyncFile::Output output(output_name);
+    const auto stats =
+        Container::decompress(input, output, threads, dictionary);
+    output.close();
+    return stats;
+}
+
+// Lists the blocks of `name` that do not decode or match their checksums,
+// and counts them into `bad_blocks`
+void report_verification(const Container::Verification& verification,
+                         const string& name, size_t& bad_blocks) {
+    if (!verification.checksums) {
+        clog << name << ": no checksums, only checking that blocks decode\n";
+    }
+    for (const auto& bad : verification.bad_blocks) {
+        clog << name << ": bad block at byte " << bad.compressed_offset
+             << ", holding bytes " << bad.uncompressed_offset << " to "
+             << bad.uncompressed_offset + bad.size << ": " << bad.error
+             << '\n';
+    }
+    bad_blocks += verification.bad_blocks.size();
+}
+
+// Decodes every block, or those of every archive member, without writing
+// anything
+Container::Stats verify(const char* filename, const Options& options,
+                        size_t& bad_blocks) {
+    const auto threads = options.container.threads;
+    const auto dictionary = options.container.dictionary;
+    optional<Container::Verification> verification;
+    if (is_standard(filename)) {
+        AsyncFile::Input input(STDIN_FILENO);
+        verification = Container::verify(input, threads, dictionary);
+    } else if (basic_ifstream<character_type> input(filename, ios::binary);
+               input && Archive::is_archive(input)) {
+        Container::Stats stats;
+        for (const auto& member : Archive::read_directory(input)) {
+            Archive::MemberInput container(input, member);
+            const auto checked =
+                Container::verify(container, threads, dictionary);
+            report_verification(checked, member.name, bad_blocks);
+            stats += checked.stats;
+        }
+        return stats;
+    } else if (const MappedFile::Input mapped(filename); mapped) {
+        verification = Container::verify(mapped.data(), threads, dictionary);
+    } else {
+        AsyncFile::Input streamed(filename);
+        if (!streamed) {
+            throw ios::failure("No such file to verify!");
+        }
+        verification = Container::verify(streamed, threads, dictionary);
+    }
+    report_verification(*verification, filename, bad_blocks);
+    return verification->stats;
+}
+
+void extract(const char* filename, const Options& options) {
+    if (is_standard(filename)) {
+        throw invalid_argument("Extracting needs a seekable file, not '-'");
+    }
+    basic_ifstream<character_type> input(filename, ios::binary);
+    if (!input) {
+        throw ios::failure("No such file to extract from!");
+    }
+    if (options.member.empty()) {
+        Container::extract(input, cout, options.offset, options.length,
+                           options.container.threads,
+                           options.container.dictionary);
+    } else {
+        // Only the member's own container is read
+        const auto directory = Archive::read_directory(input);
+        Archive::MemberInput member(
+            input, Archive::find_member(directory, options.member));
+        Container::extract(member, cout, options.offset, options.length,
+                           options.container.threads,
+                           options.container.dictionary);
+    }
+    cout.flush();
+}
+
+// Builds a dictionary from the letters of a sample input
+void train(const char* filename, const Options& options) {
+    if (options.dictionary.empty()) {
+        throw invalid_argument("Training needs --dict=FILE to write to");
+    }
+    const auto threads = options.container.threads;
+    Histogram::CountTable counts;
+    if (is_standard(filename)) {
+        counts = Histogram::count(cin, threads);
+    } else if (const MappedFile::Input mapped(filename); mapped) {
+        counts = Histogram::count(mapped.data(), threads);
+    } else {
+        basic_ifstream<character_type> input(filename, ios::binary);
+        if (!input) {
+            throw ios::failure("No such file to train on!");
+        }
+        counts = Histogram::count(input, threads);
+    }
+    basic_ofstream<character_type> output(options.dictionary, ios::binary);
+    Container::write_dictionary(
+        output, Container::train(counts, options.container.max_length));
+}
+
+Container::Dictionary read_dictionary(const string& filename) {
+    basic_ifstream<character_type> input(filename, ios::binary);
+    if (!input) {
+        throw ios::failure("No such dictionary!");
+    }
+    return Container::read_dictionary(input);
+}
+
+// Parses a size with an optional K, M or G binary suffix
+size_t parse_size(const string& value) {
+    size_t end;
+    auto size = stoull(value, &end);
+    const auto suffix = value.substr(end);
+    int shift = 0;
+    if (suffix == "K") {
+        shift = 10;
+    } else if (suffix == "M") {
+        shift = 20;
+    } else if (suffix == "G") {
+        shift = 30;
+    } else if (!suffix.empty()) {
+        throw invalid_argument("Invalid size: " + value);
+    }
+    if (size > (SIZE_MAX >> shift)) {
+        throw invalid_argument("Size is out of range: " + value);
+    }
+    return size << shift;
+}
+
+// Arguments starting with -- are options, the others name files
+Options parse_options(int argc, char** argv) {
+    Options options;
+    for (int i = 2; i < argc; i++) {
+        const string option = argv[i];
+        if (!option.starts_with("--")) {
+            options.files.push_back(option);
+        } else if (option.starts_with("--max-length=")) {
+            const auto max_length = stoul(option.substr(13));
+            if (max_length == 0 || max_length > Huffman::max_code_length) {
+                throw invalid_argument(
+                    "Maximum code length should be between 1 and " +
+                    to_string(Huffman::max_code_length));
+            }
+            options.container.max_length = max_length;
+            options.limit_length = true;
+        } else if (option.starts_with("--block-size=")) {
+            const auto block_size = parse_size(option.substr(13));
+            if (block_size == 0 || block_size > Container::max_block_size) {
+                throw invalid_argument(
+                    "Block size should be between 1 and " +
+                    to_string(Container::max_block_size));
+            }
+            options.container.block_size = block_size;
+        } else if (option == "--stats") {
+            options.stats = StatsFormat::text;
+        } else if (option == "--stats=json") {
+            options.stats = StatsFormat::json;
+        } else if (option.starts_with("--dict=")) {
+            options.dictionary = option.substr(7);
+        } else if (option.starts_with("--archive=")) {
+            options.archive = option.substr(10);
+        } else if (option.starts_with("--member=")) {
+            options.member = option.substr(9);
+        } else if (option == "--context") {
+            options.container.contexts = true;
+        } else if (option == "--symbols=utf8") {
+            options.container.symbols = Symbols::Kind::utf8;
+        } else if (option == "--symbols=utf16") {
+            options.container.symbols = Symbols::Kind::units16;
+        } else if (option == "--bwt") {
+            options.container.sort_blocks = true;
+        } else if (option == "--lz77") {
+            options.container.lz77 = Lz77::default_level;
+        } else if (option.starts_with("--lz77=")) {
+            const auto level = stoul(option.substr(7));
+            if (level == 0 || level > Lz77::max_level) {
+                throw invalid_argument("LZ77 level should be between 1 and " +
+                                       to_string(Lz77::max_level));
+            }
+            options.container.lz77 = level;
+        } else if (option == "--no-index") {
+            options.container.index = false;
+        } else if (option == "--sample") {
+            options.container.sample = Container::default_sample;
+        } else if (option.starts_with("--sample=")) {
+            options.container.sample = parse_size(option.substr(9));
+            if (options.container.sample == 0) {
+                throw invalid_argument("Sample size should be positive");
+            }
+        } else if (option == "--no-checksums") {
+            options.container.checksums = false;
+        } else if (option.starts_with("--offset=")) {
+            options.offset = parse_size(option.substr(9));
+        } else if (option.starts_with("--length=")) {
+            options.length = parse_size(option.substr(9));
+        } else if (option.starts_with("--streams=")) {
+            options.container.streams = stoul(option.substr(10));
+            if (options.container.streams == 0 ||
+                options.container.streams > Container::max_streams) {
+                throw invalid_argument("Stream count should be between 1 and " +
+                                       to_string(Container::max_streams));
+            }
+        } else if (option.starts_with("--threads=")) {
+            options.container.threads = stoul(option.substr(10));
+            if (options.container.threads == 0) {
+                throw invalid_argument("Thread count should be positive");
+            }
+        } else {
+            throw invalid_argument("Unknown option: " + option);
+        }
+    }
+    if (options.files.empty()) {
+        throw invalid_argument("No file given");
+    }
+    return options;
 }
 
 int main(int argc, char** argv) {
-    if (argc != 3) {
+    if (argc < 3) {
         throw invalid_argument("Usage: " + string(argv[0]) +
-                               " [c|d] <filename>");
+                               " [c|d|x|t|train] [options] <filename|->...");
+    }
+    // The standard streams carry whole blocks, C stdio buys nothing
+    ios::sync_with_stdio(false);
+    auto options = parse_options(argc, argv);
+    const auto filename = options.files.front().c_str();
+    const bool archive = options.files.size() > 1 ||
+                         filesystem::is_directory(options.files.front());
+    if (archive && argv[1][0] != 'c') {
+        throw invalid_argument("Only 'c' takes several files or a directory");
+    }
+    if (argv[1] == "train"sv) {
+        train(filename, options);
+        return 0;
+    }
+    // Outlives the coding, which refers to it through the options
+    optional<Container::Dictionary> dictionary;
+    if (!options.dictionary.empty()) {
+        dictionary = read_dictionary(options.dictionary);
+        options.container.dictionary = &*dictionary;
     }
+    const auto start = chrono::steady_clock::now();
     if (argv[1][0] == 'c') {
-        compress(argv[2]);
+        auto stats =
+            archive ? compress_archive(options) : compress(filename, options);
+        if (options.limit_length) {
+            report_length_limit(stats, options.container.max_length);
+        }
+        if (options.stats != StatsFormat::none) {
+            const auto wall = chrono::steady_clock::now() - start;
+            optional<Sampling> sampling;
+            if (options.container.sample != 0 && !archive) {
+                sampling = measure_sampling(filename, options, stats);
+            }
+            report_stats(stats, wall, true, options.stats, sampling);
+        }
     } else if (argv[1][0] == 'd') {
-        decompress(argv[2]);
+        const auto stats = decompress(filename, options);
+        if (options.stats != StatsFormat::none) {
+            report_stats(stats, chrono::steady_clock::now() - start, false,
+                         options.stats);
+        }
+    } else if (argv[1][0] == 'x') {
+        extract(filename, options);
+    } else if (argv[1][0] == 't') {
+        size_t bad_blocks = 0;
+        const auto stats = verify(filename, options, bad_blocks);
+        if (options.stats != StatsFormat::none) {
+            report_stats(stats, chrono::steady_clock::now() - start, false,
+                         options.stats);
+        }
+        return bad_blocks == 0 ? 0 : 1;
     } else {
-        throw invalid_argument("First argument should be 'c' or 'd'");
+        throw invalid_argument(
+            "First argument should be 'c', 'd', 'x', 't' or 'train'");
     }
     return 0;
 }
@@ -0,0 +1,60 @@
+#include "mapped_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::Input::Input(const std::string& filename) {
+    const int file = ::open(filename.c_str(), O_RDONLY);
+    if (file < 0) {
+        return;
+    }
+    struct stat status;
+    if (::fstat(file, &status) == 0 && S_ISREG(status.st_mode)) {
+        size = status.st_size;
+        // Empty files cannot be mapped, but need no pages either
+        if (size == 0) {
+            mapped = true;
+        } else if (void* pages =
+                       ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+                   pages != MAP_FAILED) {
+            ::madvise(pages, size, MADV_SEQUENTIAL);
+            address = static_cast<const character_type*>(pages);
+            mapped = true;
+        }
+    }
+    // The mapping keeps the pages alive on its own
+    ::close(file);
+}
+
+MappedFile::Input::~Input() {
+    if (address != nullptr) {
+        ::munmap(const_cast<character_type*>(address), size);
+    }
+}
+
+MappedFile::Output::Output(const std::string& filename, std::size_t size)
+    : size(size) {
+    const int file = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (file < 0) {
+        return;
+    }
+    if (size == 0) {
+        mapped = true;
+    } else if (::ftruncate(file, size) == 0) {
+        if (void* pages = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED, file, 0);
+            pages != MAP_FAILED) {
+            address = static_cast<character_type*>(pages);
+            mapped = true;
+        }
+    }
+    ::close(file);
+}
+
+MappedFile::Output::~Output() {
+    if (address != nullptr) {
+        ::munmap(address, size);
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+#include "bitstream.hpp"
+
+namespace MappedFile {
+using character_type = BitStream::character_type;
+
+// Read-only view of a whole regular file. Pipes, devices and files that
+// cannot be mapped leave it false so callers can stream them instead
+class Input {
+   public:
+    explicit Input(const std::string& filename);
+    ~Input();
+    Input(const Input&) = delete;
+    Input& operator=(const Input&) = delete;
+
+    operator bool() const { return mapped; }
+    bool operator!() const { return !mapped; }
+    std::span<const character_type> data() const { return {address, size}; }
+
+   private:
+    const character_type* address = nullptr;
+    std::size_t size = 0;
+    bool mapped = false;
+};
+
+// Writable view of a file created, or truncated, to exactly `size` bytes;
+// stays false if the file cannot be created or mapped
+class Output {
+   public:
+    Output(const std::string& filename, std::size_t size);
+    ~Output();
+    Output(const Output&) = delete;
+    Output& operator=(const Output&) = delete;
+
+    operator bool() const { return mapped; }
+    bool operator!() const { return !mapped; }
+    std::span<character_type> data() const { return {address, size}; }
+
+   private:
+    character_type* address = nullptr;
+    std::size_t size = 0;
+    bool mapped = false;
+};
+}  // namespace MappedFile
@@ -0,0 +1,126 @@
+#include "memory.hpp"
+
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+
+using character_type = Container::character_type;
+
+namespace {
+// Appends everything written to it to a vector
+class VectorBuffer : public std::basic_streambuf<character_type> {
+   public:
+    explicit VectorBuffer(std::vector<std::byte>& bytes) : bytes(bytes) {}
+
+   protected:
+    std::streamsize xsputn(const character_type* data,
+                           std::streamsize count) override {
+        const auto begin = reinterpret_cast<const std::byte*>(data);
+        bytes.insert(bytes.end(), begin, begin + count);
+        return count;
+    }
+    int_type overflow(int_type letter) override {
+        if (!traits_type::eq_int_type(letter, traits_type::eof())) {
+            bytes.push_back(static_cast<std::byte>(letter));
+        }
+        return traits_type::not_eof(letter);
+    }
+
+   private:
+    std::vector<std::byte>& bytes;
+};
+
+// Writes into a fixed region and throws std::length_error once it is full,
+// which stops the coder at the first block that does not fit
+class SpanBuffer : public std::basic_streambuf<character_type> {
+   public:
+    explicit SpanBuffer(std::span<std::byte> bytes) {
+        const auto begin = reinterpret_cast<character_type*>(bytes.data());
+        setp(begin, begin + bytes.size());
+    }
+    std::size_t size() const { return pptr() - pbase(); }
+
+   protected:
+    int_type overflow(int_type) override {
+        throw std::length_error("The output buffer is too small");
+    }
+};
+}  // namespace
+
+static std::span<const character_type> as_characters(
+    std::span<const std::byte> bytes) {
+    return {reinterpret_cast<const character_type*>(bytes.data()),
+            bytes.size()};
+}
+
+std::size_t Memory::compress_bound(std::size_t size,
+                                   const Container::Options& options) {
+    // Blocks never grow, but each costs a header and an index entry
+    const auto blocks = (size + options.block_size - 1) / options.block_size;
+    // A sampled table takes under a byte per letter
+    const std::size_t header =
+        Container::magic.size() + 1 + 4 +
+        (options.dictionary != nullptr ? 4 : 0) +
+        (options.sample != 0 ? 4 + Huffman::alphabet_size : 0);
+    const std::size_t block_header = 4 + 1 + 4 + (options.checksums ? 4 : 0);
+    constexpr std::size_t index_entry = 8 + 8 + 4;
+    constexpr std::size_t footer = 8 + 8 + Container::index_magic.size();
+    return header + size + blocks * block_header + 4 +
+           (options.index ? blocks * index_entry + footer : 0);
+}
+
+Container::Stats Memory::compress(std::span<const std::byte> input,
+                                  std::vector<std::byte>& output,
+                                  const Container::Options& options) {
+    VectorBuffer buffer(output);
+    std::basic_ostream<character_type> stream(&buffer);
+    return Container::compress(::as_characters(input), stream, options);
+}
+
+std::size_t Memory::compress(std::span<const std::byte> input,
+                             std::span<std::byte> output,
+                             const Container::Options& options) {
+    SpanBuffer buffer(output);
+    std::basic_ostream<character_type> stream(&buffer);
+    // Lets the buffer's exception through rather than failing the stream
+    stream.exceptions(std::ios::badbit);
+    Container::compress(::as_characters(input), stream, options);
+    return buffer.size();
+}
+
+Container::Dictionary Memory::read_dictionary(
+    std::span<const std::byte> input) {
+    const auto characters = ::as_characters(input);
+    std::basic_istringstream<character_type> stream(
+        std::basic_string<character_type>(characters.begin(),
+                                          characters.end()));
+    return Container::read_dictionary(stream);
+}
+
+std::uint64_t Memory::decompressed_size(std::span<const std::byte> input) {
+    return Container::decompressed_size(::as_characters(input));
+}
+
+std::size_t Memory::decompress(std::span<const std::byte> input,
+                               std::span<std::byte> output,
+                               std::size_t threads,
+                               const Container::Dictionary* dictionary) {
+    const auto size = decompressed_size(input);
+    if (size > output.size()) {
+        throw std::length_error("The output buffer is too small");
+    }
+    Container::decompress(
+        ::as_characters(input),
+        {reinterpret_cast<character_type*>(output.data()), size}, threads,
+        dictionary);
+    return size;
+}
+
+std::vector<std::byte> Memory::decompress(
+    std::span<const std::byte> input, std::size_t threads,
+    const Container::Dictionary* dictionary) {
+    std::vector<std::byte> output(decompressed_size(input));
+    decompress(input, output, threads, dictionary);
+    return output;
+}
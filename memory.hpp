@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "container.hpp"
+
+// Compression of buffers held in memory, for programs linking the library
+// rather than running the tool on files
+namespace Memory {
+
+// Largest container `compress` writes for `size` bytes of input
+std::size_t compress_bound(std::size_t size,
+                           const Container::Options& options = {});
+
+// Appends the container coding `input` to `output`
+Container::Stats compress(std::span<const std::byte> input,
+                          std::vector<std::byte>& output,
+                          const Container::Options& options = {});
+
+// Writes the container coding `input` to the start of `output` and returns
+// its size; throws std::length_error if it does not fit
+std::size_t compress(std::span<const std::byte> input,
+                     std::span<std::byte> output,
+                     const Container::Options& options = {});
+
+// Reads a dictionary as written by Container::write_dictionary
+Container::Dictionary read_dictionary(std::span<const std::byte> input);
+
+// Reads the block headers only, so needs no dictionary
+std::uint64_t decompressed_size(std::span<const std::byte> input);
+
+// Decodes `input` to the start of `output` and returns its size; throws
+// std::length_error if it does not fit. A container coded with a dictionary
+// needs the same one.
+std::size_t decompress(std::span<const std::byte> input,
+                       std::span<std::byte> output, std::size_t threads = 1,
+                       const Container::Dictionary* dictionary = nullptr);
+
+std::vector<std::byte> decompress(
+    std::span<const std::byte> input, std::size_t threads = 1,
+    const Container::Dictionary* dictionary = nullptr);
+}  // namespace Memory
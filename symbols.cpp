@@ -0,0 +1,382 @@
+#include "symbols.hpp"
+
+#include <algorithm>
+#include <ios>
+#include <stdexcept>
+
+[[noreturn]] static void invalid_file() {
+    throw std::ios::failure("Not a huf-compressed file!");
+}
+
+static void check_invalid_file(BitStream::ibitstream& input) {
+    if (input) {
+        return;
+    }
+    ::invalid_file();
+}
+
+namespace {
+constexpr std::uint8_t length_width = 6;
+constexpr std::uint8_t max_gamma_width = 32;
+// Symbols seen fewer times cost less escaped than described in the header
+constexpr std::uint64_t min_count = 2;
+
+struct Code {
+    static constexpr std::uint8_t none = 0xFF;
+
+    std::uint64_t code;
+    std::uint8_t length;
+};
+
+// Codes of a model, the escape's included
+constexpr std::size_t max_codes = Symbols::max_symbols + 1;
+}  // namespace
+
+std::size_t Symbols::Alphabet<std::uint8_t>::read(
+    std::span<const character_type> bytes, std::uint8_t& symbol) {
+    symbol = static_cast<std::uint8_t>(bytes[0]);
+    return 1;
+}
+
+std::size_t Symbols::Alphabet<std::uint8_t>::write(
+    std::uint8_t symbol, std::span<character_type> bytes) {
+    if (bytes.empty()) {
+        return 0;
+    }
+    bytes[0] = static_cast<character_type>(symbol);
+    return 1;
+}
+
+std::size_t Symbols::Alphabet<char16_t>::read(
+    std::span<const character_type> bytes, char16_t& symbol) {
+    symbol = static_cast<char16_t>(static_cast<std::uint8_t>(bytes[0]) |
+                                   static_cast<std::uint8_t>(bytes[1]) << 8);
+    return 2;
+}
+
+std::size_t Symbols::Alphabet<char16_t>::write(
+    char16_t symbol, std::span<character_type> bytes) {
+    if (bytes.size() < 2) {
+        return 0;
+    }
+    bytes[0] = static_cast<character_type>(symbol);
+    bytes[1] = static_cast<character_type>(symbol >> 8);
+    return 2;
+}
+
+std::size_t Symbols::Alphabet<char32_t>::read(
+    std::span<const character_type> bytes, char32_t& symbol) {
+    const auto lead = static_cast<std::uint8_t>(bytes[0]);
+    symbol = invalid_byte + lead;
+    std::size_t size;
+    char32_t value;
+    char32_t min;
+    if (lead < 0x80) {
+        symbol = lead;
+        return 1;
+    } else if (lead >= 0xC2 && lead <= 0xDF) {
+        size = 2, value = lead & 0x1F, min = 0x80;
+    } else if ((lead & 0xF0) == 0xE0) {
+        size = 3, value = lead & 0x0F, min = 0x800;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        size = 4, value = lead & 0x07, min = 0x10000;
+    } else {
+        return 1;
+    }
+    if (bytes.size() < size) {
+        return 1;
+    }
+    for (std::size_t i = 1; i < size; i++) {
+        const auto byte = static_cast<std::uint8_t>(bytes[i]);
+        if ((byte & 0xC0) != 0x80) {
+            return 1;
+        }
+        value = value << 6 | (byte & 0x3F);
+    }
+    // Overlong sequences would not come back the same
+    if (value < min || value > 0x10FFFF) {
+        return 1;
+    }
+    symbol = value;
+    return size;
+}
+
+std::size_t Symbols::Alphabet<char32_t>::write(
+    char32_t symbol, std::span<character_type> bytes) {
+    if (symbol >= invalid_byte) {
+        if (symbol >= invalid_byte + 0x100 || bytes.empty()) {
+            return 0;
+        }
+        bytes[0] = static_cast<character_type>(symbol - invalid_byte);
+        return 1;
+    }
+    const std::size_t size = symbol < 0x80      ? 1
+                             : symbol < 0x800   ? 2
+                             : symbol < 0x10000 ? 3
+                                                : 4;
+    if (bytes.size() < size) {
+        return 0;
+    }
+    constexpr std::array<std::uint8_t, 5> leads = {0, 0, 0xC0, 0xE0, 0xF0};
+    for (auto i = size; i-- > 1;) {
+        bytes[i] = static_cast<character_type>(0x80 | (symbol & 0x3F));
+        symbol >>= 6;
+    }
+    bytes[0] = static_cast<character_type>(leads[size] | symbol);
+    return size;
+}
+
+// Calls `visit(symbol)` with a symbol of the type `kind` reads, so that
+// every kind gets a coder of its own
+template <typename Visitor>
+static auto with_symbol_type(Symbols::Kind kind, Visitor&& visit) {
+    switch (kind) {
+        case Symbols::Kind::bytes:
+            return visit(std::uint8_t{});
+        case Symbols::Kind::units16:
+            return visit(char16_t{});
+        case Symbols::Kind::utf8:
+            return visit(char32_t{});
+    }
+    ::invalid_file();
+}
+
+// Calls `visit(symbol)` for every whole symbol of `block` and returns the
+// bytes they take
+template <typename Symbol, typename Visitor>
+static std::size_t for_each_symbol(
+    std::span<const Symbols::character_type> block, Visitor&& visit) {
+    using Alphabet = Symbols::Alphabet<Symbol>;
+    std::size_t position = 0;
+    while (block.size() - position >= Alphabet::unit) {
+        Symbol symbol;
+        position += Alphabet::read(block.subspan(position), symbol);
+        visit(symbol);
+    }
+    return position;
+}
+
+template <typename Symbol>
+static Symbols::Model build(std::span<const Symbols::character_type> block,
+                            std::uint8_t max_length) {
+    using Alphabet = Symbols::Alphabet<Symbol>;
+    std::vector<std::uint64_t> counts(Alphabet::direct_size);
+    std::uint64_t escaped = 0;
+    const auto parsed = ::for_each_symbol<Symbol>(block, [&](Symbol symbol) {
+        if (symbol < Alphabet::direct_size) {
+            ++counts[symbol];
+        } else {
+            ++escaped;
+        }
+    });
+
+    // The most frequent symbols get codes of their own, as many as the code
+    // lengths leave room for besides the escape
+    std::vector<char32_t> coded;
+    for (std::size_t symbol = 0; symbol < counts.size(); symbol++) {
+        if (counts[symbol] >= min_count) {
+            coded.push_back(static_cast<char32_t>(symbol));
+        } else {
+            escaped += counts[symbol];
+        }
+    }
+    const auto limit = std::min<std::uint64_t>(
+        Symbols::max_symbols, (std::uint64_t(1) << max_length) - 1);
+    if (coded.size() > limit) {
+        std::stable_sort(coded.begin(), coded.end(),
+                         [&counts](char32_t first, char32_t second) {
+                             return counts[first] > counts[second];
+                         });
+        for (auto symbol = coded.begin() + limit; symbol != coded.end();
+             ++symbol) {
+            escaped += counts[*symbol];
+        }
+        coded.resize(limit);
+        std::sort(coded.begin(), coded.end());
+    }
+
+    Symbols::Model model;
+    model.kind = Alphabet::kind;
+    std::vector<std::uint64_t> weights;
+    for (auto symbol : coded) {
+        weights.push_back(counts[symbol]);
+    }
+    weights.push_back(escaped);
+    model.lengths = Huffman::generate_code_lengths(weights, max_length);
+    // A lone code takes no bits
+    const bool lone = std::count(model.lengths.begin(), model.lengths.end(),
+                                 std::uint8_t(0)) +
+                          1 ==
+                      static_cast<std::ptrdiff_t>(model.lengths.size());
+    for (std::size_t index = 0; index < weights.size(); index++) {
+        model.code_lengths[model.lengths[index]] += weights[index];
+        if (!lone) {
+            model.code_bits += weights[index] * model.lengths[index];
+        }
+    }
+    model.code_bits +=
+        escaped * Alphabet::raw_bits + 8 * (block.size() - parsed);
+    model.symbols = std::move(coded);
+    return model;
+}
+
+Symbols::Model Symbols::build_model(std::span<const character_type> block,
+                                    Kind kind, std::uint8_t max_length) {
+    return ::with_symbol_type(kind, [&](auto symbol) {
+        return ::build<decltype(symbol)>(block, max_length);
+    });
+}
+
+static std::uint64_t deserialize_gamma(BitStream::ibitstream& input) {
+    return Canonical::deserialize_gamma(input, max_gamma_width);
+}
+
+static std::size_t direct_size(Symbols::Kind kind) {
+    return ::with_symbol_type(kind, [](auto symbol) {
+        return Symbols::Alphabet<decltype(symbol)>::direct_size;
+    });
+}
+
+void Symbols::serialize_model(BitStream::obitstream& output,
+                              const Model& model) {
+    output.put_bits(static_cast<std::uint8_t>(model.kind), 2);
+    Canonical::serialize_gamma(output, model.symbols.size() + 1);
+    std::uint64_t next = 0;
+    for (auto symbol : model.symbols) {
+        Canonical::serialize_gamma(output, symbol - next + 1);
+        next = symbol + 1;
+    }
+    for (auto length : model.lengths) {
+        output.put_bits(length, length_width);
+    }
+}
+
+Symbols::Model Symbols::deserialize_model(BitStream::ibitstream& input) {
+    Model model;
+    const auto kind = input.peek_bits(2);
+    input.consume(2);
+    if (kind > static_cast<std::uint8_t>(Kind::utf8)) {
+        ::invalid_file();
+    }
+    model.kind = static_cast<Kind>(kind);
+    const auto direct = ::direct_size(model.kind);
+    const auto count = ::deserialize_gamma(input) - 1;
+    if (count > max_symbols) {
+        ::invalid_file();
+    }
+    std::uint64_t next = 0;
+    for (std::uint64_t i = 0; i < count; i++) {
+        const auto symbol = next + ::deserialize_gamma(input) - 1;
+        ::check_invalid_file(input);
+        if (symbol >= direct) {
+            ::invalid_file();
+        }
+        model.symbols.push_back(static_cast<char32_t>(symbol));
+        next = symbol + 1;
+    }
+    for (std::uint64_t i = 0; i <= count; i++) {
+        const auto length =
+            static_cast<std::uint8_t>(input.peek_bits(length_width));
+        input.consume(length_width);
+        if (length > Huffman::max_code_length) {
+            ::invalid_file();
+        }
+        model.lengths.push_back(length);
+    }
+    ::check_invalid_file(input);
+    if (!Canonical::is_complete(model.lengths)) {
+        ::invalid_file();
+    }
+    return model;
+}
+
+// Canonical codes of `lengths`, in order; a lone code takes no bits
+static std::vector<Code> canonical_codes(
+    const std::vector<std::uint8_t>& lengths) {
+    std::vector<Code> codes(lengths.size(), Code{0, Code::none});
+    const bool lone = Canonical::count_codes(lengths) == 1;
+    Canonical::for_each_code(lengths, [&codes, lone](std::size_t index,
+                                                     std::uint64_t code,
+                                                     std::uint8_t length) {
+        codes[index] = lone ? Code{0, 0} : Code{code, length};
+    });
+    return codes;
+}
+
+template <typename Symbol>
+static void encode(std::span<const Symbols::character_type> block,
+                   BitStream::obitstream& output,
+                   const Symbols::Model& model) {
+    using Alphabet = Symbols::Alphabet<Symbol>;
+    const auto codes = ::canonical_codes(model.lengths);
+    const auto escape = codes.back();
+    std::vector<Code> direct(Alphabet::direct_size, Code{0, Code::none});
+    for (std::size_t index = 0; index < model.symbols.size(); index++) {
+        direct[model.symbols[index]] = codes[index];
+    }
+    const auto parsed = ::for_each_symbol<Symbol>(block, [&](Symbol symbol) {
+        if (symbol < Alphabet::direct_size &&
+            direct[symbol].length != Code::none) {
+            output.put_bits(direct[symbol].code, direct[symbol].length);
+            return;
+        }
+        if (escape.length == Code::none) {
+            throw std::invalid_argument("Symbol is neither coded nor escaped");
+        }
+        output.put_bits(escape.code, escape.length);
+        output.put_bits(symbol, Alphabet::raw_bits);
+    });
+    for (auto letter : block.subspan(parsed)) {
+        output.put_bits(static_cast<std::uint8_t>(letter), 8);
+    }
+}
+
+void Symbols::serialize_text(std::span<const character_type> block,
+                             BitStream::obitstream& output,
+                             const Model& model) {
+    ::with_symbol_type(model.kind, [&](auto symbol) {
+        ::encode<decltype(symbol)>(block, output, model);
+    });
+}
+
+template <typename Symbol>
+static void decode(BitStream::ibitstream& input,
+                   std::span<Symbols::character_type> block,
+                   const Symbols::Model& model) {
+    using Alphabet = Symbols::Alphabet<Symbol>;
+    // Resolves codes to their index in the model's lengths
+    const auto decoder =
+        Canonical::generate_decode_table<std::uint16_t, max_codes>(
+            model.lengths);
+    const auto escape = model.symbols.size();
+    std::size_t position = 0;
+    // Running past the end only yields padding, so checking once suffices
+    while (block.size() - position >= Alphabet::unit) {
+        const auto index = Canonical::decode(input, decoder);
+        Symbol symbol;
+        if (index == escape) {
+            symbol = static_cast<Symbol>(input.peek_bits(Alphabet::raw_bits));
+            input.consume(Alphabet::raw_bits);
+        } else {
+            symbol = static_cast<Symbol>(model.symbols[index]);
+        }
+        const auto size = Alphabet::write(symbol, block.subspan(position));
+        if (size == 0) {
+            ::invalid_file();
+        }
+        position += size;
+    }
+    for (auto& letter : block.subspan(position)) {
+        letter = static_cast<Symbols::character_type>(input.peek_bits(8));
+        input.consume(8);
+    }
+    ::check_invalid_file(input);
+}
+
+void Symbols::deserialize_text(BitStream::ibitstream& input,
+                               std::span<character_type> block,
+                               const Model& model) {
+    ::with_symbol_type(model.kind, [&](auto symbol) {
+        ::decode<decltype(symbol)>(input, block, model);
+    });
+}
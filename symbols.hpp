@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "bitstream.hpp"
+#include "huffman.hpp"
+
+// Wider alphabets: a block read as 16-bit units or as UTF-8 code points is
+// coded one symbol at a time rather than one byte at a time, so that a CJK
+// letter or a UTF-16 unit takes one code instead of two or three. A block
+// gives codes only to the symbols it repeats; the others are escaped, an
+// escape code followed by the symbol's `raw_bits` bits.
+namespace Symbols {
+
+using character_type = Huffman::character_type;
+
+enum class Kind : std::uint8_t {
+    bytes = 0,
+    // 16-bit little-endian units, such as UTF-16 text
+    units16 = 1,
+    // UTF-8 code points; bytes outside valid sequences are symbols of their
+    // own
+    utf8 = 2,
+};
+
+// Symbols with a code of their own per block at most, besides the escape
+constexpr std::size_t max_symbols = 1 << 14;
+
+// How symbols are read from and written to bytes, specialized for bytes,
+// 16-bit units and code points. Only symbols below `direct_size` may get a
+// code of their own; the others are always escaped.
+template <typename Symbol>
+struct Alphabet;
+
+template <>
+struct Alphabet<std::uint8_t> {
+    static constexpr Kind kind = Kind::bytes;
+    // Bytes every symbol takes at least
+    static constexpr std::size_t unit = 1;
+    static constexpr std::uint8_t raw_bits = 8;
+    static constexpr std::size_t direct_size = 1 << 8;
+
+    // Reads the symbol `bytes` start with, given at least `unit` bytes, and
+    // returns the bytes it takes
+    static std::size_t read(std::span<const character_type> bytes,
+                            std::uint8_t& symbol);
+    // Writes `symbol` at the start of `bytes` and returns the bytes it
+    // takes, or 0 if it does not fit or is no symbol
+    static std::size_t write(std::uint8_t symbol,
+                             std::span<character_type> bytes);
+};
+
+template <>
+struct Alphabet<char16_t> {
+    static constexpr Kind kind = Kind::units16;
+    static constexpr std::size_t unit = 2;
+    static constexpr std::uint8_t raw_bits = 16;
+    static constexpr std::size_t direct_size = 1 << 16;
+
+    static std::size_t read(std::span<const character_type> bytes,
+                            char16_t& symbol);
+    static std::size_t write(char16_t symbol, std::span<character_type> bytes);
+};
+
+// Invalid bytes are read as `invalid_byte` plus their value. Code points
+// outside the basic multilingual plane are always escaped.
+template <>
+struct Alphabet<char32_t> {
+    static constexpr Kind kind = Kind::utf8;
+    static constexpr std::size_t unit = 1;
+    static constexpr std::uint8_t raw_bits = 21;
+    static constexpr std::size_t direct_size = 1 << 16;
+    static constexpr char32_t invalid_byte = 0x110000;
+
+    static std::size_t read(std::span<const character_type> bytes,
+                            char32_t& symbol);
+    static std::size_t write(char32_t symbol, std::span<character_type> bytes);
+};
+
+// Code of one block
+struct Model {
+    Kind kind = Kind::bytes;
+    // Symbols with a code of their own, ascending
+    std::vector<char32_t> symbols;
+    // Code lengths of `symbols`, then of the escape; 0 marks an escape the
+    // block does not use
+    std::vector<std::uint8_t> lengths;
+    // Size of the codes in bits, escaped symbols and trailing bytes
+    // included, and symbols coded with each code length; left empty by
+    // deserialize_model
+    std::uint64_t code_bits = 0;
+    std::array<std::uint64_t, Huffman::max_code_length + 1> code_lengths{};
+};
+
+// Reads `block` as symbols of `kind` and builds its code. Bytes left over
+// past the last whole symbol are stored as they are.
+Model build_model(std::span<const character_type> block, Kind kind,
+                  std::uint8_t max_length = Huffman::max_code_length);
+
+// Writes the kind in 2 bits, the symbol count plus one and the gaps between
+// successive symbols as Elias gamma codes, the first symbol counting from
+// -1, then every code length in 6 bits, the escape's last
+void serialize_model(BitStream::obitstream& output, const Model& model);
+
+Model deserialize_model(BitStream::ibitstream& input);
+
+// Codes the symbols of `block`, then its bytes left over as they are
+void serialize_text(std::span<const character_type> block,
+                    BitStream::obitstream& output, const Model& model);
+
+// Decodes exactly `block.size()` bytes
+void deserialize_text(BitStream::ibitstream& input,
+                      std::span<character_type> block, const Model& model);
+}  // namespace Symbols
@@ -0,0 +1,114 @@
+#include "archive.hpp"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+using character_type = Archive::character_type;
+
+static void write_file(const string& filename, const string& contents) {
+    basic_ofstream<character_type> output(filename, ios::binary);
+    output.write(contents.data(), contents.size());
+}
+
+static string archive(const vector<string>& files,
+                      const Container::Options& options) {
+    basic_ostringstream<character_type> output;
+    Archive::create(files, output, options);
+    return output.str();
+}
+
+static string decompress(basic_istream<character_type>& container) {
+    basic_ostringstream<character_type> output;
+    Container::decompress(container, output);
+    return output.str();
+}
+
+TEST(Archive, Members) {
+    // Many small members and a few larger ones
+    mt19937 generator(1);
+    geometric_distribution<int> letter(0.1);
+    vector<string> files;
+    vector<string> contents;
+    for (size_t i = 0; i < 40; i++) {
+        string text(i % 10 == 0 ? 100000 : i * 37, '\0');
+        for (auto& c : text) {
+            c = static_cast<character_type>('a' + letter(generator));
+        }
+        files.push_back("archive.member" + to_string(i));
+        write_file(files.back(), text);
+        contents.push_back(std::move(text));
+    }
+
+    const auto single = archive(files, {.block_size = 4096, .threads = 1});
+    for (size_t threads : {2, 8}) {
+        SCOPED_TRACE("Threads: " + to_string(threads));
+        EXPECT_EQ(archive(files, {.block_size = 4096, .threads = threads}),
+                  single);
+    }
+
+    basic_istringstream<character_type> input(single);
+    ASSERT_TRUE(Archive::is_archive(input));
+    const auto directory = Archive::read_directory(input);
+    ASSERT_EQ(directory.size(), files.size());
+    for (size_t i = files.size(); i-- > 0;) {
+        SCOPED_TRACE("Member: " + files[i]);
+        const auto& member = Archive::find_member(directory, files[i]);
+        EXPECT_EQ(member.size, contents[i].size());
+        Archive::MemberInput container(input, member);
+        EXPECT_EQ(decompress(container), contents[i]);
+        if (contents[i].size() > 1000) {
+            Archive::MemberInput range(input, member);
+            basic_ostringstream<character_type> output;
+            Container::extract(range, output, 500, 1000, 2);
+            EXPECT_EQ(output.str(), contents[i].substr(500, 1000));
+        }
+    }
+    EXPECT_THROW(Archive::find_member(directory, "missing"), ios::failure);
+}
+
+TEST(Archive, SpilledMembers) {
+    // Containers larger than `spill_size` wait in temporary files
+    mt19937 generator(2);
+    uniform_int_distribution<int> letter(0, 255);
+    vector<string> files;
+    vector<string> contents;
+    for (size_t size : {3 * Archive::spill_size, size_t(5000),
+                        Archive::spill_size + 1}) {
+        string text(size, '\0');
+        for (auto& c : text) {
+            c = static_cast<character_type>(letter(generator));
+        }
+        files.push_back("archive.spilled" + to_string(files.size()));
+        write_file(files.back(), text);
+        contents.push_back(std::move(text));
+    }
+    const auto archived = archive(files, {.threads = 3});
+    basic_istringstream<character_type> input(archived);
+    const auto directory = Archive::read_directory(input);
+    ASSERT_EQ(directory.size(), files.size());
+    EXPECT_GT(directory[0].compressed_size, Archive::spill_size);
+    for (size_t i = 0; i < files.size(); i++) {
+        SCOPED_TRACE("Member: " + files[i]);
+        Archive::MemberInput container(input, directory[i]);
+        EXPECT_EQ(decompress(container), contents[i]);
+    }
+}
+
+TEST(Archive, InvalidArchives) {
+    write_file("archive.small", "small");
+    const auto archived = archive({"archive.small"}, {});
+    for (const auto& bytes :
+         {string(), string("HUFA"), archived.substr(0, archived.size() - 1),
+          "HUFB" + archived.substr(4)}) {
+        basic_istringstream<character_type> input(bytes);
+        EXPECT_THROW(Archive::read_directory(input), ios::failure);
+    }
+    EXPECT_THROW(archive({"archive.missing"}, {}), ios::failure);
+}
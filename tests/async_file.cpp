@@ -0,0 +1,116 @@
+#include "async_file.hpp"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+using character_type = AsyncFile::character_type;
+using AsyncFile::Backend;
+
+static void write_file(const string& filename, const string& contents) {
+    basic_ofstream<character_type> output(filename, ios::binary);
+    output.write(contents.data(), contents.size());
+}
+
+static string read_file(const string& filename) {
+    basic_ifstream<character_type> input(filename, ios::binary);
+    return string(istreambuf_iterator<character_type>(input), {});
+}
+
+// Spans several chunks and ends inside one
+static string contents() {
+    string text(3 * AsyncFile::chunk_size + 12345, '\0');
+    for (size_t i = 0; i < text.size(); i++) {
+        text[i] = static_cast<character_type>(i * 31 % 251);
+    }
+    return text;
+}
+
+TEST(AsyncFileInput, Contents) {
+    const auto text = contents();
+    write_file("async_file.input", text);
+    for (auto backend : {Backend::blocking, Backend::io_uring}) {
+        AsyncFile::Input input("async_file.input", backend);
+        ASSERT_TRUE(input);
+        if (backend == Backend::blocking) {
+            EXPECT_EQ(input.backend(), Backend::blocking);
+        }
+        // Odd sizes straddle the chunks
+        string read;
+        string part(777777, '\0');
+        while (input.read(part.data(), part.size()) || input.gcount() > 0) {
+            read.append(part.data(), input.gcount());
+        }
+        EXPECT_EQ(read, text);
+    }
+    EXPECT_FALSE(AsyncFile::Input("async_file.missing"));
+}
+
+TEST(AsyncFileInput, Pipe) {
+    int ends[2];
+    ASSERT_EQ(pipe(ends), 0);
+    const string text = "streamed through a pipe";
+    thread writer([&] {
+        for (int i = 0; i < 1000; i++) {
+            EXPECT_EQ(write(ends[1], text.data(), text.size()),
+                      static_cast<ssize_t>(text.size()));
+        }
+        close(ends[1]);
+    });
+    string read;
+    {
+        AsyncFile::Input input(ends[0]);
+        EXPECT_EQ(input.backend(), Backend::blocking);
+        read.assign(istreambuf_iterator<character_type>(input), {});
+    }
+    writer.join();
+    close(ends[0]);
+    EXPECT_EQ(read.size(), 1000 * text.size());
+    EXPECT_EQ(read.substr(0, text.size()), text);
+}
+
+TEST(AsyncFileOutput, Contents) {
+    const auto text = contents();
+    for (auto backend : {Backend::blocking, Backend::io_uring}) {
+        write_file("async_file.output", text + "previous contents, gone");
+        {
+            AsyncFile::Output output("async_file.output", backend);
+            ASSERT_TRUE(output);
+            // Flushing in the middle hands over a partial chunk
+            output.write(text.data(), 1000);
+            output.flush();
+            output.write(text.data() + 1000, text.size() - 1000);
+            output.close();
+        }
+        EXPECT_EQ(read_file("async_file.output"), text);
+    }
+}
+
+TEST(AsyncFileOutput, ShortWrites) {
+    // What io_uring leaves unwritten is written after the part it wrote
+    const auto text = contents();
+    AsyncFile::limit_ring_writes(1000);
+    {
+        AsyncFile::Output output("async_file.output");
+        ASSERT_TRUE(output);
+        output.write(text.data(), text.size());
+        output.close();
+    }
+    AsyncFile::limit_ring_writes(0);
+    EXPECT_EQ(read_file("async_file.output"), text);
+}
+
+TEST(AsyncFileOutput, Errors) {
+    EXPECT_FALSE(AsyncFile::Output("async_file.missing/output"));
+    // Writes that fail surface once the stream is closed at the latest
+    AsyncFile::Output full("/dev/full");
+    ASSERT_TRUE(full);
+    full.write("lost", 4);
+    EXPECT_THROW(full.close(), ios::failure);
+}
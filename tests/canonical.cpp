@@ -0,0 +1,93 @@
+#include "canonical.hpp"
+
+#include <gtest/gtest.h>
+
+#include <ios>
+#include <vector>
+
+using namespace std;
+
+using character_type = BitStream::character_type;
+
+TEST(Canonical, Gamma) {
+    const vector<uint64_t> values = {1, 2, 3, 255, 256, 1 << 20, 0xFFFFFFFF};
+    vector<character_type> bytes;
+    {
+        BitStream::obitstream output(bytes);
+        for (auto value : values) {
+            Canonical::serialize_gamma(output, value);
+        }
+    }
+    BitStream::ibitstream input{span<const character_type>(bytes)};
+    for (auto value : values) {
+        EXPECT_EQ(Canonical::deserialize_gamma(input, 32), value);
+    }
+
+    BitStream::ibitstream narrow{span<const character_type>(bytes)};
+    for (size_t i = 0; i < 3; i++) {
+        Canonical::deserialize_gamma(narrow, 8);
+    }
+    EXPECT_EQ(Canonical::deserialize_gamma(narrow, 8), 255u);
+    EXPECT_THROW(Canonical::deserialize_gamma(narrow, 8), ios::failure);
+}
+
+TEST(Canonical, Codes) {
+    const vector<uint8_t> lengths = {2, 1, 0, 3, 3};
+    vector<tuple<size_t, uint64_t, uint8_t>> codes;
+    Canonical::for_each_code(
+        lengths, [&codes](size_t index, uint64_t code, uint8_t length) {
+            codes.emplace_back(index, code, length);
+        });
+    const vector<tuple<size_t, uint64_t, uint8_t>> expected = {
+        {0, 0b10, 2}, {1, 0b0, 1}, {3, 0b110, 3}, {4, 0b111, 3}};
+    EXPECT_EQ(codes, expected);
+
+    EXPECT_TRUE(Canonical::is_complete(lengths));
+    EXPECT_TRUE(Canonical::is_complete(vector<uint8_t>{0, 5, 0}));
+    EXPECT_TRUE(Canonical::is_complete(vector<uint8_t>{0, 0}));
+    EXPECT_FALSE(Canonical::is_complete(vector<uint8_t>{1, 2}));
+    EXPECT_FALSE(Canonical::is_complete(vector<uint8_t>(1000, 1)));
+    EXPECT_EQ(Canonical::count_codes(lengths), 4u);
+}
+
+// Symbols past the byte range, with codes longer than a lookup resolves
+TEST(Canonical, DecodeTable) {
+    constexpr size_t size = 5000;
+    constexpr size_t codes = 20;
+    vector<uint8_t> lengths(size);
+    for (size_t i = 0; i < codes; i++) {
+        lengths[i * 251] = static_cast<uint8_t>(min(i + 1, codes - 1));
+    }
+    ASSERT_TRUE(Canonical::is_complete(lengths));
+    const auto table =
+        Canonical::generate_decode_table<uint16_t, size>(lengths);
+    EXPECT_GT(table.max_length, table.lookup_bits);
+
+    vector<uint16_t> text;
+    vector<character_type> bytes;
+    {
+        BitStream::obitstream output(bytes);
+        Canonical::for_each_code(
+            lengths, [&](size_t index, uint64_t code, uint8_t length) {
+                text.push_back(static_cast<uint16_t>(index));
+                output.put_bits(code, length);
+            });
+    }
+    BitStream::ibitstream input{span<const character_type>(bytes)};
+    for (auto symbol : text) {
+        EXPECT_EQ(Canonical::decode(input, table), symbol);
+    }
+    EXPECT_TRUE(input);
+}
+
+TEST(Canonical, LoneCode) {
+    vector<uint8_t> lengths(300);
+    lengths[299] = 1;
+    const auto table = Canonical::generate_decode_table<uint16_t, 300>(lengths);
+    const vector<character_type> bytes = {'\xFF'};
+    BitStream::ibitstream input{span<const character_type>(bytes)};
+    for (size_t i = 0; i < 100; i++) {
+        EXPECT_EQ(Canonical::decode(input, table), 299);
+    }
+    EXPECT_EQ(input.peek_bits(8), 0xFFu);
+}
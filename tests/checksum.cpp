@@ -0,0 +1,49 @@
+#include "checksum.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+#include <string>
+
+using namespace std;
+
+using character_type = Checksum::character_type;
+
+// Bit by bit, straight from the definition
+static uint32_t reference(const string& data) {
+    uint32_t crc = ~0u;
+    for (auto letter : data) {
+        crc ^= static_cast<uint8_t>(letter);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc >> 1 ^ (crc & 1 ? 0x82F63B78 : 0);
+        }
+    }
+    return ~crc;
+}
+
+TEST(Checksum, KnownValues) {
+    EXPECT_EQ(Checksum::crc32c(string()), 0);
+    EXPECT_EQ(Checksum::crc32c(string("123456789")), 0xE3069283);
+    EXPECT_EQ(Checksum::crc32c(string(32, '\0')), 0x8A9136AA);
+}
+
+TEST(Checksum, Reference) {
+    mt19937 generator(1);
+    uniform_int_distribution<int> byte(0, 255);
+    string data(10007, '\0');
+    for (auto& letter : data) {
+        letter = static_cast<character_type>(byte(generator));
+    }
+    // Every alignment and tail length
+    for (size_t size : {1, 7, 8, 9, 15, 16, 17, 1000, 10007}) {
+        for (size_t offset = 0; offset < 8 && offset + size <= 10007;
+             offset++) {
+            const auto slice = data.substr(offset, size);
+            EXPECT_EQ(Checksum::crc32c(slice), reference(slice));
+        }
+    }
+    // Checksums continue across pieces
+    const auto first = Checksum::crc32c(data.substr(0, 4321));
+    EXPECT_EQ(Checksum::crc32c(data.substr(4321), first), reference(data));
+}
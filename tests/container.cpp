@@ -0,0 +1,575 @@
+#include "container.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+using character_type = Container::character_type;
+
+static string random_text(size_t size, double p, unsigned seed) {
+    mt19937 generator(seed);
+    geometric_distribution<int> distribution(p);
+    string text(size, '\0');
+    for (auto& letter : text) {
+        letter = static_cast<character_type>(distribution(generator));
+    }
+    return text;
+}
+
+static string compress(const string& text, const Container::Options& options,
+                       Container::Stats* stats = nullptr) {
+    basic_istringstream<character_type> input(text);
+    basic_ostringstream<character_type> output;
+    const auto result = Container::compress(input, output, options);
+    if (stats != nullptr) {
+        *stats = result;
+    }
+    return output.str();
+}
+
+static string decompress(const string& compressed,
+                         const Container::Dictionary* dictionary = nullptr) {
+    basic_istringstream<character_type> input(compressed);
+    basic_ostringstream<character_type> output;
+    Container::decompress(input, output, 1, dictionary);
+    return output.str();
+}
+
+struct ContainerParam {
+    string name;
+    string text;
+};
+
+class ContainerTesting : public testing::TestWithParam<ContainerParam> {
+   public:
+    ~ContainerTesting() override {}
+};
+
+TEST_P(ContainerTesting, RoundTrip) {
+    const auto& text = GetParam().text;
+    for (size_t block_size : {1, 7, 4096, 1 << 20}) {
+        SCOPED_TRACE("Block size: " + to_string(block_size));
+        Container::Stats stats;
+        const auto compressed =
+            compress(text, {.block_size = block_size, .threads = 2}, &stats);
+        EXPECT_EQ(stats.input_size, text.size());
+        EXPECT_EQ(stats.output_size, compressed.size());
+        EXPECT_EQ(stats.blocks, (text.size() + block_size - 1) / block_size);
+        EXPECT_EQ(decompress(compressed), text);
+    }
+}
+
+TEST_P(ContainerTesting, Deterministic) {
+    const auto& text = GetParam().text;
+    const auto single = compress(text, {.block_size = 1000, .threads = 1});
+    for (size_t threads : {2, 3, 8}) {
+        SCOPED_TRACE("Threads: " + to_string(threads));
+        EXPECT_EQ(compress(text, {.block_size = 1000, .threads = threads}),
+                  single);
+    }
+}
+
+TEST_P(ContainerTesting, LimitedLengths) {
+    const auto& text = GetParam().text;
+    Container::Stats stats;
+    const auto compressed =
+        compress(text, {.threads = 2, .max_length = 9}, &stats);
+    EXPECT_GE(stats.code_bits, stats.optimal_bits);
+    EXPECT_EQ(decompress(compressed), text);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ContainerSuite, ContainerTesting,
+    testing::Values(
+        ContainerParam{"empty", ""}, ContainerParam{"single", "x"},
+        ContainerParam{"repeated", string(10000, 'a')},
+        ContainerParam{"all_bytes",
+                       [] {
+                           string text;
+                           for (int i = 0; i < 256 * 4; i++) {
+                               text += static_cast<character_type>(i);
+                           }
+                           return text;
+                       }()},
+        ContainerParam{"skewed", random_text(100000, 0.2, 1)},
+        ContainerParam{"uniform", random_text(50000, 0.001, 2)}),
+    [](const auto& info) { return info.param.name; });
+
+TEST(ContainerFormat, InterleavedStreams) {
+    const auto text = random_text(100003, 0.1, 6);
+    const auto single = compress(text, {.streams = 1});
+    const size_t max_streams = Container::max_streams;
+    for (size_t streams : {size_t{2}, size_t{3}, size_t{8}, max_streams}) {
+        SCOPED_TRACE("Streams: " + to_string(streams));
+        const size_t min_block = Container::min_interleaved_block;
+        for (size_t block_size : {min_block, size_t{1} << 20}) {
+            const auto compressed = compress(
+                text, {.block_size = block_size, .streams = streams});
+            EXPECT_EQ(decompress(compressed), text);
+        }
+        // Each extra stream costs a size and at most a byte of padding
+        EXPECT_LE(compress(text, {.streams = streams}).size(),
+                  single.size() + 6 * streams);
+    }
+}
+
+TEST(ContainerMemory, RoundTrip) {
+    const auto text = random_text(300000, 0.05, 7);
+    for (size_t block_size : {1000, 1 << 20}) {
+        SCOPED_TRACE("Block size: " + to_string(block_size));
+        const Container::Options options{.block_size = block_size,
+                                         .threads = 3};
+        basic_ostringstream<character_type> output;
+        Container::compress(span(text.data(), text.size()), output, options);
+        const auto compressed = output.str();
+        EXPECT_EQ(compressed, compress(text, options));
+
+        const span input(compressed.data(), compressed.size());
+        ASSERT_EQ(Container::decompressed_size(input), text.size());
+        string decompressed(text.size(), '\0');
+        Container::decompress(input, span(decompressed), 3);
+        EXPECT_EQ(decompressed, text);
+        EXPECT_THROW(Container::decompress(input, span(decompressed).first(
+                                                      text.size() - 1)),
+                     ios::failure);
+        EXPECT_THROW(
+            Container::decompressed_size(input.first(input.size() / 2)),
+            ios::failure);
+    }
+}
+
+TEST(ContainerFormat, Stats) {
+    const auto text = random_text(200000, 0.05, 9);
+    Container::Stats stats;
+    const auto compressed = compress(text, {.block_size = 50000}, &stats);
+    EXPECT_LE(stats.entropy_bits, stats.optimal_bits);
+    EXPECT_LE(stats.optimal_bits, stats.code_bits);
+    EXPECT_EQ(stats.huffman_bits, stats.code_bits);
+    EXPECT_EQ(stats.huffman_optimal_bits, stats.optimal_bits);
+    EXPECT_GT(stats.header_size, 0);
+    EXPECT_LT(stats.header_size, compressed.size() - stats.code_bits / 8);
+    uint64_t letters = 0;
+    for (auto count : stats.code_lengths) {
+        letters += count;
+    }
+    EXPECT_EQ(letters, text.size());
+
+    basic_istringstream<character_type> input(compressed);
+    basic_ostringstream<character_type> output;
+    const auto decoded = Container::decompress(input, output);
+    EXPECT_EQ(decoded.input_size, text.size());
+    EXPECT_EQ(decoded.output_size, compressed.size());
+    EXPECT_EQ(decoded.blocks, 4);
+}
+
+TEST(ContainerFormat, ContextBlocks) {
+    // Letters mostly follow from the one before, which an order-1 model
+    // codes in far fewer bits
+    mt19937 generator(12);
+    geometric_distribution<int> step(0.3);
+    string text(300000, '\0');
+    int previous = 0;
+    for (auto& letter : text) {
+        previous = (previous * 5 + 3 + step(generator)) % 64;
+        letter = static_cast<character_type>(' ' + previous);
+    }
+    Container::Stats stats;
+    const auto compressed = compress(
+        text, {.block_size = 100000, .threads = 2, .contexts = true}, &stats);
+    EXPECT_LT(compressed.size(), compress(text, {}).size() * 3 / 4);
+    EXPECT_LE(stats.entropy_bits, 3 * 8.0 * text.size());
+    // The order-1 codes beat the order-0 bound, which only the Huffman
+    // blocks are held to
+    EXPECT_LT(stats.code_bits, stats.optimal_bits);
+    EXPECT_LE(stats.huffman_optimal_bits, stats.huffman_bits);
+    EXPECT_EQ(decompress(compressed), text);
+    basic_istringstream<character_type> input(compressed);
+    basic_ostringstream<character_type> output;
+    Container::extract(input, output, 150000, 100000, 2);
+    EXPECT_EQ(output.str(), text.substr(150000, 100000));
+}
+
+TEST(ContainerFormat, SymbolBlocks) {
+    // CJK letters take three bytes in UTF-8 but a single symbol, while the
+    // ASCII half is better left to byte codes
+    mt19937 generator(13);
+    geometric_distribution<int> rank(0.005);
+    string text;
+    while (text.size() < 200000) {
+        const char32_t letter = 0x4E00 + rank(generator) % 0x5000;
+        array<character_type, 4> bytes;
+        text.append(bytes.data(),
+                    Symbols::Alphabet<char32_t>::write(letter, bytes));
+    }
+    text += random_text(100000, 0.2, 14);
+    const auto compressed = compress(
+        text,
+        {.block_size = 100000, .threads = 2, .symbols = Symbols::Kind::utf8});
+    EXPECT_LT(compressed.size(), compress(text, {}).size() * 3 / 4);
+    EXPECT_EQ(decompress(compressed), text);
+    basic_istringstream<character_type> input(compressed);
+    basic_ostringstream<character_type> output;
+    Container::extract(input, output, 150000, 100000, 2);
+    EXPECT_EQ(output.str(), text.substr(150000, 100000));
+}
+
+TEST(ContainerFormat, SortedBlocks) {
+    // Words repeat, which block sorting turns into runs
+    mt19937 generator(15);
+    geometric_distribution<int> rank(0.02);
+    vector<string> words;
+    for (size_t i = 0; i < 300; i++) {
+        words.push_back(random_text(3 + i % 6, 0.15, 100 + i));
+    }
+    string text;
+    while (text.size() < 300000) {
+        text += words[rank(generator) % words.size()] + ' ';
+    }
+    Container::Stats stats;
+    const auto compressed = compress(
+        text, {.block_size = 100000, .threads = 2, .sort_blocks = true},
+        &stats);
+    EXPECT_LT(compressed.size(), compress(text, {}).size() / 2);
+    EXPECT_GT(stats.timings.transform.count(), 0);
+    EXPECT_EQ(decompress(compressed), text);
+    basic_istringstream<character_type> input(compressed);
+    basic_ostringstream<character_type> output;
+    Container::extract(input, output, 150000, 100000, 2);
+    EXPECT_EQ(output.str(), text.substr(150000, 100000));
+}
+
+TEST(ContainerFormat, Lz77Blocks) {
+    // Lines repeat far apart, which a single table cannot make use of
+    vector<string> lines;
+    for (size_t i = 0; i < 200; i++) {
+        lines.push_back(random_text(40 + i % 30, 0.1, 200 + i) + '\n');
+    }
+    mt19937 generator(16);
+    uniform_int_distribution<size_t> line(0, lines.size() - 1);
+    string text;
+    while (text.size() < 300000) {
+        text += lines[line(generator)];
+    }
+    Container::Stats stats;
+    const auto compressed = compress(
+        text, {.block_size = 100000, .threads = 2, .lz77 = 4}, &stats);
+    EXPECT_LT(compressed.size(), compress(text, {}).size() / 4);
+    EXPECT_GT(stats.timings.transform.count(), 0);
+    EXPECT_EQ(decompress(compressed), text);
+    basic_istringstream<character_type> input(compressed);
+    basic_ostringstream<character_type> output;
+    Container::extract(input, output, 150000, 100000, 2);
+    EXPECT_EQ(output.str(), text.substr(150000, 100000));
+}
+
+TEST(ContainerFormat, StoredBlocks) {
+    const auto text = random_text(1 << 16, 0.0001, 3);
+    Container::Stats stats;
+    const auto compressed = compress(text, {.index = false}, &stats);
+    EXPECT_LE(compressed.size(), text.size() + 32);
+    EXPECT_EQ(decompress(compressed), text);
+}
+
+TEST(ContainerFormat, InvalidFiles) {
+    EXPECT_THROW(decompress(""), ios::failure);
+    EXPECT_THROW(decompress("Not a container at all"), ios::failure);
+    const auto compressed = compress(random_text(10000, 0.1, 4), {});
+    EXPECT_THROW(decompress(compressed.substr(0, compressed.size() / 2)),
+                 ios::failure);
+}
+
+TEST(ContainerFormat, CorruptSizes) {
+    // The header's block size at byte 5, then the first block's size, mode
+    // and payload size at bytes 9, 13 and 14
+    const auto stored = compress(random_text(1 << 16, 0.0001, 3), {});
+    ASSERT_EQ(stored[13], 1);
+    const auto check = [](const string& corrupt) {
+        EXPECT_THROW(decompress(corrupt), ios::failure);
+        EXPECT_THROW(Container::verify(span<const character_type>(
+                         corrupt.data(), corrupt.size())),
+                     ios::failure);
+    };
+    for (uint32_t block_size : {0u, (1u << 31) + 1, ~0u}) {
+        SCOPED_TRACE("Block size: " + to_string(block_size));
+        auto corrupt = stored;
+        for (int i = 0; i < 4; i++) {
+            corrupt[5 + i] = static_cast<character_type>(block_size >> 8 * i);
+        }
+        check(corrupt);
+    }
+    // A stored block's payload is exactly its bytes, and no block's
+    // payload is larger
+    for (int difference : {-1, 1}) {
+        SCOPED_TRACE("Difference: " + to_string(difference));
+        auto corrupt = stored;
+        corrupt[14] = static_cast<character_type>(corrupt[14] + difference);
+        check(corrupt);
+    }
+    auto grown = compress(random_text(10000, 0.1, 4), {});
+    grown[17] = static_cast<character_type>(0x7F);
+    check(grown);
+}
+
+TEST(ContainerFormat, Checksums) {
+    const auto text = random_text(10000, 0.05, 17);
+    auto compressed = compress(text, {.block_size = 3000, .threads = 2});
+    basic_istringstream<character_type> indexed(compressed);
+    const auto index = Container::read_index(indexed);
+    ASSERT_EQ(index.size(), 4);
+    auto verification = Container::verify(span<const character_type>(
+        compressed.data(), compressed.size()));
+    EXPECT_TRUE(verification.checksums);
+    EXPECT_TRUE(verification.bad_blocks.empty());
+    EXPECT_EQ(verification.stats.input_size, text.size());
+    EXPECT_EQ(verification.stats.output_size, compressed.size());
+
+    // A flipped bit in the text of the second block is found there
+    const auto middle =
+        (index[1].compressed_offset + index[2].compressed_offset) / 2;
+    compressed[middle] ^= 1;
+    EXPECT_THROW(decompress(compressed), ios::failure);
+    basic_istringstream<character_type> input(compressed);
+    verification = Container::verify(input, 2);
+    ASSERT_EQ(verification.bad_blocks.size(), 1);
+    const auto& bad = verification.bad_blocks.front();
+    EXPECT_EQ(bad.compressed_offset, index[1].compressed_offset);
+    EXPECT_EQ(bad.uncompressed_offset, index[1].uncompressed_offset);
+    EXPECT_EQ(bad.size, index[1].size);
+    EXPECT_FALSE(bad.error.empty());
+    EXPECT_EQ(verification.stats.input_size, text.size() - bad.size);
+
+    const auto unchecked = compress(text, {.checksums = false});
+    EXPECT_EQ(unchecked.size(), compress(text, {}).size() - 4);
+    EXPECT_EQ(decompress(unchecked), text);
+    EXPECT_FALSE(Container::verify(span<const character_type>(
+                                       unchecked.data(), unchecked.size()))
+                     .checksums);
+}
+
+TEST(ContainerFormat, SampledTable) {
+    const auto text = random_text(300000, 0.05, 18);
+    const Container::Options options{
+        .block_size = 50000, .threads = 2, .sample = 20000};
+    Container::Stats stats;
+    const auto compressed = compress(text, options, &stats);
+    // Blocks still count their letters, for stats as exact as other modes'
+    EXPECT_GT(stats.entropy_bits, 0);
+    EXPECT_GE(stats.code_bits, stats.optimal_bits);
+    EXPECT_LE(stats.code_bits + 8 * stats.header_size,
+              8 * stats.output_size);
+    EXPECT_EQ(accumulate(stats.code_lengths.begin(), stats.code_lengths.end(),
+                         uint64_t{0}),
+              text.size());
+    EXPECT_GT(stats.exact_bits, 0);
+    EXPECT_LT(compressed.size(), compress(text, {}).size() * 101 / 100);
+    EXPECT_EQ(decompress(compressed), text);
+    basic_ostringstream<character_type> output;
+    Container::compress(span(text.data(), text.size()), output, options);
+    // Both sample the start of the first block
+    EXPECT_EQ(output.str(), compressed);
+    basic_istringstream<character_type> input(compressed);
+    basic_ostringstream<character_type> range;
+    Container::extract(input, range, 120000, 100000, 2);
+    EXPECT_EQ(range.str(), text.substr(120000, 100000));
+
+    // Letters the sample lacks still have codes, and blocks of them are
+    // stored rather than grown
+    const auto shifted = text.substr(0, 100000) + string(100000, 'z');
+    const auto grown = compress(shifted, options);
+    EXPECT_LT(grown.size(), shifted.size());
+    EXPECT_EQ(decompress(grown), shifted);
+
+    const auto dictionary = Container::train({});
+    EXPECT_THROW(compress(text, {.dictionary = &dictionary, .sample = 20000}),
+                 invalid_argument);
+}
+
+TEST(ContainerIndex, Extract) {
+    const auto text = random_text(50000, 0.05, 5);
+    const auto compressed = compress(text, {.block_size = 4096, .threads = 2});
+    auto extract = [&compressed](uint64_t offset, uint64_t length) {
+        basic_istringstream<character_type> input(compressed);
+        basic_ostringstream<character_type> output;
+        Container::extract(input, output, offset, length, 2);
+        return output.str();
+    };
+    for (auto [offset, length] :
+         {pair<uint64_t, uint64_t>{0, 10}, {4095, 2}, {4096, 4096},
+          {1234, 20000}, {49990, 100}, {60000, 5}, {0, UINT64_MAX}}) {
+        SCOPED_TRACE("Offset: " + to_string(offset) +
+                     ", length: " + to_string(length));
+        EXPECT_EQ(extract(offset, length),
+                  offset < text.size() ? text.substr(offset, length) : "");
+    }
+}
+
+TEST(ContainerIndex, SharedTables) {
+    // Small blocks of the same source mostly reuse their neighbour's table,
+    // so extracting has to follow tables from an earlier block
+    mt19937 generator(8);
+    discrete_distribution<int> distribution({20, 12, 9, 7, 6, 5, 4, 3, 2, 1});
+    string text(100000, '\0');
+    for (auto& letter : text) {
+        letter = static_cast<character_type>('a' + distribution(generator));
+    }
+    // Interleaved blocks keep their table behind the streams' sizes
+    for (size_t block_size : {1000, 1 << 14}) {
+        SCOPED_TRACE("Block size: " + to_string(block_size));
+        const Container::Options options{.block_size = block_size,
+                                         .threads = 3};
+        const auto compressed = compress(text, options);
+        auto fresh_options = options;
+        fresh_options.reuse_tables = false;
+        EXPECT_LT(compressed.size(), compress(text, fresh_options).size());
+        EXPECT_EQ(decompress(compressed), text);
+        for (uint64_t offset : {0, 999, 1000, 15500, 16000, 17001, 99999}) {
+            SCOPED_TRACE("Offset: " + to_string(offset));
+            basic_istringstream<character_type> input(compressed);
+            basic_ostringstream<character_type> output;
+            Container::extract(input, output, offset, 1500, 2);
+            EXPECT_EQ(output.str(), text.substr(offset, 1500));
+        }
+    }
+}
+
+// Counts the bytes read out of a string
+class CountingBuffer : public basic_stringbuf<character_type> {
+   public:
+    explicit CountingBuffer(const string& text)
+        : basic_stringbuf<character_type>(text, ios::in) {}
+
+    size_t read = 0;
+
+   protected:
+    streamsize xsgetn(character_type* data, streamsize count) override {
+        const auto got = basic_stringbuf<character_type>::xsgetn(data, count);
+        read += got;
+        return got;
+    }
+};
+
+TEST(ContainerIndex, ReadsOnlyWhatItNeeds) {
+    // Stored blocks never start tables, and need none from earlier blocks
+    const auto text = random_text(64 * 4096, 0.001, 20);
+    const auto compressed = compress(text, {.block_size = 4096});
+    for (uint64_t offset : {63 * 4096 + 10, 64 * 4096 + 10}) {
+        SCOPED_TRACE("Offset: " + to_string(offset));
+        CountingBuffer buffer(compressed);
+        basic_istream<character_type> input(&buffer);
+        basic_ostringstream<character_type> output;
+        Container::extract(input, output, offset, 100, 2);
+        EXPECT_EQ(output.str(), text.substr(min(offset, text.size()), 100));
+        EXPECT_LT(buffer.read, 2 * 4096 + 64 * 20 + 100);
+    }
+}
+
+TEST(ContainerIndex, Entries) {
+    const auto text = random_text(10000, 0.05, 6);
+    const auto compressed = compress(text, {.block_size = 3000});
+    basic_istringstream<character_type> input(compressed);
+    const auto index = Container::read_index(input);
+    ASSERT_EQ(index.size(), 4);
+    for (size_t i = 0; i < index.size(); i++) {
+        EXPECT_EQ(index[i].uncompressed_offset, 3000 * i);
+        EXPECT_EQ(index[i].size, min<size_t>(3000, text.size() - 3000 * i));
+    }
+    EXPECT_EQ(index[0].compressed_offset, 9);
+}
+
+TEST(ContainerIndex, CorruptFooter) {
+    const auto compressed =
+        compress(random_text(10000, 0.05, 19), {.block_size = 3000});
+    const auto count_at = compressed.size() - 8 - 8 - 4;
+    // 2^62 more entries take as many bytes as none once the product wraps
+    for (uint64_t extra : {uint64_t{1}, uint64_t{1} << 62, ~uint64_t{0}}) {
+        SCOPED_TRACE("Extra entries: " + to_string(extra));
+        auto corrupt = compressed;
+        uint64_t count = 0;
+        for (size_t i = 0; i < 8; i++) {
+            count |= uint64_t(uint8_t(corrupt[count_at + i])) << (8 * i);
+        }
+        count += extra;
+        for (size_t i = 0; i < 8; i++) {
+            corrupt[count_at + i] =
+                static_cast<character_type>(count >> (8 * i));
+        }
+        basic_istringstream<character_type> input(corrupt);
+        EXPECT_THROW(Container::read_index(input), ios::failure);
+    }
+}
+
+TEST(ContainerIndex, Unindexed) {
+    const auto text = random_text(10000, 0.05, 7);
+    const auto compressed = compress(text, {.index = false});
+    EXPECT_EQ(decompress(compressed), text);
+    basic_istringstream<character_type> input(compressed);
+    EXPECT_THROW(Container::read_index(input), ios::failure);
+}
+
+TEST(ContainerParallel, Decompress) {
+    const auto text = random_text(100000, 0.05, 8);
+    const auto compressed = compress(text, {.block_size = 1000, .threads = 4});
+    for (size_t threads : {1, 3, 8}) {
+        basic_istringstream<character_type> input(compressed);
+        basic_ostringstream<character_type> output;
+        Container::decompress(input, output, threads);
+        EXPECT_EQ(output.str(), text);
+    }
+}
+
+static string event(mt19937& generator) {
+    uniform_int_distribution<int> id(0, 99999);
+    const char* kinds[] = {"click", "view", "scroll", "purchase"};
+    return "{\"id\": " + to_string(id(generator)) + ", \"kind\": \"" +
+           kinds[id(generator) % 4] + "\"}\n";
+}
+
+TEST(ContainerDictionary, SmallInputs) {
+    mt19937 generator(10);
+    string samples;
+    while (samples.size() < 100000) {
+        samples += event(generator);
+    }
+    auto dictionary = Container::train(Histogram::count(span(samples)));
+    {
+        basic_ostringstream<character_type> output;
+        Container::write_dictionary(output, dictionary);
+        basic_istringstream<character_type> input(output.str());
+        const auto read = Container::read_dictionary(input);
+        EXPECT_EQ(read.id, dictionary.id);
+        EXPECT_EQ(read.lengths, dictionary.lengths);
+    }
+
+    const Container::Options options{.index = false,
+                                     .dictionary = &dictionary};
+    for (int i = 0; i < 10; i++) {
+        // Letters the samples lack have codes all the same
+        const auto text = event(generator) + (i % 2 ? "\x01\xff" : "");
+        SCOPED_TRACE("Text: " + text);
+        const auto compressed = compress(text, options);
+        EXPECT_LT(compressed.size(), compress(text, {.index = false}).size());
+        EXPECT_EQ(decompress(compressed, &dictionary), text);
+        EXPECT_THROW(decompress(compressed), ios::failure);
+    }
+
+    // Larger blocks still get tables of their own when those pay off
+    const auto text = random_text(200000, 0.2, 11) + samples;
+    const auto compressed = compress(text, {.block_size = 20000,
+                                            .threads = 2,
+                                            .dictionary = &dictionary});
+    EXPECT_EQ(decompress(compressed, &dictionary), text);
+    basic_istringstream<character_type> input(compressed);
+    basic_ostringstream<character_type> output;
+    Container::extract(input, output, 250000, 1000, 2, &dictionary);
+    EXPECT_EQ(output.str(), text.substr(250000, 1000));
+
+    auto other = dictionary;
+    other.id++;
+    EXPECT_THROW(decompress(compressed, &other), ios::failure);
+}
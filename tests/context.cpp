@@ -0,0 +1,80 @@
+#include "context.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+using character_type = Context::character_type;
+
+// Every letter mostly follows from the one before it
+static string markov_text(size_t size, size_t letters, unsigned seed) {
+    mt19937 generator(seed);
+    geometric_distribution<int> step(0.4);
+    string text(size, '\0');
+    size_t previous = 0;
+    for (auto& letter : text) {
+        previous = (previous * 7 + 1 + step(generator)) % letters;
+        letter = static_cast<character_type>('!' + previous);
+    }
+    return text;
+}
+
+static string round_trip(const string& text, const Context::Model& model) {
+    vector<character_type> bytes;
+    {
+        BitStream::obitstream output(bytes);
+        Context::serialize_model(output, model);
+        vector<Huffman::EncodeTable> tables;
+        for (const auto& lengths : model.tables) {
+            tables.push_back(Huffman::generate_encode_table(lengths));
+        }
+        Huffman::serialize_text(text, output,
+                                Context::by_context(model, tables));
+    }
+    BitStream::ibitstream input{span<const character_type>(bytes)};
+    const auto read = Context::deserialize_model(input);
+    EXPECT_EQ(read.groups, model.groups);
+    EXPECT_EQ(read.tables, model.tables);
+    vector<Huffman::DecodeTable> tables;
+    for (const auto& lengths : read.tables) {
+        tables.push_back(Huffman::generate_decode_table(lengths));
+    }
+    string decoded(text.size(), '\0');
+    Huffman::deserialize_text(input, span(decoded),
+                              Context::by_context(read, tables));
+    return decoded;
+}
+
+TEST(ContextModel, Groups) {
+    for (size_t letters : {3, 20, 90}) {
+        SCOPED_TRACE("Letters: " + to_string(letters));
+        const auto text = markov_text(200000, letters, letters);
+        const auto model = Context::build_model(text);
+        EXPECT_GE(model.tables.size(), 1);
+        EXPECT_LE(model.tables.size(), Context::max_groups);
+        const auto counts = Histogram::count(span(text));
+        EXPECT_LT(model.code_bits, Huffman::optimal_encoded_size(counts));
+        uint64_t coded = 0;
+        for (auto count : model.code_lengths) {
+            coded += count;
+        }
+        EXPECT_EQ(coded, text.size());
+        EXPECT_EQ(round_trip(text, model), text);
+    }
+}
+
+TEST(ContextModel, LoneLetters) {
+    // Every context is followed by a single letter, coded with no bits
+    string text;
+    for (int i = 0; i < 1000; i++) {
+        text += "abc";
+    }
+    const auto model = Context::build_model(text);
+    EXPECT_EQ(model.code_bits, 0);
+    EXPECT_EQ(round_trip(text, model), text);
+    EXPECT_EQ(round_trip("", Context::build_model("")), "");
+}
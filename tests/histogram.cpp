@@ -0,0 +1,76 @@
+#include "histogram.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+using character_type = Histogram::character_type;
+
+class HistogramTesting : public testing::TestWithParam<size_t> {
+   public:
+    ~HistogramTesting() override {}
+
+    void SetUp() override {
+        mt19937 generator(GetParam());
+        // Skewed towards small letters so some counters collide a lot
+        geometric_distribution<int> distribution(0.05);
+        text.resize(GetParam());
+        for (auto& letter : text) {
+            letter = static_cast<character_type>(distribution(generator));
+        }
+        expected.fill(0);
+        for (auto letter : text) {
+            ++expected[static_cast<uint8_t>(letter)];
+        }
+    }
+
+   public:
+    string text;
+    Histogram::CountTable expected;
+};
+
+TEST_P(HistogramTesting, Span) {
+    EXPECT_EQ(Histogram::count(span(text.data(), text.size())), expected);
+}
+
+TEST_P(HistogramTesting, Threads) {
+    for (size_t threads : {1, 2, 3, 8}) {
+        SCOPED_TRACE("Threads: " + to_string(threads));
+        EXPECT_EQ(Histogram::count(span(text.data(), text.size()), threads),
+                  expected);
+    }
+}
+
+TEST_P(HistogramTesting, Stream) {
+    basic_istringstream<character_type> input(text);
+    EXPECT_EQ(Histogram::count(input, 2), expected);
+}
+
+TEST_P(HistogramTesting, Total) {
+    EXPECT_EQ(Histogram::total(expected), text.size());
+}
+
+TEST_P(HistogramTesting, Sample) {
+    const span input(text.data(), text.size());
+    EXPECT_EQ(Histogram::sample(input, text.size()), expected);
+    const auto sampled = Histogram::sample(input, 5000);
+    EXPECT_EQ(Histogram::total(sampled), min<size_t>(5000, text.size()));
+}
+
+TEST(HistogramSample, Spread) {
+    // Halves of different letters are both sampled, in proportion
+    const string text = string(1 << 20, 'a') + string(1 << 20, 'b');
+    const auto sampled = Histogram::sample(span(text.data(), text.size()),
+                                           4 * Histogram::sample_slice);
+    EXPECT_EQ(Histogram::total(sampled), 4 * Histogram::sample_slice);
+    EXPECT_EQ(sampled['a'], sampled['b']);
+}
+
+INSTANTIATE_TEST_SUITE_P(HistogramSuite, HistogramTesting,
+                         testing::Values(0, 1, 7, 8, 4093, 1 << 16,
+                                         3 * Histogram::min_thread_share + 5));
@@ -2,6 +2,9 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <fstream>
+#include <iterator>
 #include <map>
 #include <queue>
 #include <sstream>
@@ -110,19 +113,19 @@ ADD_TEST(generate_mapping, const string& param, HufTree& tree) {
         frequency_table[count].insert(letter);
     }
 
-    queue<const HufTree*> bfs;
-    bfs.push(&tree);
+    queue<const HufTree::Node*> bfs;
+    bfs.push(&tree.root());
     while (!bfs.empty()) {
         unordered_multiset<character_type> to_erase;
         for (auto _ = bfs.size(); _ > 0; _--) {
             auto node = bfs.front();
             bfs.pop();
-            if (node->left == nullptr) {
+            if (node->is_leaf()) {
                 to_erase.insert(node->letter);
                 continue;
             }
-            bfs.push(node->left.get());
-            bfs.push(node->right.get());
+            bfs.push(&tree.left(*node));
+            bfs.push(&tree.right(*node));
         }
         while (!to_erase.empty()) {
             SCOPED_TRACE("Frequency table: " + to_string(frequency_table));
@@ -153,12 +156,12 @@ ADD_TEST(generate_inverse_mapping, const HufTree& tree,
          unordered_map<character_type, vector<bool>>& imap) {
     imap = Huffman::generate_inverse_mapping(tree);
 
-    queue<pair<const HufTree*, vector<bool>>> bfs;
-    bfs.emplace(&tree, vector<bool>());
+    queue<pair<const HufTree::Node*, vector<bool>>> bfs;
+    bfs.emplace(&tree.root(), vector<bool>());
     while (!bfs.empty()) {
         auto [node, mapping] = std::move(bfs.front());
         bfs.pop();
-        if (node->left == nullptr) {
+        if (node->is_leaf()) {
             SCOPED_TRACE("Letter is: " + to_string(node->letter));
             auto it = imap.find(node->letter);
             ASSERT_NE(it, imap.end());
@@ -166,9 +169,33 @@ ADD_TEST(generate_inverse_mapping, const HufTree& tree,
             continue;
         }
         mapping.emplace_back(0);
-        bfs.emplace(node->left.get(), mapping);
+        bfs.emplace(&tree.left(*node), mapping);
         mapping.back() = 1;
-        bfs.emplace(node->right.get(), std::move(mapping));
+        bfs.emplace(&tree.right(*node), std::move(mapping));
+    }
+}
+
+ADD_TEST(canonical_codes,
+         const unordered_map<character_type, vector<bool>>& encode) {
+    vector<pair<size_t, uint8_t>> letters;
+    for (const auto& [letter, code] : encode) {
+        letters.emplace_back(code.size(), static_cast<uint8_t>(letter));
+    }
+    sort(letters.begin(), letters.end());
+    auto value = [&encode](uint8_t letter) {
+        uint64_t value = 0;
+        for (auto bit : encode.at(static_cast<character_type>(letter))) {
+            value = value << 1 | bit;
+        }
+        return value;
+    };
+    for (size_t i = 1; i < letters.size(); i++) {
+        SCOPED_TRACE("Letter is: " + to_string(static_cast<character_type>(
+                                         letters[i].second)));
+        const auto [length, letter] = letters[i];
+        const auto [previous_length, previous_letter] = letters[i - 1];
+        EXPECT_EQ(value(letter),
+                  (value(previous_letter) + 1) << (length - previous_length));
     }
 }
 
@@ -183,21 +210,22 @@ ADD_TEST(tree_serialization, const HufTree& tree) {
                         BitStream::ibitstream input(filename);
                         Huffman::deserialize_tree(input);
                     }));
-    queue<pair<const HufTree*, const HufTree*>> bfs;
-    bfs.emplace(&tree, &deserialized_tree);
+    ASSERT_EQ(deserialized_tree.nodes.size(), tree.nodes.size());
+    queue<pair<const HufTree::Node*, const HufTree::Node*>> bfs;
+    bfs.emplace(&tree.root(), &deserialized_tree.root());
     while (!bfs.empty()) {
         auto [node, deserialized_node] = bfs.front();
         bfs.pop();
-        if (node->left == nullptr) {
-            EXPECT_EQ(deserialized_node->left, nullptr);
-            EXPECT_EQ(deserialized_node->right, nullptr);
+        if (node->is_leaf()) {
+            EXPECT_TRUE(deserialized_node->is_leaf());
             EXPECT_EQ(node->letter, deserialized_node->letter);
             continue;
         }
-        EXPECT_NE(deserialized_node->left, nullptr);
-        bfs.emplace(node->left.get(), deserialized_node->left.get());
-        EXPECT_NE(deserialized_node->right, nullptr);
-        bfs.emplace(node->right.get(), deserialized_node->right.get());
+        ASSERT_FALSE(deserialized_node->is_leaf());
+        bfs.emplace(&tree.left(*node),
+                    &deserialized_tree.left(*deserialized_node));
+        bfs.emplace(&tree.right(*node),
+                    &deserialized_tree.right(*deserialized_node));
     }
 }
 
@@ -218,13 +246,274 @@ ADD_TEST(text_serialization, const string& param,
     EXPECT_EQ(output.str(), param);
 }
 
+static string read_file(const char* filename) {
+    basic_ifstream<character_type> input(filename, ios::binary);
+    return string(istreambuf_iterator<character_type>(input), {});
+}
+
+ADD_TEST(table_encoding, const string& param,
+         const unordered_map<character_type, vector<bool>>& encode,
+         const HufTree& tree) {
+    {
+        basic_istringstream<character_type> input(param);
+        BitStream::obitstream output("huffman.map");
+        Huffman::serialize_text(input, output, encode);
+    }
+    for (bool pairs : {false, true}) {
+        SCOPED_TRACE("Pairs: " + to_string(pairs));
+        {
+            basic_istringstream<character_type> input(param);
+            BitStream::obitstream output("huffman.flat");
+            Huffman::serialize_text(
+                input, output, Huffman::generate_encode_table(tree, pairs));
+        }
+        EXPECT_EQ(read_file("huffman.flat"), read_file("huffman.map"));
+    }
+}
+
+// The original bit-at-a-time decoder, kept as a reference for the table one
+static string reference_deserialize_text(BitStream::ibitstream& input,
+                                         const HufTree& decode) {
+    string text;
+    while (true) {
+        const HufTree::Node* node = &decode.root();
+        bool bit;
+        while (!node->is_leaf() && (input >> bit)) {
+            node = bit ? &decode.right(*node) : &decode.left(*node);
+        }
+        if (!node->is_leaf()) {
+            throw ios::failure("Not a huf-compressed file!");
+        }
+        if (node->letter == static_cast<character_type>(EOF)) {
+            break;
+        }
+        text += node->letter;
+    }
+    return text;
+}
+
+ADD_TEST(table_decoding, const string& param,
+         const unordered_map<character_type, vector<bool>>& encode,
+         const HufTree& tree) {
+    auto filename = "huffman.table";
+    {
+        basic_istringstream<character_type> input(param);
+        BitStream::obitstream output(filename);
+        Huffman::serialize_text(input, output, encode);
+    }
+    string reference;
+    {
+        BitStream::ibitstream input(filename);
+        ASSERT_NO_THROW(reference = reference_deserialize_text(input, tree));
+    }
+    basic_ostringstream<character_type> output;
+    {
+        const auto table = Huffman::generate_decode_table(tree);
+        BitStream::ibitstream input(filename);
+        ASSERT_NO_THROW(Huffman::deserialize_text(input, output, table));
+    }
+    EXPECT_EQ(output.str(), reference);
+}
+
 TEST_P(HuffmanTesting, integration_test) {
     HufTree tree;
     test_generate_mapping(GetParam(), tree);
     unordered_map<character_type, vector<bool>> encode;
     test_generate_inverse_mapping(tree, encode);
+    test_canonical_codes(encode);
     test_tree_serialization(tree);
     test_text_serialization(GetParam(), encode, tree);
+    test_table_decoding(GetParam(), encode, tree);
+    test_table_encoding(GetParam(), encode, tree);
+}
+
+TEST(HuffmanCanonical, lengths_serialization) {
+    const auto tree = Huffman::generate_mapping(get_count("abracadabra"));
+    const auto lengths = Huffman::generate_code_lengths(tree);
+    auto filename = "huffman.lengths";
+    {
+        BitStream::obitstream output(filename);
+        Huffman::serialize_lengths(output, lengths);
+    }
+    BitStream::ibitstream input(filename);
+    EXPECT_EQ(Huffman::deserialize_lengths(input), lengths);
+}
+
+TEST(HuffmanCanonical, length_deltas) {
+    const auto previous = Huffman::generate_code_lengths(
+        Huffman::generate_mapping(get_count("abracadabra")));
+    const auto lengths = Huffman::generate_code_lengths(
+        Huffman::generate_mapping(get_count("abracadabra cadabra")));
+    vector<character_type> bytes;
+    {
+        BitStream::obitstream output(bytes);
+        Huffman::serialize_length_deltas(output, previous, lengths);
+    }
+    BitStream::ibitstream input{span<const character_type>(bytes)};
+    EXPECT_EQ(Huffman::deserialize_length_deltas(input, previous), lengths);
+
+    // Differences that leave an incomplete code are rejected
+    Huffman::CodeLengths shorter = previous;
+    shorter['a'] = 0;
+    bytes.clear();
+    {
+        BitStream::obitstream output(bytes);
+        Huffman::serialize_length_deltas(output, previous, shorter);
+    }
+    BitStream::ibitstream invalid{span<const character_type>(bytes)};
+    EXPECT_THROW(Huffman::deserialize_length_deltas(invalid, previous),
+                 ios::failure);
+}
+
+TEST(HuffmanCanonical, incomplete_lengths) {
+    Huffman::CodeLengths lengths{};
+    lengths['a'] = 2;
+    lengths['b'] = 2;
+    auto filename = "huffman.incomplete";
+    {
+        BitStream::obitstream output(filename);
+        Huffman::serialize_lengths(output, lengths);
+    }
+    BitStream::ibitstream input(filename);
+    EXPECT_THROW(Huffman::deserialize_lengths(input), ios::failure);
+}
+
+static unordered_map<character_type, count_type> fibonacci_count() {
+    unordered_map<character_type, count_type> count;
+    count_type previous = 1, current = 1;
+    for (character_type letter = 'a'; letter <= 'x'; letter++) {
+        count[letter] = current;
+        previous = exchange(current, previous + current);
+    }
+    ++count[EOF];
+    return count;
+}
+
+TEST(HuffmanLengthLimit, package_merge) {
+    const auto counts = Huffman::to_count_table(fibonacci_count());
+    const auto optimal = Huffman::optimal_encoded_size(counts);
+    EXPECT_EQ(Huffman::encoded_size(
+                  counts, Huffman::generate_code_lengths(
+                              counts, Huffman::max_code_length)),
+              optimal);
+    auto previous = optimal;
+    for (uint8_t max_length = 24; max_length >= 5; max_length--) {
+        SCOPED_TRACE("Maximum length is: " + std::to_string(max_length));
+        const auto lengths =
+            Huffman::generate_code_lengths(counts, max_length);
+        uint64_t kraft = 0;
+        for (auto length : lengths) {
+            EXPECT_LE(length, max_length);
+            kraft += length ? uint64_t(1) << (max_length - length) : 0;
+        }
+        EXPECT_EQ(kraft, uint64_t(1) << max_length);
+        const auto size = Huffman::encoded_size(counts, lengths);
+        EXPECT_GE(size, previous);
+        previous = size;
+    }
+    EXPECT_THROW(Huffman::generate_code_lengths(counts, 4),
+                 invalid_argument);
+}
+
+TEST(HuffmanTree, two_queues) {
+    for (const auto& counts :
+         {Huffman::to_count_table(fibonacci_count()),
+          Huffman::to_count_table(get_count("abracadabra")),
+          Huffman::to_count_table(get_count(string(100, 'x')))}) {
+        const auto tree = Huffman::generate_mapping(counts);
+        EXPECT_EQ(tree.nodes.capacity(), tree.nodes.size());
+        EXPECT_EQ(Huffman::encoded_size(
+                      counts, Huffman::generate_code_lengths(tree)),
+                  Huffman::optimal_encoded_size(counts));
+    }
+}
+
+TEST(HuffmanLengthLimit, limited_decoding) {
+    const auto tree = Huffman::generate_mapping(
+        fibonacci_count(), Huffman::DecodeTable::lookup_bits);
+    const auto table = Huffman::generate_decode_table(tree);
+    for (const auto& entry : table.entries) {
+        EXPECT_LE(entry.length, Huffman::DecodeTable::lookup_bits);
+    }
+}
+
+TEST(HuffmanDecodeTable, long_codes) {
+    // Fibonacci frequencies produce the deepest possible tree, pushing codes
+    // well past the table's lookup width onto the slow path
+    string text;
+    count_type previous = 1, current = 1;
+    for (character_type letter = 'a'; letter <= 'u'; letter++) {
+        text += string(current, letter);
+        previous = exchange(current, previous + current);
+    }
+    for (size_t i = 0; i < text.size(); i++) {
+        swap(text[i], text[(i * 7919) % text.size()]);
+    }
+    HufTree tree;
+    test_generate_mapping(text, tree);
+    unordered_map<character_type, vector<bool>> encode;
+    test_generate_inverse_mapping(tree, encode);
+    size_t longest = 0;
+    for (const auto& [letter, code] : encode) {
+        longest = max(longest, code.size());
+    }
+    ASSERT_GT(longest, Huffman::DecodeTable::lookup_bits);
+    test_table_decoding(text, encode, tree);
+    test_table_encoding(text, encode, tree);
+}
+
+TEST(HuffmanDecodeTable, truncated_input) {
+    const string text = "truncated input must not decode silently";
+    HufTree tree;
+    test_generate_mapping(text, tree);
+    unordered_map<character_type, vector<bool>> encode;
+    test_generate_inverse_mapping(tree, encode);
+    auto filename = "huffman.truncated";
+    {
+        BitStream::obitstream output(filename);
+        for (auto letter : text.substr(0, 5)) {
+            for (auto bit : encode.at(letter)) {
+                output.write(bit);
+            }
+        }
+    }
+    basic_ostringstream<character_type> output;
+    BitStream::ibitstream input(filename);
+    EXPECT_THROW(Huffman::deserialize_text(input, output, tree), ios::failure);
+}
+
+TEST(HuffmanInterleaved, round_trip) {
+    string text;
+    for (size_t i = 0; i < 10007; i++) {
+        text += static_cast<character_type>('a' + (i * i) % 23);
+    }
+    const auto counts = Histogram::count(text);
+    const auto lengths = Huffman::generate_code_lengths(counts, 12);
+    const auto encode = Huffman::generate_encode_table(lengths);
+    const auto decode = Huffman::generate_decode_table(lengths);
+    for (size_t streams : {1, 2, 3, 4, 8}) {
+        SCOPED_TRACE("Streams: " + to_string(streams));
+        vector<vector<character_type>> parts(streams);
+        {
+            vector<BitStream::obitstream> outputs;
+            for (auto& part : parts) {
+                outputs.emplace_back(part);
+            }
+            Huffman::serialize_interleaved(text, outputs, encode);
+        }
+        const auto decode_parts = [&] {
+            vector<BitStream::ibitstream> inputs;
+            for (const auto& part : parts) {
+                inputs.emplace_back(span<const character_type>(part));
+            }
+            string decoded(text.size(), '\0');
+            Huffman::deserialize_interleaved(inputs, decoded, decode);
+            return decoded;
+        };
+        EXPECT_EQ(decode_parts(), text);
+        parts.back().pop_back();
+        EXPECT_THROW(decode_parts(), ios::failure);
+    }
 }
 
 INSTANTIATE_TEST_SUITE_P(
@@ -0,0 +1,117 @@
+#include "lz77.hpp"
+
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+using character_type = Lz77::character_type;
+
+static string random_text(size_t size, size_t letters, unsigned seed) {
+    mt19937 generator(seed);
+    uniform_int_distribution<size_t> letter(0, letters - 1);
+    string text(size, '\0');
+    for (auto& c : text) {
+        c = static_cast<character_type>('a' + letter(generator));
+    }
+    return text;
+}
+
+static vector<character_type> compress(const string& text,
+                                       const Lz77::Parse& parse) {
+    vector<character_type> compressed;
+    {
+        BitStream::obitstream output(compressed);
+        Lz77::serialize_tables(output, parse.tables);
+        Lz77::serialize_text(text, parse, output);
+    }
+    return compressed;
+}
+
+static string decompress(span<const character_type> compressed,
+                         size_t size) {
+    BitStream::ibitstream input(compressed);
+    const auto tables = Lz77::deserialize_tables(input);
+    string text(size, '\0');
+    Lz77::deserialize_text(input, span(text), tables);
+    return text;
+}
+
+// Texts with overlapping copies, distances past the window and long matches
+static vector<string> texts() {
+    string bytes(256, '\0');
+    iota(bytes.begin(), bytes.end(), 0);
+    const auto far = random_text(Lz77::window_size + 1000, 26, 3);
+    return {"",
+            "abc",
+            "abcdabcd",
+            string(10000, 'z'),
+            "abcabcabcabcabcabcabcabcabcabcabx",
+            random_text(20000, 4, 1),
+            random_text(5000, 26, 2) + random_text(5000, 26, 2),
+            far + far.substr(0, 5000),
+            bytes + bytes + bytes};
+}
+
+TEST(Lz77, RoundTrip) {
+    for (const auto& text : texts()) {
+        for (uint8_t level = 1; level <= Lz77::max_level; level += 4) {
+            SCOPED_TRACE("Size: " + to_string(text.size()) +
+                         ", level: " + to_string(level));
+            const auto parse = Lz77::parse(text, level);
+            size_t size = 0;
+            for (const auto& sequence : parse.sequences) {
+                size += sequence.literals + sequence.length;
+                EXPECT_LE(sequence.distance, Lz77::window_size);
+            }
+            EXPECT_EQ(size, text.size());
+            const auto compressed = compress(text, parse);
+            EXPECT_EQ(decompress(compressed, text.size()), text);
+        }
+    }
+}
+
+TEST(Lz77, Matches) {
+    // Runs take a single overlapping copy
+    const auto run = Lz77::parse(string(10000, 'z'));
+    ASSERT_EQ(run.sequences.size(), 1);
+    EXPECT_EQ(run.sequences[0].literals, 1);
+    EXPECT_EQ(run.sequences[0].distance, 1);
+    // Higher levels find at least as much of a repeated text
+    const auto text = random_text(3000, 3, 4) + random_text(3000, 3, 4);
+    EXPECT_LE(Lz77::parse(text, 9).code_bits, Lz77::parse(text, 1).code_bits);
+    EXPECT_THROW(Lz77::parse(text, 0), invalid_argument);
+    EXPECT_THROW(Lz77::parse(text, Lz77::max_level + 1), invalid_argument);
+}
+
+TEST(Lz77, Values) {
+    // Literal runs as long as the largest blocks take all 32 bits
+    for (uint64_t value :
+         {0ull, 15ull, 16ull, 17ull, 1000ull, (1ull << 31) - 1, 1ull << 31,
+          (1ull << 31) + 12345, (1ull << 32) - 1}) {
+        SCOPED_TRACE("Value: " + to_string(value));
+        const auto code = Lz77::value_code(value);
+        vector<character_type> bits;
+        {
+            BitStream::obitstream output(bits);
+            output.put_bits(code.extra, code.extra_bits);
+        }
+        BitStream::ibitstream input{span<const character_type>(bits)};
+        EXPECT_EQ(Lz77::read_value(input, code.code), value);
+    }
+}
+
+TEST(Lz77, InvalidSequences) {
+    const string text = "abcdabcdabcdabcd";
+    const auto compressed = compress(text, Lz77::parse(text));
+    // Longer blocks run out of codes, shorter ones cannot hold the copy
+    EXPECT_THROW(decompress(compressed, text.size() + 100), ios::failure);
+    EXPECT_THROW(decompress(compressed, 6), ios::failure);
+    EXPECT_THROW(decompress(span(compressed).first(compressed.size() / 2),
+                            text.size()),
+                 ios::failure);
+}
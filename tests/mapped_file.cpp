@@ -0,0 +1,67 @@
+#include "mapped_file.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+using namespace std;
+
+using character_type = MappedFile::character_type;
+
+static void write_file(const string& filename, const string& contents) {
+    basic_ofstream<character_type> output(filename, ios::binary);
+    output.write(contents.data(), contents.size());
+}
+
+static string read_file(const string& filename) {
+    basic_ifstream<character_type> input(filename, ios::binary);
+    return string(istreambuf_iterator<character_type>(input), {});
+}
+
+TEST(MappedFileInput, Contents) {
+    string contents(100000, '\0');
+    for (size_t i = 0; i < contents.size(); i++) {
+        contents[i] = static_cast<character_type>(i * 31 % 251);
+    }
+    write_file("mapped_file.input", contents);
+    const MappedFile::Input input("mapped_file.input");
+    ASSERT_TRUE(input);
+    EXPECT_TRUE(ranges::equal(input.data(), contents));
+}
+
+TEST(MappedFileInput, Empty) {
+    write_file("mapped_file.empty", "");
+    const MappedFile::Input input("mapped_file.empty");
+    ASSERT_TRUE(input);
+    EXPECT_TRUE(input.data().empty());
+}
+
+TEST(MappedFileInput, Unmappable) {
+    EXPECT_FALSE(MappedFile::Input("mapped_file.missing"));
+    // Devices are streamed rather than mapped
+    EXPECT_FALSE(MappedFile::Input("/dev/null"));
+}
+
+TEST(MappedFileOutput, Contents) {
+    const string contents = "written through a shared mapping";
+    {
+        write_file("mapped_file.output", "previous and longer contents, gone");
+        const MappedFile::Output output("mapped_file.output",
+                                        contents.size());
+        ASSERT_TRUE(output);
+        ranges::copy(contents, output.data().begin());
+    }
+    EXPECT_EQ(read_file("mapped_file.output"), contents);
+}
+
+TEST(MappedFileOutput, Empty) {
+    {
+        write_file("mapped_file.truncated", "not empty");
+        const MappedFile::Output output("mapped_file.truncated", 0);
+        ASSERT_TRUE(output);
+    }
+    EXPECT_EQ(read_file("mapped_file.truncated"), "");
+}
@@ -0,0 +1,138 @@
+#include "memory.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "libhuffman.h"
+
+using namespace std;
+
+static vector<byte> random_bytes(size_t size, double p, unsigned seed) {
+    mt19937 generator(seed);
+    geometric_distribution<int> distribution(p);
+    vector<byte> bytes(size);
+    for (auto& letter : bytes) {
+        letter = static_cast<byte>(distribution(generator));
+    }
+    return bytes;
+}
+
+class MemoryTesting : public testing::TestWithParam<size_t> {
+   public:
+    ~MemoryTesting() override {}
+};
+
+TEST_P(MemoryTesting, Vector) {
+    const auto input = random_bytes(GetParam(), 0.05, GetParam());
+    vector<byte> compressed{byte{42}};
+    const auto stats =
+        Memory::compress(input, compressed, {.block_size = 4096});
+    // The container is appended to what the vector already holds
+    ASSERT_EQ(compressed.front(), byte{42});
+    const span container(compressed.begin() + 1, compressed.end());
+    EXPECT_EQ(stats.output_size, container.size());
+    EXPECT_LE(container.size(), Memory::compress_bound(input.size()));
+    EXPECT_EQ(Memory::decompressed_size(container), input.size());
+    EXPECT_EQ(Memory::decompress(container, 2), input);
+}
+
+TEST_P(MemoryTesting, Span) {
+    const auto input = random_bytes(GetParam(), 0.001, GetParam());
+    vector<byte> compressed(Memory::compress_bound(input.size()));
+    compressed.resize(Memory::compress(input, span(compressed)));
+    vector<byte> output(input.size() + 10);
+    EXPECT_EQ(Memory::decompress(compressed, span(output)), input.size());
+    output.resize(input.size());
+    EXPECT_EQ(output, input);
+
+    if (!input.empty()) {
+        vector<byte> small(compressed.size() - 1);
+        EXPECT_THROW(Memory::compress(input, span(small)), length_error);
+        // Stops at the first block that does not fit, workers or not
+        EXPECT_THROW(Memory::compress(input, span(small),
+                                      {.block_size = 4096, .threads = 4}),
+                     length_error);
+        output.pop_back();
+        EXPECT_THROW(Memory::decompress(compressed, span(output)),
+                     length_error);
+    }
+}
+
+TEST_P(MemoryTesting, CInterface) {
+    const auto input = random_bytes(GetParam(), 0.05, GetParam());
+    vector<byte> compressed(huf_compress_bound(input.size()));
+    size_t compressed_size;
+    ASSERT_EQ(huf_compress(input.data(), input.size(), compressed.data(),
+                           compressed.size(), &compressed_size, 0),
+              HUF_OK);
+    uint64_t size;
+    ASSERT_EQ(
+        huf_decompressed_size(compressed.data(), compressed_size, &size),
+        HUF_OK);
+    EXPECT_EQ(size, input.size());
+    vector<byte> output(size);
+    size_t output_size;
+    ASSERT_EQ(huf_decompress(compressed.data(), compressed_size,
+                             output.data(), output.size(), &output_size, 2),
+              HUF_OK);
+    EXPECT_EQ(output_size, input.size());
+    EXPECT_EQ(output, input);
+
+    EXPECT_EQ(huf_decompress(compressed.data(), 5, output.data(),
+                             output.size(), &output_size, 1),
+              HUF_INVALID_INPUT);
+    if (!input.empty()) {
+        EXPECT_EQ(huf_compress(input.data(), input.size(), compressed.data(),
+                               compressed_size - 1, &compressed_size, 1),
+                  HUF_BUFFER_TOO_SMALL);
+    }
+}
+
+TEST(MemoryDictionary, RoundTrip) {
+    const auto dictionary = Container::train({});
+    vector<byte> file;
+    {
+        basic_ostringstream<Container::character_type> output;
+        Container::write_dictionary(output, dictionary);
+        for (auto letter : output.str()) {
+            file.push_back(static_cast<byte>(letter));
+        }
+    }
+    EXPECT_EQ(Memory::read_dictionary(file).id, dictionary.id);
+    // Incompressible input fills the bound, dictionary id included
+    const auto input = random_bytes(100000, 0.0001, 3);
+    const Container::Options options{.dictionary = &dictionary};
+    vector<byte> compressed(Memory::compress_bound(input.size(), options));
+    compressed.resize(Memory::compress(input, span(compressed), options));
+    EXPECT_EQ(Memory::decompress(compressed, 2, &dictionary), input);
+    EXPECT_THROW(Memory::decompress(compressed), ios::failure);
+
+    huf_dictionary* handle;
+    ASSERT_EQ(huf_dictionary_load(file.data(), file.size(), &handle), HUF_OK);
+    size_t compressed_size;
+    ASSERT_EQ(huf_compress_dict(input.data(), input.size(), compressed.data(),
+                                huf_compress_bound(input.size()),
+                                &compressed_size, 1, handle),
+              HUF_OK);
+    vector<byte> output(input.size());
+    size_t output_size;
+    EXPECT_EQ(huf_decompress(compressed.data(), compressed_size,
+                             output.data(), output.size(), &output_size, 1),
+              HUF_INVALID_INPUT);
+    ASSERT_EQ(huf_decompress_dict(compressed.data(), compressed_size,
+                                  output.data(), output.size(), &output_size,
+                                  1, handle),
+              HUF_OK);
+    EXPECT_EQ(output, input);
+    huf_dictionary_free(handle);
+    EXPECT_EQ(huf_dictionary_load(input.data(), 10, &handle),
+              HUF_INVALID_INPUT);
+}
+
+INSTANTIATE_TEST_SUITE_P(MemorySuite, MemoryTesting,
+                         testing::Values(0, 1, 1000, 100000, 1 << 21));
@@ -0,0 +1,134 @@
+#include "symbols.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+using character_type = Symbols::character_type;
+using Symbols::Kind;
+
+// Letters of a CJK-like script, a few of them frequent and most rare
+static u32string wide_text(size_t size, unsigned seed) {
+    mt19937 generator(seed);
+    geometric_distribution<int> rank(0.002);
+    u32string text(size, U'\0');
+    for (auto& letter : text) {
+        letter = static_cast<char32_t>(0x4E00 + rank(generator) % 0x5000);
+        if (letter % 17 == 0) {
+            letter = U'。';
+        }
+    }
+    return text;
+}
+
+static string utf8(const u32string& text) {
+    string bytes;
+    for (auto letter : text) {
+        array<character_type, 4> buffer;
+        const auto size = Symbols::Alphabet<char32_t>::write(letter, buffer);
+        bytes.append(buffer.data(), size);
+    }
+    return bytes;
+}
+
+static string utf16(const u32string& text) {
+    string bytes;
+    for (auto letter : text) {
+        bytes += static_cast<character_type>(letter);
+        bytes += static_cast<character_type>(letter >> 8);
+    }
+    return bytes;
+}
+
+static string round_trip(const string& text, const Symbols::Model& model) {
+    vector<character_type> bytes;
+    {
+        BitStream::obitstream output(bytes);
+        Symbols::serialize_model(output, model);
+        Symbols::serialize_text(text, output, model);
+    }
+    BitStream::ibitstream input{span<const character_type>(bytes)};
+    const auto read = Symbols::deserialize_model(input);
+    EXPECT_EQ(read.kind, model.kind);
+    EXPECT_EQ(read.symbols, model.symbols);
+    EXPECT_EQ(read.lengths, model.lengths);
+    string decoded(text.size(), '\0');
+    Symbols::deserialize_text(input, span(decoded), read);
+    return decoded;
+}
+
+TEST(Symbols, Utf8) {
+    using Alphabet = Symbols::Alphabet<char32_t>;
+    const string text = "a\xC3\xA9\xE4\xB8\xAD\xF0\x9F\x98\x80";
+    vector<char32_t> letters;
+    for (size_t position = 0; position < text.size();) {
+        char32_t letter;
+        position += Alphabet::read(span(text).subspan(position), letter);
+        letters.push_back(letter);
+    }
+    EXPECT_EQ(letters, (vector<char32_t>{U'a', 0xE9, 0x4E2D, 0x1F600}));
+
+    // Overlong, truncated and stray bytes stand for themselves
+    for (const string invalid : {"\xC0\x80", "\xE4\xB8", "\x80", "\xFF"}) {
+        char32_t letter;
+        EXPECT_EQ(Alphabet::read(invalid, letter), 1);
+        EXPECT_EQ(letter,
+                  Alphabet::invalid_byte + static_cast<uint8_t>(invalid[0]));
+        array<character_type, 4> bytes;
+        EXPECT_EQ(Alphabet::write(letter, bytes), 1);
+        EXPECT_EQ(bytes[0], invalid[0]);
+    }
+    array<character_type, 2> small;
+    EXPECT_EQ(Alphabet::write(0x4E2D, small), 0);
+    EXPECT_EQ(Alphabet::write(Alphabet::invalid_byte + 0x100, small), 0);
+}
+
+TEST(Symbols, RoundTrip) {
+    mt19937 generator(1);
+    string noise(3001, '\0');
+    for (auto& letter : noise) {
+        letter = static_cast<character_type>(generator());
+    }
+    const auto wide = wide_text(20000, 2);
+    for (const auto& text :
+         {string(), string("aaaa"), noise, utf8(wide), utf16(wide) + 'x',
+          utf8(wide).substr(1) + noise}) {
+        for (auto kind : {Kind::bytes, Kind::units16, Kind::utf8}) {
+            SCOPED_TRACE("Size: " + to_string(text.size()) +
+                         ", kind: " + to_string(static_cast<int>(kind)));
+            EXPECT_EQ(round_trip(text, Symbols::build_model(text, kind)), text);
+            EXPECT_EQ(round_trip(text, Symbols::build_model(text, kind, 4)),
+                      text);
+        }
+    }
+}
+
+TEST(Symbols, WideText) {
+    const auto wide = wide_text(100000, 3);
+    for (const auto& [text, kind] :
+         {pair{utf8(wide), Kind::utf8}, pair{utf16(wide), Kind::units16}}) {
+        SCOPED_TRACE("Kind: " + to_string(static_cast<int>(kind)));
+        const auto model = Symbols::build_model(text, kind);
+        EXPECT_LE(model.symbols.size(), Symbols::max_symbols);
+        // Codes per letter rather than per byte beat the best byte code
+        const auto counts = Histogram::count(span(text));
+        EXPECT_LT(model.code_bits, Huffman::optimal_encoded_size(counts));
+        uint64_t coded = 0;
+        for (auto count : model.code_lengths) {
+            coded += count;
+        }
+        EXPECT_EQ(coded, wide.size());
+    }
+
+    // Letters seen once are escaped, and so are those past the room the
+    // code lengths leave
+    const auto once = utf8(U"一丁丂丂");
+    EXPECT_EQ(Symbols::build_model(once, Kind::utf8).symbols,
+              vector<char32_t>{0x4E02});
+    EXPECT_EQ(Symbols::build_model(utf8(wide), Kind::utf8, 3).symbols.size(),
+              7);
+}
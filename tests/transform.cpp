@@ -0,0 +1,100 @@
+#include "transform.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+using character_type = Transform::character_type;
+
+static string random_text(size_t size, size_t letters, unsigned seed) {
+    mt19937 generator(seed);
+    uniform_int_distribution<size_t> letter(0, letters - 1);
+    string text(size, '\0');
+    for (auto& c : text) {
+        c = static_cast<character_type>('a' + letter(generator));
+    }
+    return text;
+}
+
+// Texts that exercise the recursion of SA-IS and the escapes of high ranks
+static vector<string> texts() {
+    string bytes(256, '\0');
+    iota(bytes.begin(), bytes.end(), 0);
+    string repeats;
+    for (int i = 0; i < 50; i++) {
+        repeats += "abracadabra" + string(i % 7, 'a');
+    }
+    return {"",
+            "a",
+            "banana",
+            string(1000, 'z'),
+            "mississippi",
+            repeats,
+            random_text(5000, 2, 1),
+            random_text(20000, 26, 2),
+            bytes + bytes + string(bytes.rbegin(), bytes.rend())};
+}
+
+TEST(Transform, SuffixArray) {
+    for (const auto& text : texts()) {
+        SCOPED_TRACE("Size: " + to_string(text.size()));
+        vector<uint32_t> expected(text.size());
+        iota(expected.begin(), expected.end(), 0);
+        const string_view view(text);
+        sort(expected.begin(), expected.end(),
+             [&view](uint32_t first, uint32_t second) {
+                 return view.substr(first) < view.substr(second);
+             });
+        EXPECT_EQ(Transform::suffix_array(text), expected);
+    }
+}
+
+TEST(Transform, RoundTrip) {
+    for (const auto& text : texts()) {
+        SCOPED_TRACE("Size: " + to_string(text.size()));
+        const auto transformed = Transform::forward(text);
+        string restored(text.size(), '\0');
+        Transform::inverse(transformed, span(restored));
+        EXPECT_EQ(restored, text);
+    }
+    // Runs of a letter shrink to a few ranks
+    EXPECT_LE(Transform::forward(string(1000, 'z')).ranks.size(), 11);
+}
+
+// A thread sorts every block in the buffers of the block before it, which
+// must not leak into the result whatever their sizes
+TEST(Transform, KeptBuffers) {
+    const auto all = texts();
+    vector<Transform::Transformed> expected;
+    for (const auto& text : all) {
+        expected.push_back(Transform::forward(text));
+    }
+    for (auto i = all.size(); i-- > 0;) {
+        SCOPED_TRACE("Size: " + to_string(all[i].size()));
+        const auto transformed = Transform::forward(all[i]);
+        EXPECT_EQ(transformed.primary, expected[i].primary);
+        EXPECT_EQ(transformed.ranks, expected[i].ranks);
+    }
+}
+
+TEST(Transform, InvalidRanks) {
+    const auto transformed = Transform::forward(string("mississippi"));
+    string restored(11, '\0');
+    auto bad = transformed;
+    bad.primary = 12;
+    EXPECT_THROW(Transform::inverse(bad, span(restored)), ios::failure);
+    bad = transformed;
+    bad.ranks.pop_back();
+    EXPECT_THROW(Transform::inverse(bad, span(restored)), ios::failure);
+    bad = transformed;
+    bad.ranks.push_back(static_cast<character_type>(255));
+    EXPECT_THROW(Transform::inverse(bad, span(restored)), ios::failure);
+    string longer(12, '\0');
+    EXPECT_THROW(Transform::inverse(transformed, span(longer)), ios::failure);
+}
@@ -0,0 +1,112 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+Parallel::ThreadPool::ThreadPool(std::size_t threads) {
+    if (threads <= 1) {
+        return;
+    }
+    workers.reserve(threads);
+    for (std::size_t i = 0; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+Parallel::ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void Parallel::ThreadPool::work() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mutex);
+            ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+Parallel::StealingPool::StealingPool(std::size_t threads)
+    : queues(std::max<std::size_t>(threads, 1)) {
+    workers.reserve(queues.size());
+    for (std::size_t worker = 0; worker < queues.size(); worker++) {
+        workers.emplace_back(&StealingPool::work, this, worker);
+    }
+}
+
+Parallel::StealingPool::~StealingPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void Parallel::StealingPool::push(std::function<void()> task) {
+    {
+        // Counted under the lock the task is queued in, so a worker that
+        // takes it right away never finds the count short
+        std::lock_guard lock(mutex);
+        auto& queue = queues[next++ % queues.size()];
+        {
+            std::lock_guard queue_lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        ++queued;
+    }
+    ready.notify_one();
+}
+
+bool Parallel::StealingPool::pop(std::size_t worker,
+                                 std::function<void()>& task) {
+    for (std::size_t i = 0; i < queues.size(); i++) {
+        auto& queue = queues[(worker + i) % queues.size()];
+        {
+            std::lock_guard lock(queue.mutex);
+            if (queue.tasks.empty()) {
+                continue;
+            }
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        std::lock_guard lock(mutex);
+        --queued;
+        return true;
+    }
+    return false;
+}
+
+void Parallel::StealingPool::work(std::size_t worker) {
+    while (true) {
+        std::function<void()> task;
+        if (pop(worker, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock lock(mutex);
+        ready.wait(lock, [this] { return stopping || queued != 0; });
+        if (queued == 0) {
+            return;
+        }
+    }
+}
+
+std::size_t Parallel::default_threads() {
+    return std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Parallel {
+
+// Fixed set of workers running tasks in submission order. A pool of one
+// thread has no workers and runs each task as it is submitted, on the
+// submitting thread.
+class ThreadPool {
+   public:
+    explicit ThreadPool(std::size_t threads);
+    // Finishes the queued tasks before joining the workers
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename F>
+    std::future<std::invoke_result_t<F>> submit(F&& task) {
+        using Result = std::invoke_result_t<F>;
+        if (workers.empty()) {
+            std::packaged_task<Result()> packaged(std::forward<F>(task));
+            auto result = packaged.get_future();
+            packaged();
+            return result;
+        }
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(
+            std::forward<F>(task));
+        auto result = packaged->get_future();
+        {
+            std::lock_guard lock(mutex);
+            tasks.emplace([packaged] { (*packaged)(); });
+        }
+        ready.notify_one();
+        return result;
+    }
+
+    // Threads running the tasks, the submitting one for a pool without
+    // workers
+    std::size_t size() const {
+        return std::max<std::size_t>(workers.size(), 1);
+    }
+
+   private:
+    void work();
+
+   private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::queue<std::function<void()>> tasks;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+// Workers with a queue each, for many tasks of uneven length: tasks are
+// dealt out round-robin, and a worker whose queue runs dry steals from the
+// others instead of idling, so a long task does not hold up those dealt
+// behind it. Queues are run oldest task first.
+class StealingPool {
+   public:
+    explicit StealingPool(std::size_t threads);
+    // Finishes the queued tasks before joining the workers
+    ~StealingPool();
+    StealingPool(const StealingPool&) = delete;
+    StealingPool& operator=(const StealingPool&) = delete;
+
+    template <typename F>
+    std::future<std::invoke_result_t<F>> submit(F&& task) {
+        using Result = std::invoke_result_t<F>;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(
+            std::forward<F>(task));
+        auto result = packaged->get_future();
+        push([packaged] { (*packaged)(); });
+        return result;
+    }
+
+    std::size_t size() const { return workers.size(); }
+
+   private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void push(std::function<void()> task);
+    // Takes a task from the worker's own queue, or else from another's
+    bool pop(std::size_t worker, std::function<void()>& task);
+    void work(std::size_t worker);
+
+   private:
+    std::vector<Queue> queues;
+    // Guards `queued`, which lets idle workers sleep until there is work
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::size_t queued = 0;
+    std::size_t next = 0;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+// Runs tasks on a pool and hands their results to `consume` in submission
+// order, keeping at most `limit` tasks in flight, two per thread by default.
+// Results that are ready are handed over at every submission, so a slow
+// producer does not leave them waiting for the limit.
+template <typename Result, typename Pool = ThreadPool>
+class InOrder {
+   public:
+    InOrder(Pool& pool, std::function<void(Result)> consume,
+            std::size_t limit = 0)
+        : pool(pool),
+          consume(std::move(consume)),
+          limit(limit != 0 ? limit : 2 * pool.size()) {}
+
+    template <typename F>
+    void submit(F&& task) {
+        pending.push_back(pool.submit(std::forward<F>(task)));
+        if (pending.size() >= limit) {
+            next();
+        }
+        while (!pending.empty() &&
+               pending.front().wait_for(std::chrono::seconds(0)) ==
+                   std::future_status::ready) {
+            next();
+        }
+    }
+
+    void finish() {
+        while (!pending.empty()) {
+            next();
+        }
+    }
+
+   private:
+    void next() {
+        auto result = pending.front().get();
+        pending.pop_front();
+        consume(std::move(result));
+    }
+
+   private:
+    Pool& pool;
+    std::function<void(Result)> consume;
+    std::size_t limit;
+    std::deque<std::future<Result>> pending;
+};
+
+// Bounded queue handing values from one stage of a pipeline to the next:
+// `push` waits while it is full and `pop` while it is empty. Closing it
+// wakes both sides, after which `pop` drains what is left and `push` drops
+// its value.
+template <typename T>
+class Channel {
+   public:
+    explicit Channel(std::size_t capacity) : capacity(capacity) {}
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    // Returns false once the channel is closed
+    bool push(T value) {
+        {
+            std::unique_lock lock(mutex);
+            not_full.wait(lock, [this] {
+                return closed || values.size() < capacity;
+            });
+            if (closed) {
+                return false;
+            }
+            values.push_back(std::move(value));
+        }
+        not_empty.notify_one();
+        return true;
+    }
+
+    // Empty once the channel is closed and drained
+    std::optional<T> pop() {
+        std::unique_lock lock(mutex);
+        not_empty.wait(lock, [this] { return closed || !values.empty(); });
+        return take(lock);
+    }
+
+    // Empty if no value is queued right now
+    std::optional<T> try_pop() {
+        std::unique_lock lock(mutex);
+        return take(lock);
+    }
+
+    void close() {
+        {
+            std::lock_guard lock(mutex);
+            closed = true;
+        }
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+   private:
+    std::optional<T> take(std::unique_lock<std::mutex>& lock) {
+        if (values.empty()) {
+            return std::nullopt;
+        }
+        std::optional<T> value(std::move(values.front()));
+        values.pop_front();
+        lock.unlock();
+        not_full.notify_one();
+        return value;
+    }
+
+   private:
+    std::size_t capacity;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<T> values;
+    bool closed = false;
+};
+
+// Number of threads to use when the user did not ask for a count
+std::size_t default_threads();
+}  // namespace Parallel
@@ -0,0 +1,346 @@
+#include "transform.hpp"
+
+#include <algorithm>
+#include <array>
+#include <ios>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+[[noreturn]] static void invalid_file() {
+    throw std::ios::failure("Not a huf-compressed file!");
+}
+
+namespace {
+using Text = std::vector<std::int32_t>;
+constexpr std::int32_t empty = -1;
+
+// Buffers of one level of SA-IS and of the levels below it
+struct Workspace {
+    // L-type positions start suffixes larger than the one after them
+    std::vector<std::uint8_t> larger;
+    // Leftmost S-type positions in text order
+    std::vector<std::int32_t> lms;
+    // The same in sorted order; holds the reduced text meanwhile
+    std::vector<std::int32_t> sorted;
+    // Suffix array of the reduced text
+    Text order;
+    std::unique_ptr<Workspace> next;
+};
+
+// A block's suffix array and workspace
+struct Sorter {
+    Text sa;
+    Workspace workspace;
+};
+
+// The bytes of a block moved up by one, followed by a sentinel 0, read in
+// place rather than widened to a Text
+class Shifted {
+   public:
+    explicit Shifted(std::span<const Transform::character_type> bytes)
+        : bytes(bytes) {}
+
+    std::size_t size() const { return bytes.size() + 1; }
+    std::int32_t operator[](std::size_t i) const {
+        return i < bytes.size() ? static_cast<std::uint8_t>(bytes[i]) + 1 : 0;
+    }
+
+   private:
+    std::span<const Transform::character_type> bytes;
+};
+}  // namespace
+
+// Whether position `i` starts a leftmost S-type suffix
+static bool is_lms(const std::vector<std::uint8_t>& larger, std::size_t i) {
+    return i > 0 && !larger[i] && larger[i - 1];
+}
+
+// Sorts every suffix from the sorted LMS suffixes `lms`, placing the L-type
+// suffixes from left to right, then the S-type ones from right to left
+template <typename Letters>
+static void induce(const Letters& text, std::size_t alphabet,
+                   const std::vector<std::uint8_t>& larger,
+                   const std::vector<std::int32_t>& lms, Text& sa) {
+    std::vector<std::int32_t> heads(alphabet + 1);
+    for (std::size_t i = 0; i < text.size(); i++) {
+        ++heads[text[i] + 1];
+    }
+    std::partial_sum(heads.begin(), heads.end(), heads.begin());
+    auto tails = heads;
+    std::fill(sa.begin(), sa.end(), empty);
+    for (auto i = lms.size(); i-- > 0;) {
+        sa[--tails[text[lms[i]] + 1]] = lms[i];
+    }
+    auto next = heads;
+    for (std::size_t k = 0; k < sa.size(); k++) {
+        const auto i = sa[k];
+        if (i > 0 && larger[i - 1]) {
+            sa[next[text[i - 1]]++] = i - 1;
+        }
+    }
+    tails = heads;
+    for (auto k = sa.size(); k-- > 1;) {
+        const auto i = sa[k];
+        if (i > 0 && !larger[i - 1]) {
+            sa[--tails[text[i - 1] + 1]] = i - 1;
+        }
+    }
+}
+
+// SA-IS over `text`, whose letters are below `alphabet` and whose last
+// letter is a sentinel smaller than every other, into `sa`
+template <typename Letters>
+static void sais(const Letters& text, std::size_t alphabet, Text& sa,
+                 Workspace& workspace) {
+    const auto size = text.size();
+    sa.resize(size);
+    if (size == 1) {
+        sa[0] = 0;
+        return;
+    }
+    auto& larger = workspace.larger;
+    auto& lms = workspace.lms;
+    larger.assign(size, 0);
+    std::size_t count = 0;
+    for (auto i = size - 1; i-- > 0;) {
+        larger[i] = text[i] > text[i + 1] ||
+                    (text[i] == text[i + 1] && larger[i + 1]);
+        count += larger[i] && !larger[i + 1];
+    }
+    // Sized exactly, as growing them would take up to twice the room
+    lms.clear();
+    lms.reserve(count);
+    for (std::size_t i = 1; i < size; i++) {
+        if (::is_lms(larger, i)) {
+            lms.push_back(static_cast<std::int32_t>(i));
+        }
+    }
+    ::induce(text, alphabet, larger, lms, sa);
+
+    // Names the LMS substrings in their induced order, equal substrings
+    // sharing a name; `sa` holds the name of every LMS position meanwhile
+    auto& sorted = workspace.sorted;
+    sorted.clear();
+    sorted.reserve(count);
+    for (auto i : sa) {
+        if (::is_lms(larger, i)) {
+            sorted.push_back(i);
+        }
+    }
+    auto& names = sa;
+    std::int32_t name = 0;
+    names[sorted[0]] = name;
+    for (std::size_t k = 1; k < sorted.size(); k++) {
+        auto a = static_cast<std::size_t>(sorted[k - 1]);
+        auto b = static_cast<std::size_t>(sorted[k]);
+        bool differ = text[a] != text[b];
+        while (!differ) {
+            ++a, ++b;
+            const bool end_a = ::is_lms(larger, a);
+            const bool end_b = ::is_lms(larger, b);
+            if (text[a] != text[b] || end_a != end_b) {
+                differ = true;
+            } else if (end_a) {
+                break;
+            }
+        }
+        names[sorted[k]] = differ ? ++name : name;
+    }
+
+    // Equal names need the reduced text sorted recursively
+    if (static_cast<std::size_t>(name) + 1 < lms.size()) {
+        auto& reduced = sorted;
+        for (std::size_t k = 0; k < lms.size(); k++) {
+            reduced[k] = names[lms[k]];
+        }
+        if (!workspace.next) {
+            workspace.next = std::make_unique<Workspace>();
+        }
+        ::sais(reduced, name + 1, workspace.order, *workspace.next);
+        for (std::size_t k = 0; k < lms.size(); k++) {
+            sorted[k] = lms[workspace.order[k]];
+        }
+    }
+    ::induce(text, alphabet, larger, sorted, sa);
+}
+
+// Fills `sorter.sa` with the suffix array of `text` followed by the
+// sentinel, which comes first
+static void sort_suffixes(std::span<const Transform::character_type> text,
+                          Sorter& sorter) {
+    if (text.size() > Transform::max_block) {
+        throw std::invalid_argument("Text is too long to sort");
+    }
+    ::sais(Shifted(text), 257, sorter.sa, sorter.workspace);
+}
+
+std::vector<std::uint32_t> Transform::suffix_array(
+    std::span<const character_type> text) {
+    Sorter sorter;
+    ::sort_suffixes(text, sorter);
+    return std::vector<std::uint32_t>(sorter.sa.begin() + 1, sorter.sa.end());
+}
+
+// Writes a run of `run` ranks 0 in bijective base 2
+static void write_run(std::vector<Transform::character_type>& ranks,
+                      std::size_t run) {
+    if (run == 0) {
+        return;
+    }
+    for (auto digits = run - 1;; digits = (digits - 2) / 2) {
+        ranks.push_back(static_cast<Transform::character_type>(digits & 1));
+        if (digits < 2) {
+            break;
+        }
+    }
+}
+
+// Moves the letter at `rank` of `order` to its front and returns it. A
+// byte-sized rank shows the compiler that the shift stays in the array.
+static std::uint8_t move_to_front(std::array<std::uint8_t, 256>& order,
+                                  std::uint8_t rank) {
+    const auto letter = order[rank];
+    for (std::size_t i = rank; i > 0; i--) {
+        order[i] = order[i - 1];
+    }
+    order[0] = letter;
+    return letter;
+}
+
+Transform::Transformed Transform::forward(
+    std::span<const character_type> block) {
+    Transformed transformed{.primary = 0, .ranks = {}};
+    if (block.empty()) {
+        return transformed;
+    }
+    // Blocks up to `max_kept_block` reuse the buffers their thread sorted
+    // the last one in
+    thread_local Sorter kept;
+    Sorter own;
+    auto& sorter = block.size() <= max_kept_block ? kept : own;
+    ::sort_suffixes(block, sorter);
+
+    std::array<std::uint8_t, 256> order;
+    std::iota(order.begin(), order.end(), 0);
+    auto& ranks = transformed.ranks;
+    std::size_t run = 0;
+    const auto code = [&](character_type letter) {
+        const auto value = static_cast<std::uint8_t>(letter);
+        if (order[0] == value) {
+            ++run;
+            return;
+        }
+        ::write_run(ranks, std::exchange(run, 0));
+        const auto rank = static_cast<std::size_t>(
+            std::find(order.begin(), order.end(), value) - order.begin());
+        ::move_to_front(order, static_cast<std::uint8_t>(rank));
+        if (rank <= 253) {
+            ranks.push_back(static_cast<character_type>(rank + 1));
+        } else {
+            ranks.push_back(static_cast<character_type>(255));
+            ranks.push_back(static_cast<character_type>(rank - 254));
+        }
+    };
+    // Row 0 is the rotation starting with the sentinel, the others follow
+    // the suffix array; the sentinel's own row is left out of the last
+    // column
+    code(block.back());
+    for (std::size_t row = 1; row < sorter.sa.size(); row++) {
+        if (sorter.sa[row] == 0) {
+            transformed.primary = static_cast<std::uint32_t>(row);
+        } else {
+            code(block[sorter.sa[row] - 1]);
+        }
+    }
+    ::write_run(ranks, run);
+    return transformed;
+}
+
+// Undoes move-to-front and the runs into the last column `last`
+static void decode_ranks(std::span<const Transform::character_type> ranks,
+                         std::span<Transform::character_type> last) {
+    std::array<std::uint8_t, 256> order;
+    std::iota(order.begin(), order.end(), 0);
+    std::size_t position = 0;
+    std::size_t run = 0;
+    std::size_t weight = 1;
+    const auto end_run = [&] {
+        std::fill_n(last.begin() + position, run,
+                    static_cast<Transform::character_type>(order[0]));
+        position += run;
+        run = 0;
+        weight = 1;
+    };
+    for (std::size_t i = 0; i < ranks.size(); i++) {
+        const auto code = static_cast<std::uint8_t>(ranks[i]);
+        if (code < 2) {
+            run += weight << code;
+            weight <<= 1;
+            if (run > last.size() - position) {
+                ::invalid_file();
+            }
+            continue;
+        }
+        end_run();
+        std::size_t rank = code - 1;
+        if (code == 255) {
+            if (++i == ranks.size() ||
+                static_cast<std::uint8_t>(ranks[i]) > 1) {
+                ::invalid_file();
+            }
+            rank = 254 + static_cast<std::uint8_t>(ranks[i]);
+        }
+        if (position == last.size()) {
+            ::invalid_file();
+        }
+        last[position++] = static_cast<Transform::character_type>(
+            ::move_to_front(order, static_cast<std::uint8_t>(rank)));
+    }
+    end_run();
+    if (position != last.size()) {
+        ::invalid_file();
+    }
+}
+
+void Transform::inverse(const Transformed& transformed,
+                        std::span<character_type> block) {
+    const auto size = block.size();
+    const auto primary = transformed.primary;
+    if (size == 0 ? primary != 0 : primary == 0 || primary > size) {
+        ::invalid_file();
+    }
+    std::vector<character_type> last(size);
+    ::decode_ranks(transformed.ranks, last);
+
+    // Rows before the sentinel's keep their place in `last`, later ones
+    // move down by one. Walking back from the sentinel's rotation with the
+    // last-to-first mapping yields the block from its end.
+    const auto letter_of = [&](std::size_t row) {
+        return static_cast<std::uint8_t>(last[row < primary ? row : row - 1]);
+    };
+    std::array<std::uint32_t, 256> first{};
+    for (auto letter : last) {
+        ++first[static_cast<std::uint8_t>(letter)];
+    }
+    // The sentinel's row comes first
+    std::uint32_t total = 1;
+    for (auto& count : first) {
+        total += std::exchange(count, total);
+    }
+    std::vector<std::uint32_t> next(size + 1);
+    for (std::size_t row = 0; row <= size; row++) {
+        if (row != primary) {
+            next[row] = first[letter_of(row)]++;
+        }
+    }
+    std::size_t row = 0;
+    for (auto position = size; position-- > 0;) {
+        if (row == primary) {
+            ::invalid_file();
+        }
+        block[position] = static_cast<character_type>(letter_of(row));
+        row = next[row];
+    }
+}
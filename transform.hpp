@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "bitstream.hpp"
+
+// Block-sorting pre-transform: the Burrows-Wheeler transform groups letters
+// by the text that follows them, move-to-front turns the groups into runs
+// of small ranks, and the runs of rank 0 are counted rather than repeated.
+// What is left codes far smaller with an order-0 Huffman code.
+namespace Transform {
+
+using character_type = BitStream::character_type;
+
+// Larger blocks are left alone, which bounds the suffix array to 32-bit
+// positions
+constexpr std::size_t max_block = std::size_t(1) << 28;
+
+// Sorting a block takes about 9 bytes per byte of the block on text: its
+// 32-bit suffix array, a byte per position and the smaller buffers of the
+// recursion. Blocks up to this size sort in buffers their thread keeps for
+// the next block; larger ones free theirs.
+constexpr std::size_t max_kept_block = std::size_t(1) << 22;
+
+// Positions of the suffixes of `text` in sorted order, built with SA-IS in
+// linear time
+std::vector<std::uint32_t> suffix_array(std::span<const character_type> text);
+
+// A block after the transform
+struct Transformed {
+    // Row of the block itself among the sorted rotations of the block
+    // followed by a sentinel smaller than every letter
+    std::uint32_t primary;
+    // Move-to-front ranks of the last column, the sentinel left out. Runs of
+    // rank 0 are written as their length in bijective base 2, with digits
+    // 0 and 1; ranks 1 to 253 as 2 to 254, and higher ones as 255 followed
+    // by the rank less 254.
+    std::vector<character_type> ranks;
+};
+
+Transformed forward(std::span<const character_type> block);
+
+// Restores exactly `block.size()` bytes; throws if `transformed` does not
+// describe a block of that size
+void inverse(const Transformed& transformed, std::span<character_type> block);
+}  // namespace Transform